@@ -0,0 +1,755 @@
+// bench -- benchmarks for a simple text editor
+//
+// By Jaldhar H. Vyas <jaldhar@braincells.com>
+// Copyright (C) 2017, Consolidated Braincells Inc. All rights reserved.
+// "Do what thou wilt" shall be the whole of the license.
+//
+// Times the core operations of each Buffer backend (and Subeditor's line
+// motion) over buffers from 1KB to 1GB.  Results are printed one per line as
+// tab separated fields with a header line so they can be kept and compared
+// from one release to the next.
+//
+// Usage: bench [-k kernel] [-s size]... [-t threads] [benchmark]...
+//
+// -k picks the scan kernel (avx2, sse2 or scalar) instead of the best one the
+// CPU can run.  -s can be given several times; sizes may end in K, M or G.
+// -t is how many threads find-all uses (by default, one per processor) so
+// runs with different numbers can be compared.  With no benchmark names, all
+// of them are run.
+//
+// highlight-check and screen aren't timed and each prints a table of its own
+// after the others.  highlight-check edits small texts at random and checks
+// that what would be painted is highlighted just as lexing the whole text
+// from the start would, and bench fails if it isn't.  screen draws frames
+// like the editor's on a 30 by 100 xterm-256color (as described by terminfo;
+// no terminal is needed) and prints how many bytes it takes to show each
+// kind of change.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include <unistd.h>
+using namespace std;
+
+#include "buffer.h"
+#include "highlight.h"
+#include "paged.h"
+#include "piecetable.h"
+#include "scan.h"
+#include "screen.h"
+#include "search.h"
+#include "subeditor.h"
+
+using GapBuffer = Buffer<char, 80>;
+using PieceBuffer = Buffer<char, 80, PieceTable<char>>;
+using PagedBuffer = Buffer<char, 80, PagedText<char>>;
+using Text = shared_ptr<const string>;
+
+#if defined(PAGED_TEXT)
+static const char* SUBEDITORBACKEND = "paged";
+#elif defined(PIECE_TABLE)
+static const char* SUBEDITORBACKEND = "piece";
+#else
+static const char* SUBEDITORBACKEND = "gap";
+#endif
+
+// Every search looks for this and it is only at the very beginning and end of
+// the text.
+static const char NEEDLE = '~';
+
+static const size_t KB = size_t(1) << 10;
+static const size_t MB = size_t(1) << 20;
+static const size_t GB = size_t(1) << 30;
+
+static unsigned threads = max(1u, thread::hardware_concurrency());
+
+// Runs fn once and returns how long it took in seconds.
+template<typename F>
+static double timeIt(F fn) {
+    using clock = chrono::steady_clock;
+    auto start = clock::now();
+    fn();
+    chrono::duration<double> elapsed = clock::now() - start;
+    return elapsed.count();
+}
+
+// How many times to repeat an operation that costs O(size) so each
+// benchmark moves about the same amount of memory whatever the size.
+static size_t repeat(size_t size) {
+    return max(size_t(16), min(size_t(1) << 16, (256 * MB) / size));
+}
+
+static void report(const char* benchmark, const char* backend, size_t size,
+size_t ops, double seconds) {
+    printf("%s\t%s\t%s\t%zu\t%zu\t%.6f\t%.1f\n", benchmark, backend,
+        scanKernel(), size, ops, seconds, seconds * 1e9 / ops);
+    fflush(stdout);
+}
+
+// Lines of random lengths (up to 120 characters) of lowercase letters.  A
+// 64KB block is made and then repeated to fill size.
+static Text makeText(size_t size) {
+    mt19937 rng(42);
+    string block;
+    while (block.size() < 64 * KB) {
+        size_t length = rng() % 121;
+        for (size_t i = 0; i < length; i++) {
+            block += static_cast<char>('a' + rng() % 26);
+        }
+        block += '\n';
+    }
+
+    auto text = make_shared<string>();
+    text->reserve(size);
+    while (text->size() < size) {
+        text->append(block, 0, min(block.size(), size - text->size()));
+    }
+    text->front() = NEEDLE;
+    text->back() = NEEDLE;
+    return text;
+}
+
+template<typename B>
+static void load(B& buffer, const Text& text) {
+    buffer.assign(text->data(), text->data() + text->size(), text);
+}
+
+// Paged text has nothing to refer to in place so it gets its own copy.
+template<typename Allocator>
+static void load(Buffer<char, 80, PagedText<char, Allocator>>& buffer,
+const Text& text) {
+    buffer.assign(text->data(), text->data() + text->size());
+}
+
+// Each benchmark starts with a freshly loaded buffer and returns the number
+// of operations it timed and how long they took.
+
+template<typename B>
+static double typing(const Text& text, size_t& ops) {
+    B buffer;
+    load(buffer, text);
+    buffer.pointSet(buffer.size() / 2);
+    ops = MB;
+
+    return timeIt([&] {
+        for (size_t i = 0; i < ops; i++) {
+            buffer.insert(static_cast<char>('a' + i % 26));
+        }
+    });
+}
+
+template<typename B>
+static double randomInsert(const Text& text, size_t& ops) {
+    B buffer;
+    load(buffer, text);
+    mt19937_64 rng(42);
+    ops = repeat(text->size());
+
+    return timeIt([&] {
+        for (size_t i = 0; i < ops; i++) {
+            buffer.pointSet(rng() % (buffer.size() + 1));
+            buffer.insert('x');
+        }
+    });
+}
+
+// Edits the beginning and end in turn.  For a gap buffer this is the worst
+// case as the whole text has to move across the gap each time.
+template<typename B>
+static double alternating(const Text& text, size_t& ops) {
+    B buffer;
+    load(buffer, text);
+    ops = repeat(text->size());
+
+    return timeIt([&] {
+        for (size_t i = 0; i < ops; i++) {
+            buffer.pointSet((i % 2) ? buffer.size() : 0);
+            buffer.insert('x');
+        }
+    });
+}
+
+template<typename B>
+static double searchForward(const Text& text, size_t& ops) {
+    B buffer;
+    load(buffer, text);
+    buffer.pointSet(buffer.size() / 2);
+    buffer.insert('x');
+    ops = repeat(text->size());
+    volatile size_t found;
+
+    double seconds = timeIt([&] {
+        for (size_t i = 0; i < ops; i++) {
+            found = buffer.searchForward(NEEDLE, 1);
+        }
+    });
+    (void)found;
+    return seconds;
+}
+
+template<typename B>
+static double searchBackward(const Text& text, size_t& ops) {
+    B buffer;
+    load(buffer, text);
+    buffer.pointSet(buffer.size() / 2);
+    buffer.insert('x');
+    ops = repeat(text->size());
+    volatile size_t found;
+
+    double seconds = timeIt([&] {
+        for (size_t i = 0; i < ops; i++) {
+            found = buffer.searchBackward(NEEDLE, buffer.size() - 2);
+        }
+    });
+    (void)found;
+    return seconds;
+}
+
+// Looks for a string that isn't there (though its first and last characters
+// are) from one end of the text to the other with the gap in the middle, as
+// an incremental search that fails does for each key.
+template<typename B>
+static double searchString(const Text& text, size_t& ops) {
+    B buffer;
+    load(buffer, text);
+    buffer.pointSet(buffer.size() / 2);
+    buffer.insert('x');
+    ops = repeat(text->size());
+    Search<char> search(string(1, NEEDLE) + "isearch" + NEEDLE);
+    volatile size_t found;
+
+    double seconds = timeIt([&] {
+        for (size_t i = 0; i < ops; i++) {
+            found = search.forward(buffer, 0);
+        }
+    });
+    (void)found;
+    return seconds;
+}
+
+// Finds every match of a string that ends about one line in 26, as
+// replace_string does before it changes anything.  Paged text is only ever
+// searched by one thread.  Each operation is one search of the whole text.
+template<typename B>
+static double findAll(const Text& text, size_t& ops) {
+    B buffer;
+    load(buffer, text);
+    buffer.pointSet(buffer.size() / 2);
+    buffer.insert('x');
+    ops = max(size_t(1), repeat(text->size()) / 16);
+    Search<char> search("e\n");
+    unsigned n = is_same<B, PagedBuffer>::value ? 1 : threads;
+    volatile size_t found;
+
+    double seconds = timeIt([&] {
+        for (size_t i = 0; i < ops; i++) {
+            found = search.all(buffer, n).size();
+        }
+    });
+    (void)found;
+    return seconds;
+}
+
+// Takes a snapshot and types a character while it is still alive, as when
+// typing goes on during a save.  Each operation is one snapshot and one
+// character.
+template<typename B>
+static double snapshot(const Text& text, size_t& ops) {
+    B buffer;
+    load(buffer, text);
+    buffer.pointSet(buffer.size() / 2);
+    buffer.insert('x');
+    ops = 64 * KB;
+    volatile size_t size;
+
+    double seconds = timeIt([&] {
+        for (size_t i = 0; i < ops; i++) {
+            auto snapshot = buffer.snapshot();
+            buffer.insert('x');
+            size = snapshot.size();
+        }
+    });
+    (void)size;
+    return seconds;
+}
+
+// Highlights the whole text as C++ a slice at a time, as the editor does
+// while it waits for keys.  Each operation is one line.
+template<typename B>
+static double highlight(const Text& text, size_t& ops) {
+    B buffer;
+    load(buffer, text);
+    Highlighter highlighter;
+    highlighter.reset(Syntax::forFile("bench.cc"), buffer.lines());
+    ops = buffer.lines();
+
+    return timeIt([&] {
+        while (highlighter.lexSome(buffer)) {
+        }
+    });
+}
+
+// Types a character somewhere in one long line (the text with its newlines
+// made tabs) and finds the column at the end of it, as the cursor does.  Each
+// operation is one character and one column.
+template<typename B>
+static double column(const Text& text, size_t& ops) {
+    string line(*text);
+    replace(line.begin(), line.end(), '\n', '\t');
+    B buffer;
+    buffer.assign(line.begin(), line.end());
+    mt19937 rng(42);
+    ops = 64 * KB;
+    volatile size_t column;
+
+    double seconds = timeIt([&] {
+        for (size_t i = 0; i < ops; i++) {
+            buffer.pointSet(rng() % buffer.size());
+            buffer.insert('x');
+            column = buffer.column(buffer.size());
+        }
+    });
+    (void)column;
+    return seconds;
+}
+
+// Reads every element through the iterator.  Each operation is one element.
+template<typename B>
+static double iterate(const Text& text, size_t& ops) {
+    B buffer;
+    load(buffer, text);
+    buffer.pointSet(buffer.size() / 2);
+    buffer.insert('x');
+    const B& constBuffer = buffer;
+    size_t passes = max(size_t(1), (64 * MB) / text->size());
+    ops = passes * buffer.size();
+    volatile size_t sum;
+
+    double seconds = timeIt([&] {
+        for (size_t i = 0; i < passes; i++) {
+            size_t total = 0;
+            for (auto j = constBuffer.begin(); j != constBuffer.end(); ++j) {
+                total += *j;
+            }
+            sum = total;
+        }
+    });
+    (void)sum;
+    return seconds;
+}
+
+// Goes down to the last line (a million lines at most) and back up again
+// with next_line and previous_line.  Each operation is one line.
+static double lineMotion(const Text& text, size_t& ops) {
+    Subeditor subeditor;
+    load(subeditor.buffer(), text);
+    size_t lines = min(subeditor.buffer().lines() - 1, MB);
+    ops = 2 * lines;
+    bool isArg = false;
+    bool isExit = false;
+
+    return timeIt([&] {
+        for (size_t i = 0; i < lines; i++) {
+            int arg = 1;
+            subeditor.next_line(isArg, arg, isExit, 0);
+        }
+        for (size_t i = 0; i < lines; i++) {
+            int arg = 1;
+            subeditor.previous_line(isArg, arg, isExit, 0);
+        }
+    });
+}
+
+// What the screen benchmark draws on.
+static const char* SCREENTERMINAL = "xterm-256color";
+static const size_t SCREENROWS = 30;
+static const size_t SCREENCOLS = 100;
+
+// Puts text on row of screen, as much of it as fits, and blanks the rest.
+static void paintRow(Screen& screen, size_t row, const string& text,
+attr_t attributes) {
+    size_t n = min(text.size(), screen.cols());
+    for (size_t i = 0; i < n; i++) {
+        screen.put(row, i, &text[i], 1, 1, attributes);
+    }
+    screen.blank(row, n, attributes);
+}
+
+// Paints what the editor shows with lines[top] at the top of the viewport:
+// a title line, as many lines as fit between it and a status line, and the
+// cursor at column of the last of them.
+static void paintFrame(Screen& screen, const vector<string>& lines,
+size_t top, size_t column) {
+    size_t last = screen.rows() - 1;
+    paintRow(screen, 0, "bench", A_REVERSE);
+    for (size_t row = 1; row < last; row++) {
+        paintRow(screen, row, lines[top + row - 1], A_NORMAL);
+    }
+    paintRow(screen, last, "-- bench", A_REVERSE);
+    screen.cursor(last - 1, column);
+}
+
+// Shows a first frame and then one unchanged, one scrolled by a line and one
+// with a character typed in the middle of the last line, and prints how many
+// bytes each of them sent to the terminal.
+static void screenBytes() {
+    // Curses is set up for the terminal as though it were on /dev/null, so
+    // nothing is really sent anywhere.
+    FILE* terminal = fopen("/dev/null", "w");
+    if (terminal == nullptr) {
+        perror("bench: /dev/null");
+        return;
+    }
+    SCREEN* curses = newterm(SCREENTERMINAL, terminal, stdin);
+    if (curses == nullptr) {
+        fprintf(stderr, "bench: can't use terminal %s\n", SCREENTERMINAL);
+        fclose(terminal);
+        return;
+    }
+
+    Text text = makeText(64 * KB);
+    vector<string> lines;
+    for (size_t start = 0; lines.size() < SCREENROWS; ) {
+        size_t end = text->find('\n', start);
+        lines.push_back(text->substr(start, end - start));
+        start = end + 1;
+    }
+
+    Screen screen(terminal);
+    screen.resize(SCREENROWS, SCREENCOLS, A_NORMAL);
+    auto show = [&screen](const char* frame) {
+        printf("%s\t%s\t%zu\t%zu\t%zu\n", frame, SCREENTERMINAL,
+            SCREENROWS, SCREENCOLS, screen.update());
+    };
+
+    printf("frame\tterminal\trows\tcols\tbytes\n");
+    paintFrame(screen, lines, 0, 0);
+    show("first");
+    paintFrame(screen, lines, 0, 0);
+    show("unchanged");
+    paintFrame(screen, lines, 1, 0);
+    show("scroll");
+    string& line = lines[SCREENROWS - 2];
+    size_t column = min(line.size(), SCREENCOLS - 1) / 2;
+    line.insert(column, 1, 'x');
+    paintFrame(screen, lines, 1, column + 1);
+    show("insert");
+    fflush(stdout);
+
+    endwin();
+    delscreen(curses);
+    fclose(terminal);
+}
+
+// How many texts highlight-check edits for each backend and how many times
+// it paints each one.
+static const size_t CHECKTEXTS = 250;
+static const size_t CHECKFRAMES = 200;
+
+// Lexes all of text from the start and returns the spans of each line.
+static vector<Highlighter::span_list> lexAll(const Syntax* syntax,
+const string& text) {
+    vector<Highlighter::span_list> lines;
+    Syntax::state_type state = 0;
+    for (size_t start = 0; start <= text.size(); ) {
+        size_t end = min(text.find('\n', start), text.size());
+        lines.emplace_back();
+        state = syntax->lex(text.data() + start, end - start, state,
+            &lines.back());
+        start = end + 1;
+    }
+    return lines;
+}
+
+static bool sameSpans(const Highlighter::span_list& a,
+const Highlighter::span_list& b) {
+    return a.size() == b.size() && equal(a.begin(), a.end(), b.begin(),
+        [](const FaceSpan& x, const FaceSpan& y) {
+            return x._start == y._start && x._end == y._end &&
+                x._face == y._face;
+        });
+}
+
+// Makes a small C++ text full of comments and strings and edits it at random,
+// one or two edits at a time, opening and closing comments and strings.
+// After each time the highlighter is made ready to paint a few lines from
+// somewhere in the text and lexes up to two slices more, as the editor does
+// for keys and the time between them.  The lines it would paint, and at the
+// end every line, are checked against lexing the whole text from the start.
+// Returns how many frames had any line wrong.
+template<typename B>
+static size_t highlightCheck() {
+    static const string pieces[] = { "/*", "*/", "\"", "//", "\n", "\n\n",
+        "#", "x", " " };
+    static const size_t ROWS = 8;
+    const Syntax* syntax = Syntax::forFile("bench.cc");
+    string start;
+    for (size_t i = 0; i < 40; i++) {
+        start += "int x = 1; /* c */ \"s\"\n";
+    }
+
+    size_t wrong = 0;
+    Highlighter::span_list spans;
+    for (size_t seed = 0; seed < CHECKTEXTS; seed++) {
+        mt19937 rng(seed);
+        B buffer;
+        buffer.assign(start.begin(), start.end());
+        buffer.clearDamage();
+        Highlighter highlighter;
+        highlighter.reset(syntax, buffer.lines());
+        auto check = [&](size_t first, size_t last) {
+            string text;
+            buffer.for_each_segment(0, buffer.size(),
+                [&text](const char* p, size_t n) {
+                    text.append(p, n);
+                    return true;
+                });
+            auto expected = lexAll(syntax, text);
+            for (size_t line = first; line < last; line++) {
+                highlighter.spans(buffer, line, spans);
+                if (!sameSpans(spans, expected[line])) {
+                    wrong++;
+                    return;
+                }
+            }
+        };
+
+        for (size_t frame = 0; frame < CHECKFRAMES; frame++) {
+            for (size_t edits = 1 + rng() % 2; edits > 0; edits--) {
+                size_t pos = rng() % (buffer.size() + 1);
+                if (rng() % 3 == 0 && pos < buffer.size()) {
+                    buffer.erase(pos, min(pos + 1 + rng() % 4,
+                        buffer.size()));
+                } else {
+                    const string& piece = pieces[rng() % 9];
+                    buffer.pointSet(pos);
+                    buffer.insert(piece.begin(), piece.end());
+                }
+            }
+            size_t top = rng() % buffer.lines();
+            size_t last = min(top + ROWS, buffer.lines());
+            highlighter.edited(buffer);
+            highlighter.prepare(buffer, top, last);
+            highlighter.changed();
+            buffer.clearDamage();
+            for (size_t slices = rng() % 3; slices > 0; slices--) {
+                highlighter.lexSome(buffer);
+            }
+            check(top, last);
+        }
+
+        while (highlighter.lexSome(buffer)) {
+        }
+        highlighter.prepare(buffer, 0, buffer.lines());
+        check(0, buffer.lines());
+    }
+    return wrong;
+}
+
+// Runs highlight-check on each backend and prints how many frames were
+// wrong.  Returns false if any were.
+static bool highlightChecks() {
+    struct Check {
+        const char* backend;
+        size_t      (*run)();
+    };
+    static const Check checks[] = {
+        { "gap", highlightCheck<GapBuffer> },
+        { "piece", highlightCheck<PieceBuffer> },
+        { "paged", highlightCheck<PagedBuffer> },
+    };
+
+    bool right = true;
+    printf("check\tbackend\tframes\twrong\n");
+    for (auto& check: checks) {
+        size_t wrong = check.run();
+        printf("highlight\t%s\t%zu\t%zu\n", check.backend,
+            CHECKTEXTS * (CHECKFRAMES + 1), wrong);
+        fflush(stdout);
+        right = right && wrong == 0;
+    }
+    return right;
+}
+
+struct Benchmark {
+    const char* name;
+    const char* backend;
+    double      (*run)(const Text&, size_t&);
+};
+
+static const Benchmark benchmarks[] = {
+    { "typing", "gap", typing<GapBuffer> },
+    { "typing", "piece", typing<PieceBuffer> },
+    { "typing", "paged", typing<PagedBuffer> },
+    { "random-insert", "gap", randomInsert<GapBuffer> },
+    { "random-insert", "piece", randomInsert<PieceBuffer> },
+    { "random-insert", "paged", randomInsert<PagedBuffer> },
+    { "alternating", "gap", alternating<GapBuffer> },
+    { "alternating", "piece", alternating<PieceBuffer> },
+    { "alternating", "paged", alternating<PagedBuffer> },
+    { "search-forward", "gap", searchForward<GapBuffer> },
+    { "search-forward", "piece", searchForward<PieceBuffer> },
+    { "search-forward", "paged", searchForward<PagedBuffer> },
+    { "search-backward", "gap", searchBackward<GapBuffer> },
+    { "search-backward", "piece", searchBackward<PieceBuffer> },
+    { "search-backward", "paged", searchBackward<PagedBuffer> },
+    { "search-string", "gap", searchString<GapBuffer> },
+    { "search-string", "piece", searchString<PieceBuffer> },
+    { "search-string", "paged", searchString<PagedBuffer> },
+    { "find-all", "gap", findAll<GapBuffer> },
+    { "find-all", "piece", findAll<PieceBuffer> },
+    { "find-all", "paged", findAll<PagedBuffer> },
+    { "snapshot", "gap", snapshot<GapBuffer> },
+    { "snapshot", "piece", snapshot<PieceBuffer> },
+    { "snapshot", "paged", snapshot<PagedBuffer> },
+    { "highlight", "gap", highlight<GapBuffer> },
+    { "highlight", "piece", highlight<PieceBuffer> },
+    { "highlight", "paged", highlight<PagedBuffer> },
+    { "column", "gap", column<GapBuffer> },
+    { "column", "piece", column<PieceBuffer> },
+    { "column", "paged", column<PagedBuffer> },
+    { "iterate", "gap", iterate<GapBuffer> },
+    { "iterate", "piece", iterate<PieceBuffer> },
+    { "iterate", "paged", iterate<PagedBuffer> },
+    { "line-motion", SUBEDITORBACKEND, lineMotion },
+};
+
+static bool isBenchmark(const char* name) {
+    for (auto& benchmark: benchmarks) {
+        if (strcmp(name, benchmark.name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// A number optionally followed by K, M or G.  Returns 0 if it isn't one.
+static size_t parseSize(const char* arg) {
+    char* end;
+    size_t size = strtoull(arg, &end, 10);
+    switch (*end) {
+        case 'K': case 'k':
+            size *= KB;
+            end++;
+            break;
+        case 'M': case 'm':
+            size *= MB;
+            end++;
+            break;
+        case 'G': case 'g':
+            size *= GB;
+            end++;
+            break;
+    }
+    return (*end == '\0') ? size : 0;
+}
+
+static void usage() {
+    fprintf(stderr,
+        "usage: bench [-k kernel] [-s size]... [-t threads] [benchmark]...\n"
+        "benchmarks:");
+    const char* last = "";
+    for (auto& benchmark: benchmarks) {
+        if (strcmp(benchmark.name, last) != 0) {
+            fprintf(stderr, " %s", benchmark.name);
+        }
+        last = benchmark.name;
+    }
+    fprintf(stderr, " highlight-check screen\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char* argv[]) {
+    vector<size_t> sizes;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "k:s:t:")) != -1) {
+        switch (opt) {
+            case 'k':
+                if (!scanUseKernel(optarg)) {
+                    fprintf(stderr, "bench: can't use kernel %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 's': {
+                size_t size = parseSize(optarg);
+                if (size < 2) {
+                    usage();
+                }
+                sizes.push_back(size);
+                break;
+            }
+            case 't': {
+                int n = atoi(optarg);
+                if (n < 1) {
+                    usage();
+                }
+                threads = n;
+                break;
+            }
+            default:
+                usage();
+        }
+    }
+
+    if (sizes.empty()) {
+        sizes = { KB, 32 * KB, MB, 32 * MB, GB };
+    }
+
+    bool timed = (optind == argc);
+    bool highlight = (optind == argc);
+    bool screen = (optind == argc);
+    for (int i = optind; i < argc; i++) {
+        if (strcmp(argv[i], "highlight-check") == 0) {
+            highlight = true;
+        } else if (strcmp(argv[i], "screen") == 0) {
+            screen = true;
+        } else if (isBenchmark(argv[i])) {
+            timed = true;
+        } else {
+            usage();
+        }
+    }
+
+    if (timed) {
+        printf("benchmark\tbackend\tkernel\tsize\tops\tseconds\tns/op\n");
+    }
+    for (auto size: timed ? sizes : vector<size_t>()) {
+        Text text = makeText(size);
+        for (auto& benchmark: benchmarks) {
+            bool wanted = (optind == argc);
+            for (int i = optind; i < argc; i++) {
+                wanted = wanted || strcmp(argv[i], benchmark.name) == 0;
+            }
+            if (wanted) {
+                size_t ops;
+                double seconds = benchmark.run(text, ops);
+                report(benchmark.name, benchmark.backend, size, ops, seconds);
+            }
+        }
+    }
+
+    bool right = true;
+    if (highlight) {
+        if (timed) {
+            printf("\n");
+        }
+        right = highlightChecks();
+    }
+    if (screen) {
+        if (timed || highlight) {
+            printf("\n");
+        }
+        screenBytes();
+    }
+
+    return right ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -8,10 +8,18 @@
 #define _BUFFER_H_
 
 #include <algorithm>
+#include <atomic>
 #include <cstdlib>
 #include <iterator>
+#include <memory>
 #include <type_traits>
+#include <utility>
 #include <vector>
+#include "columnindex.h"
+#include "lineindex.h"
+#include "scan.h"
+#include "journal.h"
+#include "undo.h"
 
 struct BufferInternals {
     std::size_t    _capacity;
@@ -21,6 +29,176 @@ struct BufferInternals {
     std::ptrdiff_t _gapEnd;
 };
 
+// Running totals of the work a buffer has done, kept all the time so slow
+// sessions can be explained afterwards.  Each is a single addition on a path
+// that is already doing much more.
+struct BufferCounters {
+    std::size_t _gapMoves;      // Times the gap was moved.
+    std::size_t _gapBytes;      // Bytes copied to move it.
+    std::size_t _reallocations; // Times the storage was replaced.
+    std::size_t _scanned;       // Bytes looked at by searches.
+
+    BufferCounters& operator+=(const BufferCounters& that) {
+        _gapMoves += that._gapMoves;
+        _gapBytes += that._gapBytes;
+        _reallocations += that._reallocations;
+        _scanned += that._scanned;
+        return *this;
+    }
+};
+
+// The part of a buffer changed since clearDamage() was last called, so a
+// display only has to repaint that.  _first and _last are positions in the
+// text as it is now: everything before _first is unchanged and so is
+// everything from _last on, though if _lines is set (newlines were added or
+// removed) it has moved to different lines.
+struct BufferDamage {
+    bool           _damaged;
+    std::size_t    _first;
+    std::size_t    _last;
+    bool           _lines;
+
+    void inserted(std::size_t pos, std::size_t n, bool lines) {
+        if (!_damaged) {
+            _damaged = true;
+            _first = pos;
+            _last = pos;
+        }
+        _first = std::min(_first, pos);
+        _last = (_last >= pos) ? _last + n : pos + n;
+        _lines = _lines || lines;
+    }
+
+    void erased(std::size_t pos, std::size_t n, bool lines) {
+        if (!_damaged) {
+            _damaged = true;
+            _first = pos;
+            _last = pos;
+        }
+        _first = std::min(_first, pos);
+        _last = (_last >= pos + n) ? _last - n : pos;
+        _lines = _lines || lines;
+    }
+
+    void clear() {
+        _damaged = false;
+        _first = _last = 0;
+        _lines = false;
+    }
+};
+
+// A run of elements that are contiguous in memory.
+template<typename T>
+struct BufferSpan {
+    const T*       _data;
+    std::size_t    _size;
+
+    const T* begin() const {
+        return _data;
+    }
+
+    const T* end() const {
+        return _data + _size;
+    }
+
+    std::size_t size() const {
+        return _size;
+    }
+
+    bool empty() const {
+        return _size == 0;
+    }
+};
+
+// Calls fn(data, length) for [data, data + size) in pieces of at most chunk
+// elements.  Stops and returns false as soon as fn does.
+template<typename T, typename F>
+bool forEachChunk(const T* data, std::size_t size, std::size_t chunk, F& fn) {
+    while (size > 0) {
+        std::size_t n = std::min(size, chunk);
+        if (!fn(data, n)) {
+            return false;
+        }
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+// The text of a buffer as it was at some moment, which never changes.  It is
+// a list of runs of elements in the buffer's own storage (which a buffer
+// doesn't change while a snapshot refers to it) and the owners of that
+// storage, which it keeps alive.  It can be read from any number of threads
+// at once, in the same way as a buffer, so Search, for instance, works with
+// either.
+//
+// A snapshot lets go of the storage it owns by destroying its shared_ptrs,
+// which may happen on another thread, e.g. when a save in the background
+// finishes.  Letting go is a release, but use_count() is only a relaxed load,
+// so a buffer which finds it is the only owner left puts an acquire fence
+// before it writes to the storage again.  The fence pairs with the release
+// and so everything the snapshot read happens before those writes.  The
+// piece table and paged text backends do the same with their own storage.
+template<typename T>
+class BufferSnapshot {
+public:
+    using value_type = T;
+    using size_type = std::size_t;
+
+    static const size_type npos = -1;
+
+    BufferSnapshot() : _segments{}, _ends{}, _owners{}, _size{0} {
+    }
+
+    // Adds [data, data + length) to the end of the text.
+    void append(const T* data, size_type length) {
+        if (length > 0) {
+            _segments.push_back({ data, length });
+            _size += length;
+            _ends.push_back(_size);
+        }
+    }
+
+    // Keeps owner alive for as long as the snapshot is.
+    void own(std::shared_ptr<const void> owner) {
+        if (owner) {
+            _owners.push_back(std::move(owner));
+        }
+    }
+
+    size_type size() const {
+        return _size;
+    }
+
+    bool empty() const {
+        return _size == 0;
+    }
+
+    // As Buffer::for_each_segment().
+    template<typename F>
+    bool for_each_segment(size_type from, size_type to, F fn,
+    size_type chunk = npos) const {
+        to = std::min(to, _size);
+        for (size_type i = std::upper_bound(_ends.begin(), _ends.end(), from) -
+        _ends.begin(); i < _segments.size() && from < to; i++) {
+            size_type start = _ends[i] - _segments[i].size();
+            size_type last = std::min(_ends[i], to);
+            if (!forEachChunk(_segments[i].begin() + (from - start),
+            last - from, chunk, fn)) {
+                return false;
+            }
+            from = last;
+        }
+        return true;
+    }
+
+private:
+    std::vector<BufferSpan<T>>              _segments;
+    std::vector<size_type>                  _ends;   // Where each one ends.
+    std::vector<std::shared_ptr<const void>> _owners;
+    size_type                               _size;
+};
+
 template<typename T, bool isConst> class BufferIterator;
 
 template<typename T,  std::size_t N, typename Container = std::vector<T>>
@@ -40,28 +218,58 @@ public:
     using const_iterator = BufferIterator<const self_type, true>;
     using reverse_iterator = std::reverse_iterator<iterator>;
     using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+    using span_type = BufferSpan<T>;
+    using chunk_type = TextChunk<T>;
+    using snapshot_type = BufferSnapshot<T>;
 
     static const size_type npos = -1;
 
-    Buffer() : _text(N, 0), _point{0}, _gapStart{_text.begin()},
-    _gapEnd{_text.end()} {
+    Buffer() : _text{std::make_shared<Container>(N, 0)}, _point{0},
+    _mark{npos}, _gapStart{_text->begin()}, _gapEnd{_text->end()},
+    _privateStart{0}, _privateEnd{N}, _lines(), _columns(), _damage(),
+    _undo(), _journal{nullptr}, _counters() {
+        _lines.reset(N);
+        _damage.clear();
     }
 
-    Buffer(const self_type& that) : _text(that._text),
-    _point{that._point}, _gapStart{that._gapStart}, _gapEnd{that._gapEnd} {
+    // The gap iterators have to point into our own copy of the text, not
+    // that's.
+    Buffer(const self_type& that) :
+    _text{std::make_shared<Container>(*that._text)},
+    _point{that._point}, _mark{that._mark},
+    _gapStart{_text->begin() + (that._gapStart - that._text->begin())},
+    _gapEnd{_text->begin() + (that._gapEnd - that._text->begin())},
+    _privateStart{0}, _privateEnd{_text->size()}, _lines(that._lines),
+    _columns(that._columns), _damage(that._damage), _undo(that._undo),
+    _journal{nullptr}, _counters(that._counters) {
     }
 
     Buffer(self_type&& that) : _text(std::move(that._text)),
-    _point{that._point},_gapStart{std::move(that._gapStart)},
-    _gapEnd{std::move(that._gapEnd)} {
+    _point{that._point}, _mark{that._mark},
+    _gapStart{std::move(that._gapStart)}, _gapEnd{std::move(that._gapEnd)},
+    _privateStart{that._privateStart}, _privateEnd{that._privateEnd},
+    _lines(std::move(that._lines)), _columns(std::move(that._columns)),
+    _damage(that._damage),
+    _undo(std::move(that._undo)), _journal{nullptr},
+    _counters(that._counters) {
     }
 
     self_type& operator=(const self_type& that) {
         if (this != &that) {
-            this->_text = that._text;
+            this->_text = std::make_shared<Container>(*that._text);
             this->_point = that._point;
-            this->_gapStart = that._gapStart;
-            this->_gapEnd = that._gapEnd;
+            this->_mark = that._mark;
+            this->_gapStart = this->_text->begin() +
+                (that._gapStart - that._text->begin());
+            this->_gapEnd = this->_text->begin() +
+                (that._gapEnd - that._text->begin());
+            this->_privateStart = 0;
+            this->_privateEnd = this->_text->size();
+            this->_lines = that._lines;
+            this->_columns = that._columns;
+            this->_damage = that._damage;
+            this->_undo = that._undo;
+            this->_counters = that._counters;
         }
         return *this;
     }
@@ -70,14 +278,22 @@ public:
         if (this != &that) {
             this->_text = std::move(that._text);
             this->_point = that._point;
+            this->_mark = that._mark;
             this->_gapStart = std::move(that._gapStart);
             this->_gapEnd = std::move(that._gapEnd);
+            this->_privateStart = that._privateStart;
+            this->_privateEnd = that._privateEnd;
+            this->_lines = std::move(that._lines);
+            this->_columns = std::move(that._columns);
+            this->_damage = that._damage;
+            this->_undo = std::move(that._undo);
+            this->_counters = that._counters;
         }
         return *this;
     }
 
     bool operator==(const self_type& that) const {
-        return this->_text == that._text &&
+        return *this->_text == *that._text &&
             this->_point == that._point &&
             this->_gapStart == that._gapStart &&
             this->_gapEnd == that._gapEnd;
@@ -87,15 +303,20 @@ public:
         return !operator==(that);
     }
 
+    // Anything can be written through a non-const iterator so the storage
+    // is made the buffer's own first.
     reference operator[](size_type n) {
+        writing(0, _text->size());
         return iterator(this)[n];
     }
 
     iterator begin() {
+        writing(0, _text->size());
         return iterator(this);
     }
 
     iterator end() {
+        writing(0, _text->size());
         return iterator(this) +  size();
     }
 
@@ -140,7 +361,7 @@ public:
     }
 
     size_type capacity() const {
-        return _text.capacity();
+        return _text->size();
     }
 
     bool empty() const {
@@ -148,11 +369,11 @@ public:
     }
 
     size_type max_size() const {
-        return _text.max_size();
+        return _text->max_size();
     }
 
     size_type size() const {
-        return _text.capacity() - (_gapEnd - _gapStart);
+        return _text->size() - (_gapEnd - _gapStart);
     }
 
     size_type front() const {
@@ -163,46 +384,232 @@ public:
         return (size() == 0) ? 0 : size() - 1;
     }
 
-    friend void std::swap(self_type& lhs, self_type& rhs) {
+    friend void swap(self_type& lhs, self_type& rhs) {
         if (lhs != rhs) {
             lhs._text.swap(rhs._text);
             std::swap(lhs._point, rhs._point);
+            std::swap(lhs._mark, rhs._mark);
             std::swap(lhs._gapStart, rhs._gapStart);
             std::swap(lhs._gapEnd, rhs._gapEnd);
+            std::swap(lhs._privateStart, rhs._privateStart);
+            std::swap(lhs._privateEnd, rhs._privateEnd);
+            std::swap(lhs._lines, rhs._lines);
+            std::swap(lhs._columns, rhs._columns);
+            std::swap(lhs._damage, rhs._damage);
+            std::swap(lhs._undo, rhs._undo);
+            std::swap(lhs._counters, rhs._counters);
         }
     }
 
-    bool deletePrevious() {
-        if (_point <= 0 || _point > size()) {
+    // Deletes the n elements before point.  However many there are, the
+    // gap is moved once and widened over them.  Returns false (and deletes
+    // nothing) if there are fewer than n.
+    bool deletePrevious(size_type n = 1) {
+        if (n == 0 || _point < n || _point > size()) {
             return false;
         }
 
-        moveGap();
-        _gapStart--;
-        return pointMove(-1);
+        return remove(_point - n, n, true);
     }
 
-    bool deleteNext() {
-        if (_point < 0 || _point >= size()) {
+    // Deletes the n elements from point on.
+    bool deleteNext(size_type n = 1) {
+        if (n == 0 || _point > size() || n > size() - _point) {
             return false;
         }
 
-        moveGap();
-        _gapEnd++;
-        return true;
+        return remove(_point, n, false);
+    }
+
+    // Deletes [from, to) by moving the gap to from and widening it to to.
+    // Point is left at from.
+    bool erase(size_type from, size_type to) {
+        if (from > to) {
+            return false;
+        }
+
+        return remove(from, to - from);
+    }
+
+    // The same but text is the copy of [from, to) that copy() made, which
+    // undo can then share instead of copying the text again.
+    bool erase(size_type from, size_type to, const chunk_type& text) {
+        if (from > to || text->size() != to - from) {
+            return false;
+        }
+
+        return remove(from, to - from, false, text);
+    }
+
+    // A copy of [from, to) that no longer depends on the buffer.
+    chunk_type copy(size_type from, size_type to) const {
+        auto text = std::make_shared<std::vector<T>>();
+        if (from < to) {
+            text->reserve(std::min(to, size()) - from);
+            for_each_segment(from, to, [&text](const_pointer p, size_type n) {
+                text->insert(text->end(), p, p + n);
+                return true;
+            });
+        }
+        return text;
     }
 
     bool insert(value_type c) {
-        if (_point < 0 || _point > size()) {
+        if (_point > size()) {
             return false;
         }
 
-        moveGap();
+        _undo.inserted(_point, 1);
+        markInserted(_point, 1);
+        openGap(1);
         *_gapStart = c;
+        if (isNewline(c)) {
+            _lines.add(_gapStart - _text->begin(), 1);
+        }
+        _damage.inserted(_point, 1, isNewline(c));
+        _columns.inserted(_point, 1);
         _gapStart++;
+        journalInserted(_point, 1);
         return pointMove(1);
     }
 
+    // Inserts n copies of c at point.  The gap is opened once for the whole
+    // run.
+    bool insert(size_type n, value_type c) {
+        if (_point > size()) {
+            return false;
+        }
+
+        _undo.inserted(_point, n);
+        markInserted(_point, n);
+        openGap(n);
+        std::fill_n(_gapStart, n, c);
+        if (isNewline(c)) {
+            countLines(_gapStart, _gapStart + n, 1);
+        }
+        _damage.inserted(_point, n, isNewline(c));
+        _columns.inserted(_point, n);
+        _gapStart += n;
+        journalInserted(_point, n);
+        return pointMove(n);
+    }
+
+    // Inserts the range [first, last) at point.  The gap is opened once and
+    // the range is copied into it in one pass.
+    template<typename ForwardIt, typename = typename std::enable_if<
+        !std::is_integral<ForwardIt>::value>::type>
+    bool insert(ForwardIt first, ForwardIt last) {
+        if (_point > size()) {
+            return false;
+        }
+
+        size_type n = std::distance(first, last);
+        _undo.inserted(_point, n);
+        markInserted(_point, n);
+        openGap(n);
+        container_iterator start = _gapStart;
+        size_type newlines = _lines.total();
+        _gapStart = std::copy(first, last, _gapStart);
+        countLines(start, _gapStart, 1);
+        _damage.inserted(_point, n, _lines.total() != newlines);
+        _columns.inserted(_point, n);
+        journalInserted(_point, n);
+        return pointMove(n);
+    }
+
+    // Replaces the contents of the buffer with the range [first, last) and
+    // puts point at the beginning.  The new storage is sized once, the gap
+    // is placed in front of the text (where point is) and the range is copied
+    // in a single pass.
+    template<typename ForwardIt, typename = typename std::enable_if<
+        !std::is_integral<ForwardIt>::value>::type>
+    void assign(ForwardIt first, ForwardIt last) {
+        Container text;
+        text.reserve(std::distance(first, last) + N);
+        text.resize(N, 0);
+        text.insert(text.end(), first, last);
+        _text = std::make_shared<Container>(std::move(text));
+        _privateStart = 0;
+        _privateEnd = _text->size();
+        _counters._reallocations++;
+
+        _point = 0;
+        _mark = npos;
+        _gapStart = _text->begin();
+        _gapEnd = _text->begin() + N;
+        rebuildLines();
+        _columns.reset(size());
+        _damage.clear();
+        _damage.inserted(0, size(), true);
+        _undo.clear();
+    }
+
+    // A gap buffer has to have the text in its own storage so this is the
+    // same as assign(first, last); owner is not needed afterwards.
+    void assign(const_pointer first, const_pointer last,
+    std::shared_ptr<const void> /*owner*/) {
+        assign(first, last);
+    }
+
+    // The text before the gap.  Like the post-gap span, it is only valid
+    // until the buffer is next changed.
+    span_type preGap() const {
+        return { _text->data(), static_cast<size_type>(_gapStart -
+            _text->begin()) };
+    }
+
+    // The text after the gap.
+    span_type postGap() const {
+        return { _text->data() + (_gapEnd - _text->begin()),
+            static_cast<size_type>(_text->end() - _gapEnd) };
+    }
+
+    // Calls fn(data, length) for each contiguous run of the text in
+    // [from, to), in order, giving it no more than chunk elements at a time.
+    // fn returns false to stop early, in which case so does this.  This is
+    // how to read the text without going through an iterator.
+    template<typename F>
+    bool for_each_segment(size_type from, size_type to, F fn,
+    size_type chunk = npos) const {
+        span_type pre = preGap();
+        span_type post = postGap();
+        to = std::min(to, size());
+        if (from >= to) {
+            return true;
+        }
+
+        if (from < pre.size() && !forEachChunk(pre.begin() + from,
+        std::min(to, pre.size()) - from, chunk, fn)) {
+            return false;
+        }
+        if (to > pre.size()) {
+            size_type first = std::max(from, pre.size()) - pre.size();
+            return forEachChunk(post.begin() + first,
+                (to - pre.size()) - first, chunk, fn);
+        }
+        return true;
+    }
+
+    // The text as it is now, for reading from another thread while the
+    // buffer goes on being changed.  It refers to the storage rather than
+    // copying it, so it is taken in constant time.  From then on the buffer
+    // only writes to the gap as it was; the first change that needs to write
+    // elsewhere while a snapshot is still alive copies the storage (once)
+    // and leaves the old one to the snapshots.
+    snapshot_type snapshot() const {
+        snapshot_type snapshot;
+        span_type pre = preGap();
+        span_type post = postGap();
+        snapshot.append(pre.begin(), pre.size());
+        snapshot.append(post.begin(), post.size());
+        snapshot.own(_text);
+
+        _privateStart = std::max(_privateStart, pre.size());
+        _privateEnd = std::max(_privateStart,
+            std::min(_privateEnd, _text->size() - post.size()));
+        return snapshot;
+    }
+
     difference_type point() const {
         return _point;
     }
@@ -212,9 +619,9 @@ public:
         return true;
     }
 
-    bool pointMove(int count) {
+    bool pointMove(difference_type count) {
         size_type loc = _point + count;
-        if (loc < 0 || loc > size()) {
+        if (loc > size()) {
             return false;
         }
 
@@ -222,49 +629,408 @@ public:
         return true;
     }
 
-    size_type searchBackward(value_type c, size_type pos) {
-        for(auto i = rend() - (pos + 1); i < rend(); i++) {
-            if (*i == c) {
-                return i.base().pos();
-            }
+    // The mark is a second position, npos until it is set, which stays with
+    // the text around it as the buffer is changed.  Together with point it
+    // delimits the region.
+    size_type mark() const {
+        return _mark;
+    }
+
+    bool markSet(size_type n) {
+        if (n != npos && n > size()) {
+            return false;
         }
-        return npos;
+
+        _mark = n;
+        return true;
+    }
+
+    // The number of lines.  This is one more than the number of newlines as
+    // the text after the last newline (even if empty) is also a line.
+    size_type lines() const {
+        return _lines.total() + 1;
     }
 
-    size_type searchForward(value_type c, size_type pos) {
-        for(auto i = begin() + pos; i < end(); i++) {
-            if (*i == c) {
-                return i.pos();
+    // The line (counting from 0) which pos is on.
+    size_type lineOf(size_type pos) const {
+        size_type offset = physical(pos);
+        size_type chunk = offset >> LineIndex::CHUNKBITS;
+        return _lines.before(chunk) +
+            countNewlines(chunk << LineIndex::CHUNKBITS, offset);
+    }
+
+    // The position of the first character of line (counting from 0) or npos
+    // if there is no such line.
+    size_type lineStart(size_type line) const {
+        if (line == 0) {
+            return 0;
+        }
+        if (line > _lines.total()) {
+            return npos;
+        }
+
+        size_type before;
+        size_type first = _lines.find(line, before) << LineIndex::CHUNKBITS;
+        size_type last = std::min(first + LineIndex::CHUNKSIZE, _text->size());
+        size_type gapStart = _gapStart - _text->begin();
+        size_type gapEnd = _gapEnd - _text->begin();
+        size_type k = line - before;
+        const_pointer text = _text->data();
+
+        for (size_type i = first; i < last;) {
+            if (i >= gapStart && i < gapEnd) {
+                i = gapEnd;
+                continue;
+            }
+            size_type end = (i < gapStart) ? std::min(last, gapStart) : last;
+            size_type found = scanFind(text + i, text + end, NEWLINE) - text;
+            if (found == end) {
+                i = end;
+            } else if (--k == 0) {
+                return ((found < gapStart) ? found :
+                    found - (gapEnd - gapStart)) + 1;
+            } else {
+                i = found + 1;
             }
         }
         return npos;
     }
 
+    // The position of the newline that ends line or size() if it is the last
+    // line.
+    size_type lineEnd(size_type line) const {
+        size_type next = lineStart(line + 1);
+        return (next == npos) ? size() : next - 1;
+    }
+
+    // The column (counting from 0) at which pos is shown on its line, with
+    // tabs, wide characters and combining marks taken into account.
+    size_type column(size_type pos) const {
+        return _columns.measure(*this, lineStart(lineOf(pos)), pos).apply(0);
+    }
+
+    // The position of the character shown at column on line or, if the line
+    // is not that long, of its end.
+    size_type columnStart(size_type line, size_type column) const {
+        return _columns.find(*this, lineStart(line), lineEnd(line),
+            [column](const TextAdvance& advance) {
+                return advance.apply(0) > column;
+            });
+    }
+
+    // The position count characters after pos, or size() if there aren't
+    // that many.  A character is a codepoint together with any combining
+    // marks after it.
+    size_type nextChar(size_type pos, size_type count = 1) const {
+        return _columns.find(*this, pos, size(),
+            [count](const TextAdvance& advance) {
+                return advance._chars > count;
+            });
+    }
+
+    // The position count characters before pos, or 0 if there aren't that
+    // many.
+    size_type previousChar(size_type pos, size_type count = 1) const {
+        return _columns.findBackward(*this, 0, pos,
+            [count](const TextAdvance& advance) {
+                return advance._chars >= count;
+            });
+    }
+
+    // Looks for c at pos and then backwards.  Returns the position just after
+    // the match or npos if there isn't one.
+    size_type searchBackward(value_type c, size_type pos) const {
+        size_type found = findBackward(c, pos);
+        _counters._scanned += (std::min(pos + 1, size()) -
+            ((found == npos) ? 0 : found - 1)) * sizeof(T);
+        return found;
+    }
+
+    // Looks for c at pos and then forwards.  Returns the position of the
+    // match or npos if there isn't one.
+    size_type searchForward(value_type c, size_type pos) const {
+        size_type found = findForward(c, pos);
+        if (pos < size()) {
+            _counters._scanned += (((found == npos) ? size() : found + 1) -
+                pos) * sizeof(T);
+        }
+        return found;
+    }
+
+    const BufferDamage& damage() const {
+        return _damage;
+    }
+
+    void clearDamage() {
+        _damage.clear();
+    }
+
+    // Reverses the last change (or run of typing or deleting) and puts point
+    // where it was.  Returns false if there is nothing left to undo.
+    bool undo() {
+        return _undo.undo(*this);
+    }
+
+    // Makes the last undone change again.  Any other change since then means
+    // there is nothing to redo.
+    bool redo() {
+        return _undo.redo(*this);
+    }
+
+    // Stops the next change from being merged into the last one so they are
+    // undone separately.
+    void undoBoundary() {
+        _undo.boundary();
+    }
+
+    // Limits the undo history to about bytes of memory.  The oldest changes
+    // are forgotten first.
+    void undoLimit(size_type bytes) {
+        _undo.limit(bytes);
+    }
+
+    // Every change from now on is also recorded in journal (or nothing is if
+    // it is nullptr.)
+    void journal(Journal* journal) {
+        _journal = journal;
+    }
+
+    const BufferCounters& counters() const {
+        return _counters;
+    }
+
     BufferInternals internals() {
         return {
             capacity(),
-            distance(_text.begin(), userToGap(_point)),
+            distance(_text->begin(), userToGap(_point)),
             size(),
-            distance(_text.begin(), _gapStart),
-            distance(_text.begin(), _gapEnd)
+            distance(_text->begin(), _gapStart),
+            distance(_text->begin(), _gapEnd)
         };
     }
 
 private:
     friend iterator;
     friend const_iterator;
+    friend class UndoLog<T>;
 
-    Container                    _text;
+    std::shared_ptr<Container>   _text;
     size_type                    _point;
+    size_type                    _mark;
     container_iterator           _gapStart;
     container_iterator           _gapEnd;
+    mutable size_type            _privateStart; // The part of _text no
+    mutable size_type            _privateEnd;   // snapshot refers to.
+    LineIndex                    _lines;
+    mutable ColumnIndex          _columns;
+    BufferDamage                 _damage;
+    UndoLog<T>                   _undo;
+    Journal*                     _journal;
+    mutable BufferCounters       _counters;
+
+    static constexpr value_type NEWLINE = value_type('\n');
+
+    static bool isNewline(const value_type& c) {
+        return c == NEWLINE;
+    }
+
+    // searchBackward() without counting.  The text on each side of the gap
+    // is contiguous so it is searched directly with scanFindLast().
+    size_type findBackward(value_type c, size_type pos) const {
+        span_type pre = preGap();
+        span_type post = postGap();
+        size_type last = std::min(pos + 1, size());
+
+        if (last > pre.size()) {
+            const_pointer end = post.begin() + (last - pre.size());
+            const_pointer i = scanFindLast(post.begin(), end, c);
+            if (i != end) {
+                return pre.size() + (i - post.begin()) + 1;
+            }
+            last = pre.size();
+        }
+
+        const_pointer end = pre.begin() + last;
+        const_pointer i = scanFindLast(pre.begin(), end, c);
+        return (i != end) ? (i - pre.begin()) + 1 : npos;
+    }
+
+    // searchForward() without counting.
+    size_type findForward(value_type c, size_type pos) const {
+        span_type pre = preGap();
+        span_type post = postGap();
+
+        if (pos < pre.size()) {
+            const_pointer i = scanFind(pre.begin() + pos, pre.end(), c);
+            if (i != pre.end()) {
+                return i - pre.begin();
+            }
+            pos = pre.size();
+        }
 
+        if (pos - pre.size() < post.size()) {
+            const_pointer i = scanFind(post.begin() + (pos - pre.size()),
+                post.end(), c);
+            if (i != post.end()) {
+                return pre.size() + (i - post.begin());
+            }
+        }
+        return npos;
+    }
+
+    // Deletes the n elements from pos by moving the gap there and widening
+    // it over them, so it costs no more than counting their newlines.
+    // Point is left at pos.  backward says whether the deletion is of the
+    // text before point and text is a copy of it if there is one; both are
+    // for undo.
+    bool remove(size_type pos, size_type n, bool backward = false,
+    const chunk_type& text = nullptr) {
+        if (pos > size() || n > size() - pos) {
+            return false;
+        }
+
+        if (text) {
+            _undo.erasing(pos, text);
+        } else {
+            _undo.erasing(*this, pos, n, backward);
+        }
+        markRemoved(pos, n);
+        _point = pos;
+        moveGap();
+        size_type newlines = _lines.total();
+        countLines(_gapEnd, _gapEnd + n, -1);
+        _damage.erased(pos, n, _lines.total() != newlines);
+        _columns.erased(pos, n);
+        _gapEnd += n;
+        if (_journal != nullptr) {
+            _journal->erased(pos, n);
+        }
+        return true;
+    }
+
+    void journalInserted(size_type pos, size_type n) {
+        if (_journal != nullptr) {
+            _journal->inserted(*this, pos, n);
+        }
+    }
+
+    // An insertion at the mark goes after it.
+    void markInserted(size_type pos, size_type n) {
+        if (_mark != npos && _mark > pos) {
+            _mark += n;
+        }
+    }
+
+    void markRemoved(size_type pos, size_type n) {
+        if (_mark != npos && _mark > pos) {
+            _mark = (_mark > pos + n) ? _mark - n : pos;
+        }
+    }
+
+    // The offset in _text of the element at pos.
+    size_type physical(size_type pos) const {
+        size_type gapStart = _gapStart - _text->begin();
+        return (pos < gapStart) ? pos : pos + (_gapEnd - _gapStart);
+    }
+
+    // The number of newlines in [first, last) of _text, leaving out the gap.
+    size_type countNewlines(size_type first, size_type last) const {
+        size_type gapStart = _gapStart - _text->begin();
+        size_type gapEnd = _gapEnd - _text->begin();
+        size_type count = 0;
+
+        const_pointer text = _text->data();
+
+        if (first < gapStart) {
+            count += scanCount(text + first, text + std::min(last, gapStart),
+                NEWLINE);
+        }
+        if (last > gapEnd) {
+            count += scanCount(text + std::max(first, gapEnd), text + last,
+                NEWLINE);
+        }
+        return count;
+    }
+
+    // Tells the line index that the newlines in [first, last) have just come
+    // into the text (sign is 1) or are about to leave it (sign is -1).
+    void countLines(container_const_iterator first,
+    container_const_iterator last, difference_type sign) {
+        const_pointer text = _text->data();
+        size_type offset = first - _text->begin();
+        size_type end = last - _text->begin();
+
+        while (offset < end) {
+            size_type chunkEnd = std::min(end,
+                (offset | (LineIndex::CHUNKSIZE - 1)) + 1);
+            // A whole chunk of text that is leaving takes every newline the
+            // index has for it so there is no need to look.
+            difference_type count =
+                (sign < 0 && chunkEnd - offset == LineIndex::CHUNKSIZE) ?
+                _lines.count(offset >> LineIndex::CHUNKBITS) :
+                scanCount(text + offset, text + chunkEnd, NEWLINE);
+            if (count) {
+                _lines.add(offset, sign * count);
+            }
+            offset = chunkEnd;
+        }
+    }
+
+    void rebuildLines() {
+        _lines.reset(_text->size());
+        countLines(_text->begin(), _gapStart, 1);
+        countLines(_gapEnd, _text->end(), 1);
+    }
+
+    // Moves the gap to point and makes room to write n elements at the start
+    // of it.
+    void openGap(size_type n) {
+        moveGap();
+        growGap(n);
+        size_type gapStart = _gapStart - _text->begin();
+        writing(gapStart, gapStart + n);
+    }
+
+    // Makes sure there is room for at least n more elements in the gap.  The
+    // capacity grows geometrically (but never by less than N) so a long run
+    // of insertions costs amortized constant time per element.  The gap
+    // stays where it is.  The text is copied rather than moved out of the old
+    // storage since a snapshot may still be reading it.
+    void growGap(size_type n) {
+        size_type gap = _gapEnd - _gapStart;
+        if (gap >= n) {
+            return;
+        }
+
+        size_type oldCapacity = _text->size();
+        size_type newCapacity = std::max(oldCapacity + (n - gap) + N,
+            oldCapacity * 2);
+        difference_type before = _gapStart - _text->begin();
+        difference_type after = _text->end() - _gapEnd;
+
+        Container text(newCapacity, 0);
+        _counters._reallocations++;
+        std::copy(_text->begin(), _gapStart, text.begin());
+        std::copy(_gapEnd, _text->end(), text.end() - after);
+        _text = std::make_shared<Container>(std::move(text));
+        _privateStart = 0;
+        _privateEnd = newCapacity;
+
+        _gapStart = _text->begin() + before;
+        _gapEnd = _text->end() - after;
+        rebuildLines();
+    }
+
+    // The text between the gap and point is copied into the gap (to the far
+    // end of it if point is before the gap) which swaps them over.
     void moveGap() {
-        if (_gapStart == _gapEnd) {
-            _text.resize(_text.capacity() + N, 0);
-            _text.shrink_to_fit();
-            _gapStart = _text.end() - N;
-            _gapEnd = _text.end();
+        size_type gapStart = _gapStart - _text->begin();
+        size_type gapEnd = _gapEnd - _text->begin();
+        size_type to = physical(_point);
+        if (to > gapEnd) {
+            writing(gapStart, gapStart + (to - gapEnd));
+        } else if (to < gapStart) {
+            writing(gapEnd - (gapStart - to), gapEnd);
         }
 
         container_const_iterator p = userToGap(_point);
@@ -275,7 +1041,9 @@ private:
         difference_type n;
         if (_gapStart < p) { // point is after gapStart
             n = p - _gapEnd;
-            copy(p - n , p, _gapStart);
+            countLines(p - n, p, -1);
+            std::copy(p - n , p, _gapStart);
+            countLines(_gapStart, _gapStart + n, 1);
             _gapStart += n;
             _gapEnd += n;
             _point = gapToUser(_gapStart);
@@ -283,12 +1051,44 @@ private:
             n = _gapStart - p;
             _gapStart -= n;
             _gapEnd -= n;
-            copy(p, p + n, _gapEnd);
+            // The source and destination overlap when the gap is smaller
+            // than the distance moved so this has to copy from the back.
+            countLines(p, p + n, -1);
+            std::copy_backward(p, p + n, _gapEnd + n);
+            countLines(_gapEnd, _gapEnd + n, 1);
+        }
+
+        if (n > 0) {
+            _counters._gapMoves++;
+            _counters._gapBytes += n * sizeof(T);
         }
     }
 
+    // Makes sure [first, last) of the storage can be written without
+    // changing a snapshot.  If a snapshot might be reading it and one is
+    // still alive, the buffer moves to a copy of the storage.
+    void writing(size_type first, size_type last) {
+        if (first >= _privateStart && last <= _privateEnd) {
+            return;
+        }
+
+        if (_text.use_count() > 1) {
+            difference_type gapStart = _gapStart - _text->begin();
+            difference_type gapEnd = _gapEnd - _text->begin();
+            _text = std::make_shared<Container>(*_text);
+            _counters._reallocations++;
+            _gapStart = _text->begin() + gapStart;
+            _gapEnd = _text->begin() + gapEnd;
+        } else {
+            // No snapshot has it any more (see BufferSnapshot.)
+            std::atomic_thread_fence(std::memory_order_acquire);
+        }
+        _privateStart = 0;
+        _privateEnd = _text->size();
+    }
+
     container_iterator userToGap(size_type p) {
-        container_iterator i = _text.begin() + p;
+        container_iterator i = _text->begin() + p;
 
         if (i >= _gapStart) {
             i += (_gapEnd - _gapStart);
@@ -298,7 +1098,7 @@ private:
     }
 
     size_type gapToUser(container_const_iterator i) const {
-        difference_type p = i - _text.begin();
+        difference_type p = i - _text->begin();
 
         if (i >= _gapEnd) {
             p -= (_gapEnd - _gapStart);
@@ -312,6 +1112,9 @@ private:
     }
 };
 
+template<typename T, std::size_t N, typename Container>
+constexpr typename Buffer<T, N, Container>::value_type
+Buffer<T, N, Container>::NEWLINE;
 
 template<typename T, bool isConst>
 class BufferIterator {
@@ -336,15 +1139,16 @@ public:
     BufferIterator() : _buffer{nullptr}, _pos{nullptr} {
     }
 
-    BufferIterator(buffer_ptr_type buffer) : _buffer{buffer} {
-        if (_buffer->_gapStart == _buffer->_text.begin() && !_buffer->empty()) {
+    BufferIterator(buffer_ptr_type buffer) : _buffer{buffer},
+    _pos{buffer->_gapStart} {
+        if (_pos == _buffer->_text->begin() && !_buffer->empty()) {
             _pos = _buffer->_gapEnd;
         } else {
-            // we have to go through all these convulutions just to assign the
-            // value of a const iterator to an iterator.
-            std::advance(_pos,
-                std::distance<typename T::container_const_iterator>(_pos,
-                    _buffer->_text.begin()));
+            // _text may be const so its begin() can't be assigned to _pos
+            // but the same place can be reached by stepping back from the
+            // gap.
+            _pos -= std::distance<typename T::container_const_iterator>(
+                _buffer->_text->begin(), _pos);
         }
     }
 
@@ -352,14 +1156,6 @@ public:
     _buffer(that._buffer), _pos{that._pos} {
     }
 
-    self_type& operator=(const self_type& that) {
-        if (this != &that) {
-            &this->_buffer = &that._buffer;
-            this->_pos = that._pos;
-        }
-        return *this;
-    }
-
     bool operator==(const self_type& that) {
         return _buffer == that._buffer && _pos == that._pos;
     }
@@ -0,0 +1,558 @@
+// ColumnIndex -- finds columns and characters in a text editor buffer
+//
+// By Jaldhar H. Vyas <jaldhar@braincells.com>
+// Copyright (C) 2017, Consolidated Braincells Inc. All rights reserved.
+// "Do what thou wilt" shall be the whole of the license.
+//
+// The text of a buffer is divided into chunks of about CHUNKSIZE bytes and
+// for each one a TextAdvance is kept: how many characters start in it and how
+// it moves the column along.  These are combined pairwise in a segment tree,
+// so the column of a position on a line, or the position of a column or of
+// the n'th character from somewhere, is found from O(log chunks) of them plus
+// decoding what is left of at most two chunks.  How big each chunk is is
+// kept in a Fenwick tree to find the chunk a position is in.
+//
+// The owner reports every insertion and deletion.  Only the sizes of the
+// chunks they touch are changed then; the chunks themselves are decoded again
+// the next time they are needed.  Chunks that are never needed are never
+// decoded at all, so a large file costs nothing until columns are asked for
+// and then only as much as the lines they are asked for on.  A chunk that
+// grows to more than twice CHUNKSIZE is split up again.
+
+#ifndef _COLUMNINDEX_H_
+#define _COLUMNINDEX_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+#include <vector>
+#include "utf8.h"
+
+// How a run of text moves the column along and how many characters (not
+// counting combining marks and other codepoints that take up no room) start
+// in it.  The column after it depends on the column before it like this:
+//
+//     SHIFT: column + _width
+//     TAB:   the tab stop after column + _before, plus _width
+//     LINE:  _width (the run has a newline in it and _width is after the last)
+struct TextAdvance {
+    enum Kind : unsigned char { SHIFT, TAB, LINE };
+
+    std::size_t _chars;
+    std::size_t _before;
+    std::size_t _width;
+    Kind        _kind;
+
+    TextAdvance() : _chars{0}, _before{0}, _width{0}, _kind{SHIFT} {
+    }
+
+    // The column after the run if it starts at column.
+    std::size_t apply(std::size_t column) const {
+        switch (_kind) {
+            case SHIFT:
+                return column + _width;
+            case TAB:
+                return tabStop(column + _before) + _width;
+            default:
+                return _width;
+        }
+    }
+
+    // Adds that run to the end of this one.
+    void append(const TextAdvance& that) {
+        _chars += that._chars;
+        switch (that._kind) {
+            case SHIFT:
+                _width += that._width;
+                break;
+            case TAB:
+                if (_kind == SHIFT) {
+                    _kind = TAB;
+                    _before = _width + that._before;
+                    _width = that._width;
+                } else {
+                    _width = tabStop(_width + that._before) + that._width;
+                }
+                break;
+            case LINE:
+                _kind = LINE;
+                _width = that._width;
+                break;
+        }
+    }
+
+    // Adds codepoint to the end of the run.
+    void append(char32_t codepoint) {
+        if (codepoint == '\n') {
+            _chars++;
+            _kind = LINE;
+            _width = 0;
+        } else if (codepoint == '\t') {
+            TextAdvance tab;
+            tab._chars = 1;
+            tab._kind = TAB;
+            append(tab);
+        } else {
+            std::size_t width = utf8Width(codepoint);
+            _chars += (width != 0);
+            _width += width;
+        }
+    }
+
+    // Adds that run to the beginning of this one.
+    void prepend(const TextAdvance& that) {
+        TextAdvance run = that;
+        run.append(*this);
+        *this = run;
+    }
+
+    static std::size_t tabStop(std::size_t column) {
+        return column / TABSTOP * TABSTOP + TABSTOP;
+    }
+};
+
+class ColumnIndex {
+public:
+    static const std::size_t CHUNKBITS = 12;
+    static const std::size_t CHUNKSIZE = std::size_t(1) << CHUNKBITS;
+
+    ColumnIndex() : _sizes(), _starts(), _nodes(), _leaves{0} {
+        reset(0);
+    }
+
+    // Forgets everything about the text, which is now size bytes long.
+    void reset(std::size_t size) {
+        _sizes.resize(std::max(std::size_t(1), chunks(size)));
+        fill(0, _sizes.size(), size);
+        build(std::vector<Node>(_sizes.size()));
+    }
+
+    // n bytes have been inserted at pos.
+    void inserted(std::size_t pos, std::size_t n) {
+        std::size_t start;
+        std::size_t chunk = find(pos, start);
+        resize(chunk, _sizes[chunk] + n);
+        touch(pos, pos + n);
+        if (_sizes[chunk] > 2 * CHUNKSIZE) {
+            split(chunk);
+        }
+    }
+
+    // n bytes have been erased from pos.
+    void erased(std::size_t pos, std::size_t n) {
+        std::size_t start;
+        std::size_t chunk = find(pos, start);
+        for (std::size_t offset = pos - start; n > 0; chunk++, offset = 0) {
+            std::size_t count = std::min(n, _sizes[chunk] - offset);
+            resize(chunk, _sizes[chunk] - count);
+            n -= count;
+        }
+        touch(pos, pos);
+    }
+
+    // How the text of buffer in [from, to) moves the column along.  from
+    // has to be at the start of a codepoint.
+    template<typename B>
+    TextAdvance measure(const B& buffer, std::size_t from, std::size_t to) {
+        TextAdvance advance;
+        if (from >= to) {
+            return advance;
+        }
+
+        std::size_t start;
+        std::size_t first = find(from, start);
+        std::size_t end = start + _sizes[first];
+        if (from != start || to <= end) {
+            decode(buffer, from, std::min(to, end), advance);
+            first++;
+        }
+        if (to > end) {
+            std::size_t last = find(to, start);
+            advance.append(range(buffer, 1, 0, _leaves, first, last));
+            decode(buffer, boundary(buffer, start), to, advance);
+        }
+        return advance;
+    }
+
+    // The first codepoint in [from, to) for which done(advance) is true,
+    // where advance is the TextAdvance from from up to and including it, or
+    // to if there isn't one.  done has to stay true once it is.  from has to
+    // be at the start of a codepoint.
+    template<typename B, typename F>
+    std::size_t find(const B& buffer, std::size_t from, std::size_t to,
+    F done) {
+        if (from >= to) {
+            return to;
+        }
+
+        TextAdvance advance;
+        std::size_t start;
+        std::size_t first = find(from, start);
+        std::size_t end = start + _sizes[first];
+        std::size_t found;
+        if (from != start || to <= end) {
+            found = scan(buffer, from, std::min(to, end), advance, done);
+            if (found != npos || to <= end) {
+                return (found != npos) ? found : to;
+            }
+            first++;
+        }
+
+        std::size_t last = find(to, start);
+        std::size_t chunk = seek(buffer, 1, 0, _leaves, first, last,
+            advance, done);
+        if (chunk != npos) {
+            start = this->start(chunk);
+            end = start + _sizes[chunk];
+        } else {
+            end = to;
+        }
+        found = scan(buffer, boundary(buffer, start), end, advance, done);
+        return (found != npos) ? found : std::min(end, to);
+    }
+
+    // The last codepoint in [from, to) for which done(advance) is true, where
+    // advance is the TextAdvance from it up to to, or from if there isn't
+    // one.  done has to stay true once it is.
+    template<typename B, typename F>
+    std::size_t findBackward(const B& buffer, std::size_t from,
+    std::size_t to, F done) {
+        if (from >= to) {
+            return from;
+        }
+
+        TextAdvance advance;
+        std::size_t start;
+        std::size_t last = find(to, start);
+        std::size_t found = scanBackward(buffer,
+            std::max(from, boundary(buffer, start)), to, advance, done);
+        if (found != npos || from >= start) {
+            return (found != npos) ? found : from;
+        }
+
+        std::size_t first = find(from, start);
+        std::size_t chunk = seekBackward(buffer, 1, 0, _leaves, first + 1,
+            last, advance, done);
+        std::size_t end;
+        if (chunk != npos) {
+            start = this->start(chunk);
+            end = start + _sizes[chunk];
+            start = boundary(buffer, start);
+        } else {
+            start = from;
+            end = this->start(first) + _sizes[first];
+        }
+        found = scanBackward(buffer, start, end, advance, done);
+        return (found != npos) ? found : from;
+    }
+
+private:
+    static const std::size_t npos = -1;
+
+    struct Node {
+        TextAdvance _advance;
+        bool        _known;
+
+        Node() : _advance(), _known{false} {
+        }
+    };
+
+    std::vector<std::size_t> _sizes;  // How big each chunk is.
+    std::vector<std::size_t> _starts; // Fenwick tree of the same.
+    std::vector<Node>        _nodes;  // Segment tree, leaves from _leaves.
+    std::size_t              _leaves;
+
+    static std::size_t chunks(std::size_t size) {
+        return (size + CHUNKSIZE - 1) >> CHUNKBITS;
+    }
+
+    // Shares size bytes out among the n chunks from first, CHUNKSIZE to each
+    // but the last.
+    void fill(std::size_t first, std::size_t n, std::size_t size) {
+        for (std::size_t i = first; i < first + n; i++) {
+            _sizes[i] = (size > CHUNKSIZE) ? CHUNKSIZE : size;
+            size -= _sizes[i];
+        }
+    }
+
+    // Makes the trees again from the sizes and leaves.
+    void build(std::vector<Node>&& leaves) {
+        _starts.assign(_sizes.size() + 1, 0);
+        for (std::size_t i = 1; i < _starts.size(); i++) {
+            _starts[i] += _sizes[i - 1];
+            std::size_t parent = i + (i & -i);
+            if (parent < _starts.size()) {
+                _starts[parent] += _starts[i];
+            }
+        }
+
+        _leaves = 1;
+        while (_leaves < leaves.size()) {
+            _leaves *= 2;
+        }
+        _nodes.assign(2 * _leaves, Node());
+        std::move(leaves.begin(), leaves.end(), _nodes.begin() + _leaves);
+        for (std::size_t i = _leaves + leaves.size(); i < 2 * _leaves; i++) {
+            _nodes[i]._known = true;
+        }
+        for (std::size_t i = _leaves - 1; i > 0; i--) {
+            combine(i);
+        }
+    }
+
+    void combine(std::size_t node) {
+        const Node& left = _nodes[2 * node];
+        const Node& right = _nodes[2 * node + 1];
+        _nodes[node]._known = left._known && right._known;
+        if (_nodes[node]._known) {
+            _nodes[node]._advance = left._advance;
+            _nodes[node]._advance.append(right._advance);
+        }
+    }
+
+    // The chunk pos is in and where it starts.  If pos is the end of the
+    // text it is in the last chunk.
+    std::size_t find(std::size_t pos, std::size_t& start) const {
+        std::size_t chunk = 0;
+        std::size_t step = 1;
+        while (step * 2 < _starts.size()) {
+            step *= 2;
+        }
+
+        start = 0;
+        for (; step > 0; step /= 2) {
+            if (chunk + step < _starts.size() &&
+            start + _starts[chunk + step] <= pos) {
+                chunk += step;
+                start += _starts[chunk];
+            }
+        }
+        if (chunk == _sizes.size()) {
+            chunk--;
+            start -= _sizes[chunk];
+        }
+        return chunk;
+    }
+
+    std::size_t start(std::size_t chunk) const {
+        std::size_t start = 0;
+        for (std::size_t i = chunk; i > 0; i -= i & -i) {
+            start += _starts[i];
+        }
+        return start;
+    }
+
+    void resize(std::size_t chunk, std::size_t size) {
+        for (std::size_t i = chunk + 1; i < _starts.size(); i += i & -i) {
+            _starts[i] += size - _sizes[chunk];
+        }
+        _sizes[chunk] = size;
+    }
+
+    // The text in [from, to) has changed.  A codepoint can be up to three
+    // bytes either side of it, so the chunks those are in have to be
+    // decoded again as well.
+    void touch(std::size_t from, std::size_t to) {
+        std::size_t start;
+        std::size_t chunk = find(from - std::min<std::size_t>(from, 3), start);
+        for (; chunk < _sizes.size() && start < to + 3; chunk++) {
+            for (std::size_t i = _leaves + chunk; i > 0 && _nodes[i]._known;
+            i /= 2) {
+                _nodes[i]._known = false;
+            }
+            start += _sizes[chunk];
+        }
+    }
+
+    // Breaks chunk up into chunks of CHUNKSIZE.
+    void split(std::size_t chunk) {
+        std::size_t size = _sizes[chunk];
+        std::size_t n = chunks(size);
+        std::vector<Node> leaves(_nodes.begin() + _leaves,
+            _nodes.begin() + _leaves + _sizes.size());
+        leaves.insert(leaves.begin() + chunk + 1, n - 1, Node());
+        leaves[chunk] = Node();
+        _sizes.insert(_sizes.begin() + chunk + 1, n - 1, 0);
+        fill(chunk, n, size);
+        build(std::move(leaves));
+    }
+
+    // The first position at or after pos where a codepoint starts.  Only a
+    // sequence starting up to three bytes before pos can go past it.
+    template<typename B>
+    static std::size_t boundary(const B& buffer, std::size_t pos) {
+        std::size_t from = pos - std::min<std::size_t>(pos, 3);
+        std::size_t lead = npos;
+        buffer.for_each_segment(from, pos,
+            [&from, &lead](const char* data, std::size_t length) {
+                for (std::size_t i = 0; i < length; i++, from++) {
+                    unsigned char c = data[i];
+                    if ((c & 0xC0) != 0x80) {
+                        lead = (c >= 0xC2 && c <= 0xF4) ? from : npos;
+                    }
+                }
+                return true;
+            });
+        if (lead == npos) {
+            return pos;
+        }
+
+        std::size_t end = pos;
+        utf8ForEach(buffer, lead, lead + 1,
+            [&end](std::size_t at, char32_t, std::size_t length) {
+                end = std::max(end, at + length);
+                return false;
+            });
+        return end;
+    }
+
+    template<typename B>
+    static void decode(const B& buffer, std::size_t from, std::size_t to,
+    TextAdvance& advance) {
+        utf8ForEach(buffer, from, to,
+            [&advance](std::size_t, char32_t codepoint, std::size_t) {
+                advance.append(codepoint);
+                return true;
+            });
+    }
+
+    // The first codepoint in [from, to) for which done(advance) is true once
+    // it has been added, or npos, with advance added to as it goes.
+    template<typename B, typename F>
+    static std::size_t scan(const B& buffer, std::size_t from,
+    std::size_t to, TextAdvance& advance, F& done) {
+        std::size_t found = npos;
+        utf8ForEach(buffer, from, to,
+            [&advance, &found, &done](std::size_t pos, char32_t codepoint,
+            std::size_t) {
+                TextAdvance next = advance;
+                next.append(codepoint);
+                if (done(next)) {
+                    found = pos;
+                    return false;
+                }
+                advance = next;
+                return true;
+            });
+        return found;
+    }
+
+    // As scan() but from to backwards, with advance added to at the front.
+    template<typename B, typename F>
+    static std::size_t scanBackward(const B& buffer, std::size_t from,
+    std::size_t to, TextAdvance& advance, F& done) {
+        std::vector<std::pair<std::size_t, char32_t>> codepoints;
+        utf8ForEach(buffer, from, to,
+            [&codepoints](std::size_t pos, char32_t codepoint, std::size_t) {
+                codepoints.emplace_back(pos, codepoint);
+                return true;
+            });
+
+        for (auto i = codepoints.rbegin(); i != codepoints.rend(); ++i) {
+            TextAdvance next;
+            next.append(i->second);
+            next.append(advance);
+            if (done(next)) {
+                return i->first;
+            }
+            advance = next;
+        }
+        return npos;
+    }
+
+    // Decodes chunk and records what it was.
+    template<typename B>
+    const TextAdvance& leaf(const B& buffer, std::size_t chunk) {
+        Node& node = _nodes[_leaves + chunk];
+        if (!node._known) {
+            std::size_t start = this->start(chunk);
+            node._advance = TextAdvance();
+            decode(buffer, boundary(buffer, start), start + _sizes[chunk],
+                node._advance);
+            node._known = true;
+        }
+        return node._advance;
+    }
+
+    // The TextAdvance of the chunks [first, last) under node, which covers
+    // [left, right), decoding any that have to be.
+    template<typename B>
+    TextAdvance range(const B& buffer, std::size_t node, std::size_t left,
+    std::size_t right, std::size_t first, std::size_t last) {
+        if (last <= left || right <= first) {
+            return TextAdvance();
+        }
+        if (right - left == 1) {
+            return leaf(buffer, left);
+        }
+        if (first <= left && right <= last && _nodes[node]._known) {
+            return _nodes[node]._advance;
+        }
+
+        std::size_t middle = (left + right) / 2;
+        TextAdvance advance = range(buffer, 2 * node, left, middle, first,
+            last);
+        advance.append(range(buffer, 2 * node + 1, middle, right, first,
+            last));
+        combine(node);
+        return advance;
+    }
+
+    // The first chunk in [first, last) under node (which covers [left,
+    // right)) for which done(advance) is true once it has been added, or
+    // npos, with advance added to as it goes.
+    template<typename B, typename F>
+    std::size_t seek(const B& buffer, std::size_t node, std::size_t left,
+    std::size_t right, std::size_t first, std::size_t last,
+    TextAdvance& advance, F& done) {
+        if (last <= left || right <= first) {
+            return npos;
+        }
+        if (first <= left && right <= last) {
+            TextAdvance next = advance;
+            next.append(range(buffer, node, left, right, left, right));
+            if (!done(next)) {
+                advance = next;
+                return npos;
+            }
+            if (right - left == 1) {
+                return left;
+            }
+        }
+
+        std::size_t middle = (left + right) / 2;
+        std::size_t found = seek(buffer, 2 * node, left, middle, first, last,
+            advance, done);
+        return (found != npos) ? found : seek(buffer, 2 * node + 1, middle,
+            right, first, last, advance, done);
+    }
+
+    // As seek() but from last backwards, with advance added to at the front.
+    template<typename B, typename F>
+    std::size_t seekBackward(const B& buffer, std::size_t node,
+    std::size_t left, std::size_t right, std::size_t first, std::size_t last,
+    TextAdvance& advance, F& done) {
+        if (last <= left || right <= first) {
+            return npos;
+        }
+        if (first <= left && right <= last) {
+            TextAdvance next = advance;
+            next.prepend(range(buffer, node, left, right, left, right));
+            if (!done(next)) {
+                advance = next;
+                return npos;
+            }
+            if (right - left == 1) {
+                return left;
+            }
+        }
+
+        std::size_t middle = (left + right) / 2;
+        std::size_t found = seekBackward(buffer, 2 * node + 1, middle, right,
+            first, last, advance, done);
+        return (found != npos) ? found : seekBackward(buffer, 2 * node, left,
+            middle, first, last, advance, done);
+    }
+};
+
+#endif
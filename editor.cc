@@ -3,37 +3,221 @@
 // By Jaldhar H. Vyas <jaldhar@braincells.com>
 // Copyright (C) 2017, Consolidated Braincells Inc. All rights reserved.
 // "Do what thou wilt" shall be the whole of the license.
+//
+// Usage: editor [--batch script | --record script] [--stats file]
+//     [--memory megabytes] [--recover] [file]...
+//
+// --batch plays the keys in script without a terminal and prints how long it
+// took.  --record edits as usual but also writes every key to script so the
+// session can be played back later.  --stats writes how long each command
+// took and what the buffers did to file as JSON on exit.  --memory limits how
+// much of each buffer is kept in memory if the editor was built to page text
+// (with -DPAGED_TEXT.)  --recover makes the changes in the journals an
+// editor that died left behind for the files again.
 
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <getopt.h>
+#include <sys/resource.h>
 using namespace std;
 
 #include "evaluate.h"
 #include "key.h"
+#include "script.h"
 #include "subeditor.h"
 #include "window.h"
 
 void redisplay() {
 }
 
-int main(int argc, const char* argv[]) {
+// How often the screen is repainted while a buffer is being saved, in
+// milliseconds, even if no keys are typed.
+static const int SAVEWAIT = 100;
+
+static void usage() {
+    fprintf(stderr,
+        "usage: editor [--batch script | --record script] [--stats file] "
+        "[--memory megabytes] [--recover] [file]...\n");
+    exit(EXIT_FAILURE);
+}
+
+// Plays script and prints how many keys there were, how long they took and
+// the most memory the editor used, as a header line and a line of tab
+// separated fields.  With nothing to paint, each key is timed just until it
+// has been evaluated.
+static int batch(Subeditor& subeditor, const char* filename) {
+    Script script;
+    if (!script.load(filename)) {
+        perror(filename);
+        return EXIT_FAILURE;
+    }
+
+    Evaluate evaluate(subeditor, script, nullptr);
+    using clock = chrono::steady_clock;
+    auto start = clock::now();
+
+    int c;
+    while ((c = script.get()) != ERR) {
+        bool isExit = (c != KEY_RESIZE && evaluate(c));
+        subeditor.finishSaves();
+        subeditor.statistics().painted();
+        if (isExit) {
+            break;
+        }
+    }
+
+    chrono::duration<double> elapsed = clock::now() - start;
+    double seconds = elapsed.count();
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    printf("keys\tseconds\tkeys/s\tbeeps\tbuffers\tpeak-kb\n");
+    printf("%zu\t%.6f\t%.0f\t%zu\t%zu\t%ld\n", script.position(), seconds,
+        (seconds > 0) ? script.position() / seconds : 0.0, script.beeps(),
+        subeditor.buffers(), usage.ru_maxrss);
+
+    return EXIT_SUCCESS;
+}
+
+static void writeStatistics(Subeditor& subeditor, const char* filename) {
+    if (filename != NULL &&
+    !subeditor.statistics().write(filename, subeditor.counters())) {
+        perror(filename);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    static const struct option options[] = {
+        { "batch", required_argument, NULL, 'b' },
+        { "record", required_argument, NULL, 'r' },
+        { "stats", required_argument, NULL, 's' },
+        { "memory", required_argument, NULL, 'm' },
+        { "recover", no_argument, NULL, 'R' },
+        { NULL, 0, NULL, 0 }
+    };
+    const char* batchScript = NULL;
+    const char* recordScript = NULL;
+    const char* statsFile = NULL;
+    size_t memoryLimit = 0;
+    bool recover = false;
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1) {
+        switch (opt) {
+            case 'b':
+                batchScript = optarg;
+                break;
+            case 'r':
+                recordScript = optarg;
+                break;
+            case 's':
+                statsFile = optarg;
+                break;
+            case 'm': {
+                char* end;
+                memoryLimit = strtoul(optarg, &end, 10);
+                if (*end != '\0' || memoryLimit == 0) {
+                    usage();
+                }
+                memoryLimit <<= 20;
+                break;
+            }
+            case 'R':
+                recover = true;
+                break;
+            default:
+                usage();
+        }
+    }
+    if (batchScript != NULL && recordScript != NULL) {
+        usage();
+    }
+
+    Subeditor subeditor;
+    if (memoryLimit != 0) {
+        subeditor.memoryLimit(memoryLimit);
+    }
+    subeditor.recover(recover);
+
+    // Each file gets a buffer of its own.  They are visited last first so the
+    // first one ends up current and the rest follow it in order.
+    for (int i = argc - 1; i >= optind; i--) {
+        if (!subeditor.visit(argv[i])) {
+            perror(argv[i]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (batchScript != NULL) {
+        int status = batch(subeditor, batchScript);
+        writeStatistics(subeditor, statsFile);
+        return status;
+    }
+
     Window window;
     Key key;
-    Subeditor subeditor;
-    window.init("Editor");
-    Evaluate evaluate(subeditor, key, window);
+    Recorder recorder(key);
+    KeySource& input = (recordScript != NULL) ?
+        static_cast<KeySource&>(recorder) : key;
+
+    if (recordScript != NULL && !recorder.open(recordScript)) {
+        perror(recordScript);
+        return EXIT_FAILURE;
+    }
+
+    window.init(subeditor.name());
+    Evaluate evaluate(subeditor, input, &window);
     key.init();
-    
+
     int c;
+    bool isExit = false;
     window.redisplay(subeditor);
-    while(true) {
-        c = key.get();
-        if (c == KEY_RESIZE) { // Special NCurses SIGWINCH handler.
-            window.resize();
-        } else if (evaluate(c)) {
-            break;
+    while(!isExit) {
+        // While the rest of the buffer is still to be highlighted keys are
+        // not waited for at all; some more of it is highlighted instead
+        // whenever there are none.  While a buffer is being saved keys are
+        // only waited for a while at a time so the screen can show when the
+        // save is done.  A slice of highlighting only needs a repaint if it
+        // turned out some of the screen was highlighted wrongly.
+        bool repaint = true;
+        if (window.highlighting()) {
+            c = input.poll();
+            if (c == ERR) {
+                repaint = window.highlight(subeditor);
+            }
+        } else if (subeditor.saving()) {
+            c = input.wait(SAVEWAIT);
+        } else {
+            c = input.get();
+        }
+
+        // Everything that has been typed ahead is dealt with before the
+        // screen is repainted, so a burst of input only costs one repaint.
+        while (c != ERR) {
+            repaint = true;
+            if (c == KEY_RESIZE) { // Special NCurses SIGWINCH handler.
+                window.resize();
+            } else if (evaluate(c)) {
+                isExit = true;
+                break;
+            }
+            c = input.poll();
+        }
+
+        if (!isExit) {
+            if (subeditor.finishSaves()) {
+                repaint = true;
+            }
+            if (repaint) {
+                window.redisplay(subeditor);
+                subeditor.statistics().painted();
+            }
         }
-        window.redisplay(subeditor);
     }
 
+    recorder.close();
+    writeStatistics(subeditor, statsFile);
     key.fini();
     return window.fini();
-}
\ No newline at end of file
+}
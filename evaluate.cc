@@ -5,6 +5,9 @@
 // "Do what thou wilt" shall be the whole of the license.
 
 #include <cctype>
+#include <climits>
+#include <cstdlib>
+#include <string>
 using namespace std;
 
 #include <curses.h>
@@ -13,26 +16,85 @@ using namespace std;
 #include "subeditor.h"
 #include "window.h"
 
-Evaluate::Evaluate(Subeditor& subeditor, Key& key, Window& window) :
-_keymap {
-    { 0x06, &Subeditor::forward_char }, // CTRL-f
-    { KEY_RIGHT, &Subeditor::forward_char },
-    { 0x02, &Subeditor::backward_char }, // CTRL-b
-    { KEY_LEFT, &Subeditor::backward_char },
-    { 0x08, &Subeditor::backward_delete_char }, // CTRL-h
-    { KEY_BACKSPACE, &Subeditor::backward_delete_char },
-    { 0x04, &Subeditor::delete_char }, // CTRL-d
-    { KEY_DC, &Subeditor::delete_char },
-    { 0x01, &Subeditor::beginning_of_line }, // CTRL-a
-    { KEY_HOME, &Subeditor::beginning_of_line },
-    { 0x05, &Subeditor::end_of_line }, // CTRL-e
-    { KEY_END, &Subeditor::end_of_line },
-    { 0x0e, &Subeditor::next_line }, // CTRL-n
-    { KEY_DOWN, &Subeditor::next_line },
-    { 0x10, &Subeditor::previous_line }, // CTRL-p
-    { KEY_UP, &Subeditor::previous_line },
-    { 0x11, &Subeditor::quit }, // CTRL-q
-}, _subeditor{subeditor}, _key{key}, _window{window} {
+struct KeyBinding {
+    int         key;
+    COMMAND     command;
+    const char* name;
+};
+
+static const KeyBinding globalBindings[] = {
+    { 0x06, &Subeditor::forward_char, "forward_char" }, // CTRL-f
+    { KEY_RIGHT, &Subeditor::forward_char, "forward_char" },
+    { 0x02, &Subeditor::backward_char, "backward_char" }, // CTRL-b
+    { KEY_LEFT, &Subeditor::backward_char, "backward_char" },
+    { 0x08, &Subeditor::backward_delete_char,
+        "backward_delete_char" }, // CTRL-h
+    { KEY_BACKSPACE, &Subeditor::backward_delete_char, "backward_delete_char" },
+    { 0x04, &Subeditor::delete_char, "delete_char" }, // CTRL-d
+    { KEY_DC, &Subeditor::delete_char, "delete_char" },
+    { 0x01, &Subeditor::beginning_of_line, "beginning_of_line" }, // CTRL-a
+    { KEY_HOME, &Subeditor::beginning_of_line, "beginning_of_line" },
+    { 0x05, &Subeditor::end_of_line, "end_of_line" }, // CTRL-e
+    { KEY_END, &Subeditor::end_of_line, "end_of_line" },
+    { 0x0e, &Subeditor::next_line, "next_line" }, // CTRL-n
+    { KEY_DOWN, &Subeditor::next_line, "next_line" },
+    { 0x10, &Subeditor::previous_line, "previous_line" }, // CTRL-p
+    { KEY_UP, &Subeditor::previous_line, "previous_line" },
+    { 0x1f, &Subeditor::undo, "undo" }, // CTRL-_
+    { 0x1e, &Subeditor::redo, "redo" }, // CTRL-^
+    { 0x00, &Subeditor::set_mark, "set_mark" }, // CTRL-space
+    { 0x17, &Subeditor::kill_region, "kill_region" }, // CTRL-w
+    { 0x19, &Subeditor::yank, "yank" }, // CTRL-y
+    { 0x13, &Subeditor::isearch_forward, "isearch_forward" }, // CTRL-s
+    { 0x12, &Subeditor::isearch_backward, "isearch_backward" }, // CTRL-r
+    { 0x11, &Subeditor::quit, "quit" }, // CTRL-q
+};
+
+// Keys after CTRL-x.
+static const KeyBinding ctrlXBindings[] = {
+    { 0x13, &Subeditor::save_buffer, "save_buffer" }, // CTRL-s
+    { 0x18, &Subeditor::exchange_point_and_mark,
+        "exchange_point_and_mark" }, // CTRL-x
+    { 0x06, &Subeditor::find_file, "find_file" }, // CTRL-f
+    { 'b', &Subeditor::switch_to_buffer, "switch_to_buffer" }, // b
+    { 'k', &Subeditor::kill_buffer, "kill_buffer" }, // k
+    { 'l', &Subeditor::show_statistics, "show_statistics" }, // l
+    { 't', &Subeditor::toggle_truncate_lines,
+        "toggle_truncate_lines" }, // t
+};
+
+// Keys after ESC (i.e. with Meta.)
+static const KeyBinding escBindings[] = {
+    { 'g', &Subeditor::goto_line, "goto_line" }, // g
+    { 0x1f, &Subeditor::redo, "redo" }, // CTRL-_
+    { 'w', &Subeditor::copy_region_as_kill, "copy_region_as_kill" }, // w
+    { 'y', &Subeditor::yank_pop, "yank_pop" }, // y
+    { '%', &Subeditor::replace_string, "replace_string" }, // %
+    { '#', &Subeditor::count_matches, "count_matches" }, // #
+};
+
+template<typename T>
+static void bindAll(Keymap& keymap, const T& bindings) {
+    for (auto& binding: bindings) {
+        keymap.bind(binding.key, binding.command, binding.name);
+    }
+}
+
+Evaluate::Evaluate(Subeditor& subeditor, KeySource& key, Window* window) :
+_keymap(), _ctrlXMap(), _escMap(), _subeditor{subeditor}, _key{key},
+_window{window} {
+    bindAll(_keymap, globalBindings);
+    bindAll(_ctrlXMap, ctrlXBindings);
+    bindAll(_escMap, escBindings);
+    _keymap.bind(0x18, &_ctrlXMap); // CTRL-x
+    _keymap.bind(0x1b, &_escMap); // ESC
+}
+
+// Keys outside the range of unsigned char are curses function keys which
+// isprint() can't be given.  Bytes from 0x80 on are parts of UTF-8
+// sequences.
+static bool isPrintable(int c) {
+    return c >= 0 && c <= 0xff && (c >= 0x80 || isprint(c));
 }
 
 bool Evaluate::operator()(int c) {
@@ -40,19 +102,139 @@ bool Evaluate::operator()(int c) {
     bool isArg = false;
     int arg = 1;
 
-    auto it = _keymap.find(c);
-    if (it == _keymap.end()) {
-        if (isprint(c)) {
-            if (!_subeditor.self_insert(isArg, arg, isExit, c)) {
-                _key.beep();
+    // A message only stays up until the next key.
+    _subeditor.message("");
+
+    if (c == 0x15) { // CTRL-u
+        c = universalArgument(arg);
+        isArg = true;
+    }
+
+    // Prefix keys are followed through their keymaps until a key that is
+    // bound to a command (or not bound at all.)
+    const Keymap* keymap = &_keymap;
+    const Keymap* prefix;
+    while ((prefix = keymap->prefix(c)) != nullptr) {
+        keymap = prefix;
+        c = _key.get();
+    }
+
+    // Each key is timed from here until the screen has been painted after
+    // it.  Keys read by a command that takes more than one are timed
+    // separately.
+    Statistics& statistics = _subeditor.statistics();
+    COMMAND command = keymap->command(c);
+    if (command != nullptr) {
+        // A paste into a command that reads more keys (such as a prompt) is
+        // given to it a byte at a time, as if it had been typed, but without
+        // anything that isn't printable so a newline in it doesn't end the
+        // input.
+        const char* name = keymap->name(c);
+        string pasted;
+        size_t next = 0;
+        statistics.started(name);
+        while (!(_subeditor.*command)(isArg, arg, isExit, c)) {
+            if (next == pasted.size()) {
+                if (_window != nullptr) {
+                    _window->redisplay(_subeditor);
+                    statistics.painted();
+                }
+                do {
+                    c = _key.get();
+                    if (c == Key::PASTE) {
+                        pasted.clear();
+                        next = 0;
+                        for (auto byte: _key.paste()) {
+                            if (isPrintable(static_cast<unsigned char>(byte))) {
+                                pasted += byte;
+                            }
+                        }
+                    }
+                } while (c == Key::PASTE && pasted.empty());
+                if (c == ERR) {
+                    break;
+                }
+                statistics.started(name);
+                if (c != Key::PASTE) {
+                    continue;
+                }
             }
+            c = static_cast<unsigned char>(pasted[next++]);
+        }
+
+        // A command can stop at a key that isn't for it, which then goes
+        // round again as though it had just been typed.
+        int unread = _subeditor.unread();
+        if (unread != ERR) {
+            _key.unget(unread);
         }
-    } else {
-        while (!(it->second)(_subeditor, isArg, arg, isExit, c)) {
-            c = _key.get();
-            _window.redisplay(_subeditor);
+    } else if (keymap != &_keymap) {
+        statistics.started("undefined");
+        _key.beep();
+    } else if (c == Key::PASTE) {
+        statistics.started("paste");
+        if (!_subeditor.paste(_key.paste())) {
+            _key.beep();
+        }
+    } else if (isPrintable(c) && isArg && c < 0x80) {
+        statistics.started("self_insert");
+        if (!_subeditor.self_insert(isArg, arg, isExit, c)) {
+            _key.beep();
+        }
+    } else if (isPrintable(c)) {
+        // Any more printable keys which have already been typed (e.g. when
+        // text is pasted into a terminal that doesn't bracket pastes) are
+        // inserted together with this one.  With an argument, only the rest
+        // of a UTF-8 sequence is and the whole of it is inserted arg times.
+        string text(1, c);
+        statistics.started("self_insert");
+        while ((c = _key.poll()) != ERR) {
+            if (!isPrintable(c) || _keymap.bound(c) ||
+            (isArg && (c & 0xC0) != 0x80)) {
+                _key.unget(c);
+                break;
+            }
+            text += static_cast<char>(c);
+            statistics.started("self_insert");
+        }
+        if (isArg) {
+            string character;
+            character.swap(text);
+            for (int i = 0; i < abs(arg); i++) {
+                text += character;
+            }
+        }
+        if (!_subeditor.insert(text)) {
+            _key.beep();
         }
     }
 
     return isExit;
-}
\ No newline at end of file
+}
+
+// CTRL-u.  Sets arg to 4, or 4 times as much for each further CTRL-u, or to
+// the number typed after it.  Returns the first key after the argument
+// which is the command it is for.
+int Evaluate::universalArgument(int& arg) {
+    bool isNumber = false;
+    arg = 4;
+
+    while (true) {
+        int c = _key.get();
+        if (c == 0x15 && !isNumber) { // CTRL-u
+            if (arg <= INT_MAX / 4) {
+                arg *= 4;
+            }
+        } else if (c >= '0' && c <= '9') {
+            if (!isNumber) {
+                arg = 0;
+                isNumber = true;
+            }
+            if (arg <= (INT_MAX - 9) / 10) {
+                arg = arg * 10 + (c - '0');
+            }
+        } else {
+            return c;
+        }
+    }
+}
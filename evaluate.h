@@ -7,24 +7,26 @@
 #ifndef _EVALUATE_H_
 #define _EVALUATE_H_
 
-#include <functional>
-#include <map>
+#include "keymap.h"
 
-class Key;
+class KeySource;
 class Subeditor;
 class Window;
-using COMMAND = 
-  std::function<bool(Subeditor&, bool& isArg, int& arg, bool& isExit, int c)>;
 
 class Evaluate {
 public:
-    Evaluate(Subeditor& subeditor, Key& key, Window& window);
+    // window may be null if nothing is displayed (e.g. playing a script.)
+    Evaluate(Subeditor& subeditor, KeySource& key, Window* window);
     bool operator()(int c);
 private:
-    std::map<int, COMMAND>  _keymap;
+    Keymap                  _keymap;
+    Keymap                  _ctrlXMap;
+    Keymap                  _escMap;
     Subeditor&              _subeditor;
-    Key&                    _key;
-    Window&                 _window;
+    KeySource&              _key;
+    Window*                 _window;
+
+    int universalArgument(int& arg);
 };
 
 #endif
\ No newline at end of file
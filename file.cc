@@ -0,0 +1,254 @@
+// File -- reads and writes files for a simple text editor (Implementation)
+//
+// By Jaldhar H. Vyas <jaldhar@braincells.com>
+// Copyright (C) 2017, Consolidated Braincells Inc. All rights reserved.
+// "Do what thou wilt" shall be the whole of the license.
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+using namespace std;
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "file.h"
+
+File::File() : _data{nullptr}, _size{0} {
+}
+
+File::~File() {
+    close();
+}
+
+bool File::open(const string& filename) {
+    close();
+
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        ::close(fd);
+        return false;
+    }
+
+    // mmap() refuses zero length mappings so an empty file has no mapping.
+    if (st.st_size > 0) {
+        void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            ::close(fd);
+            return false;
+        }
+        madvise(data, st.st_size, MADV_SEQUENTIAL);
+        _data = data;
+        _size = st.st_size;
+    }
+
+    ::close(fd);
+    return true;
+}
+
+void File::close() {
+    if (_data != nullptr) {
+        munmap(_data, _size);
+    }
+    _data = nullptr;
+    _size = 0;
+}
+
+const char* File::begin() const {
+    return static_cast<const char*>(_data);
+}
+
+const char* File::end() const {
+    return begin() + _size;
+}
+
+size_t File::size() const {
+    return _size;
+}
+
+FileWriter::FileWriter() : _filename(), _temp(), _fd{-1}, _inPlace{false},
+_buffer() {
+}
+
+FileWriter::~FileWriter() {
+    abort();
+}
+
+bool FileWriter::open(const string& filename, bool overwrite) {
+    abort();
+
+    // A link whose file doesn't exist yet can only be written through.
+    struct stat st;
+    bool exists = stat(filename.c_str(), &st) == 0;
+    char* real = exists ? realpath(filename.c_str(), nullptr) : nullptr;
+    _filename = (real != nullptr) ? real : filename;
+    free(real);
+    _inPlace = (exists && overwrite && st.st_nlink > 1) || (!exists &&
+        lstat(filename.c_str(), &st) == 0 && S_ISLNK(st.st_mode));
+
+    _temp = _filename + ".XXXXXX";
+    _fd = mkstemp(&_temp[0]);
+    if (_fd == -1) {
+        return false;
+    }
+
+    // Keep the permissions of the file being replaced.
+    if (exists) {
+        fchmod(_fd, st.st_mode & 07777);
+    } else {
+        mode_t mask = umask(0);
+        umask(mask);
+        fchmod(_fd, 0666 & ~mask);
+    }
+
+    _buffer.reserve(BUFFERSIZE);
+    return true;
+}
+
+bool FileWriter::write(const char* data, size_t size) {
+    if (_fd == -1) {
+        return false;
+    }
+
+    if (_buffer.size() + size <= BUFFERSIZE) {
+        _buffer.insert(_buffer.end(), data, data + size);
+        return true;
+    }
+
+    if (!flush()) {
+        return false;
+    }
+    if (size < BUFFERSIZE) {
+        _buffer.insert(_buffer.end(), data, data + size);
+        return true;
+    }
+    if (!writeAll(_fd, data, size)) {
+        abort();
+        return false;
+    }
+    return true;
+}
+
+bool FileWriter::commit() {
+    if (_fd == -1 || !flush()) {
+        return false;
+    }
+
+    if (fsync(_fd) == -1) {
+        abort();
+        return false;
+    }
+    if (_inPlace) {
+        return copy();
+    }
+
+    int fd = _fd;
+    _fd = -1;
+    if (::close(fd) == -1 || rename(_temp.c_str(), _filename.c_str()) == -1) {
+        unlink(_temp.c_str());
+        return false;
+    }
+
+    return syncDirectory(_filename);
+}
+
+bool FileWriter::flush() {
+    if (!writeAll(_fd, _buffer.data(), _buffer.size())) {
+        abort();
+        return false;
+    }
+    _buffer.clear();
+    return true;
+}
+
+// Copies the temporary file into _filename.  Once _filename has been
+// truncated the temporary file is the only whole copy of the text, so if
+// anything goes wrong after that it is left behind.
+bool FileWriter::copy() {
+    int fd = ::open(_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+        0666);
+    if (fd == -1) {
+        abort();
+        return false;
+    }
+
+    _buffer.resize(BUFFERSIZE);
+    bool copied = true;
+    for (off_t offset = 0; copied; ) {
+        ssize_t n = pread(_fd, _buffer.data(), _buffer.size(), offset);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            copied = n == 0;
+            break;
+        }
+        copied = writeAll(fd, _buffer.data(), n);
+        offset += n;
+    }
+    _buffer.clear();
+    copied = copied && fsync(fd) == 0;
+    int error = errno;
+    if (::close(fd) == -1 && copied) {
+        copied = false;
+        error = errno;
+    }
+
+    ::close(_fd);
+    _fd = -1;
+    if (!copied) {
+        errno = error;
+        return false;
+    }
+    unlink(_temp.c_str());
+    return true;
+}
+
+// write() may write less than asked for so carry on from wherever it
+// stopped.
+bool FileWriter::writeAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t written = ::write(fd, data,
+            min(size, static_cast<size_t>(SSIZE_MAX)));
+        if (written == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+void FileWriter::abort() {
+    if (_fd != -1) {
+        ::close(_fd);
+        unlink(_temp.c_str());
+        _fd = -1;
+    }
+    _buffer.clear();
+}
+
+// Only a sync of the directory itself makes a change to its entries durable.
+bool syncDirectory(const string& filename) {
+    size_t slash = filename.rfind('/');
+    string directory = (slash == string::npos) ? "." :
+        filename.substr(0, max<size_t>(slash, 1));
+    int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+    bool synced = fsync(fd) == 0;
+    ::close(fd);
+    return synced;
+}
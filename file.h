@@ -0,0 +1,81 @@
+// File -- reads and writes files for a simple text editor (Interface)
+//
+// By Jaldhar H. Vyas <jaldhar@braincells.com>
+// Copyright (C) 2017, Consolidated Braincells Inc. All rights reserved.
+// "Do what thou wilt" shall be the whole of the license.
+
+#ifndef _FILE_H_
+#define _FILE_H_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// A read-only memory mapping of a file.  The mapping is released when the
+// object is destroyed or close() is called.
+class File {
+public:
+    File();
+    File(const File&) = delete;
+    File& operator=(const File&) = delete;
+    ~File();
+
+    bool open(const std::string& filename);
+    void close();
+
+    const char* begin() const;
+    const char* end() const;
+    std::size_t size() const;
+
+private:
+    void*       _data;
+    std::size_t _size;
+};
+
+// Writes a file a piece at a time, so text that is never all in memory at
+// once can be saved.  The data goes to a temporary file in the same
+// directory which commit() renames over filename, so readers never see a
+// partially written file.  Small pieces are gathered up and written
+// together; large ones are written as they are.  If the writer is destroyed
+// without being committed, or anything fails, the temporary file is removed
+// and filename is left as it was.
+//
+// A symbolic link is followed and the file it points to is the one replaced.
+// Renaming would leave any other hard links to a file with the old text, so
+// if overwrite is true and there are others, commit() instead copies the
+// temporary file (which has been synced first) into the file itself, and the
+// temporary file is only removed once that has worked.  That must not be done
+// while anything still reads the file as it was, such as a mapping of it.
+class FileWriter {
+public:
+    static const std::size_t BUFFERSIZE = std::size_t(64) << 10;
+
+    FileWriter();
+    FileWriter(const FileWriter&) = delete;
+    FileWriter& operator=(const FileWriter&) = delete;
+    ~FileWriter();
+
+    bool open(const std::string& filename, bool overwrite = false);
+    bool write(const char* data, std::size_t size);
+    bool commit();
+
+private:
+    std::string       _filename;
+    std::string       _temp;
+    int               _fd;
+    bool              _inPlace;   // Copy into _filename instead of renaming.
+    std::vector<char> _buffer;
+
+    bool flush();
+    bool copy();
+    void abort();
+
+    static bool writeAll(int fd, const char* data, std::size_t size);
+};
+
+// Makes a file that was just created, renamed or removed in the directory
+// filename is in stay that way if the system crashes.  Returns false if it
+// couldn't.
+bool syncDirectory(const std::string& filename);
+
+#endif
@@ -0,0 +1,227 @@
+// Highlight -- syntax highlighting for a simple text editor (Implementation)
+//
+// By Jaldhar H. Vyas <jaldhar@braincells.com>
+// Copyright (C) 2017, Consolidated Braincells Inc. All rights reserved.
+// "Do what thou wilt" shall be the whole of the license.
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "highlight.h"
+
+static const Syntax CPLUSPLUS("C++",
+    { ".c", ".cc", ".cpp", ".cxx", ".h", ".hh", ".hpp" },
+    {
+        { "//", nullptr, '\\', false, false, Face::COMMENT },
+        { "/*", "*/", '\0', false, true, Face::COMMENT },
+        { "\"", "\"", '\\', false, false, Face::STRING },
+        { "'", "'", '\\', false, false, Face::STRING },
+        { "#", nullptr, '\\', true, false, Face::PREPROCESSOR },
+    },
+    {
+        { "alignas", Face::KEYWORD }, { "alignof", Face::KEYWORD },
+        { "auto", Face::KEYWORD }, { "bool", Face::KEYWORD },
+        { "break", Face::KEYWORD }, { "case", Face::KEYWORD },
+        { "catch", Face::KEYWORD }, { "char", Face::KEYWORD },
+        { "class", Face::KEYWORD }, { "const", Face::KEYWORD },
+        { "const_cast", Face::KEYWORD }, { "constexpr", Face::KEYWORD },
+        { "continue", Face::KEYWORD }, { "decltype", Face::KEYWORD },
+        { "default", Face::KEYWORD }, { "delete", Face::KEYWORD },
+        { "do", Face::KEYWORD }, { "double", Face::KEYWORD },
+        { "dynamic_cast", Face::KEYWORD }, { "else", Face::KEYWORD },
+        { "enum", Face::KEYWORD }, { "explicit", Face::KEYWORD },
+        { "extern", Face::KEYWORD }, { "false", Face::KEYWORD },
+        { "float", Face::KEYWORD }, { "for", Face::KEYWORD },
+        { "friend", Face::KEYWORD }, { "goto", Face::KEYWORD },
+        { "if", Face::KEYWORD }, { "inline", Face::KEYWORD },
+        { "int", Face::KEYWORD }, { "long", Face::KEYWORD },
+        { "mutable", Face::KEYWORD }, { "namespace", Face::KEYWORD },
+        { "new", Face::KEYWORD }, { "noexcept", Face::KEYWORD },
+        { "nullptr", Face::KEYWORD }, { "operator", Face::KEYWORD },
+        { "override", Face::KEYWORD }, { "private", Face::KEYWORD },
+        { "protected", Face::KEYWORD }, { "public", Face::KEYWORD },
+        { "register", Face::KEYWORD }, { "reinterpret_cast", Face::KEYWORD },
+        { "return", Face::KEYWORD }, { "short", Face::KEYWORD },
+        { "signed", Face::KEYWORD }, { "sizeof", Face::KEYWORD },
+        { "static", Face::KEYWORD }, { "static_assert", Face::KEYWORD },
+        { "static_cast", Face::KEYWORD }, { "struct", Face::KEYWORD },
+        { "switch", Face::KEYWORD }, { "template", Face::KEYWORD },
+        { "this", Face::KEYWORD }, { "thread_local", Face::KEYWORD },
+        { "throw", Face::KEYWORD }, { "true", Face::KEYWORD },
+        { "try", Face::KEYWORD }, { "typedef", Face::KEYWORD },
+        { "typeid", Face::KEYWORD }, { "typename", Face::KEYWORD },
+        { "union", Face::KEYWORD }, { "unsigned", Face::KEYWORD },
+        { "using", Face::KEYWORD }, { "virtual", Face::KEYWORD },
+        { "void", Face::KEYWORD }, { "volatile", Face::KEYWORD },
+        { "while", Face::KEYWORD },
+    },
+    true);
+
+static const Syntax JSON("JSON",
+    { ".json" },
+    {
+        { "\"", "\"", '\\', false, false, Face::STRING },
+    },
+    {
+        { "true", Face::KEYWORD }, { "false", Face::KEYWORD },
+        { "null", Face::KEYWORD },
+    },
+    true);
+
+static const Syntax LOG("Log",
+    { ".log" },
+    {
+        { "\"", "\"", '\\', false, false, Face::STRING },
+    },
+    {
+        { "TRACE", Face::KEYWORD }, { "DEBUG", Face::KEYWORD },
+        { "INFO", Face::KEYWORD }, { "NOTICE", Face::KEYWORD },
+        { "WARN", Face::WARNING }, { "WARNING", Face::WARNING },
+        { "Warning", Face::WARNING }, { "warning", Face::WARNING },
+        { "ERROR", Face::ERROR }, { "Error", Face::ERROR },
+        { "error", Face::ERROR }, { "FATAL", Face::ERROR },
+        { "CRITICAL", Face::ERROR }, { "PANIC", Face::ERROR },
+    },
+    true);
+
+static const Syntax* const SYNTAXES[] = { &CPLUSPLUS, &JSON, &LOG };
+
+static bool isWordStart(char c) {
+    return isalpha(static_cast<unsigned char>(c)) || c == '_';
+}
+
+static bool isWord(char c) {
+    return isalnum(static_cast<unsigned char>(c)) || c == '_';
+}
+
+// Whether s is at pos in the length characters of line.
+static bool at(const char* line, size_t length, size_t pos, const char* s) {
+    size_t n = strlen(s);
+    return n <= length - pos && memcmp(line + pos, s, n) == 0;
+}
+
+static void add(vector<FaceSpan>* spans, size_t start, size_t end,
+Face face) {
+    if (spans != nullptr && start < end && face != Face::PLAIN) {
+        spans->push_back({ start, end, face });
+    }
+}
+
+Syntax::Syntax(const char* name, initializer_list<const char*> suffixes,
+initializer_list<SyntaxRegion> regions,
+initializer_list<pair<const char*, Face>> words, bool numbers) : _name(name),
+_suffixes(suffixes.begin(), suffixes.end()), _regions(regions), _words(),
+_longest{0}, _numbers{numbers} {
+    for (auto& word: words) {
+        _words.emplace(word.first, word.second);
+        _longest = max(_longest, strlen(word.first));
+    }
+}
+
+const Syntax* Syntax::forFile(const string& filename) {
+    for (auto syntax: SYNTAXES) {
+        for (auto& suffix: syntax->_suffixes) {
+            if (filename.size() > suffix.size() &&
+            filename.compare(filename.size() - suffix.size(), suffix.size(),
+            suffix) == 0) {
+                return syntax;
+            }
+        }
+    }
+    return nullptr;
+}
+
+const string& Syntax::name() const {
+    return _name;
+}
+
+Syntax::state_type Syntax::lex(const char* line, size_t length,
+state_type state, vector<FaceSpan>* spans) const {
+    size_t pos = 0;
+    if (state != 0) {
+        Face face = _regions[state - 1]._face;
+        pos = close(line, length, 0, state);
+        add(spans, 0, pos, face);
+    }
+
+    // Nothing but blanks has been seen on the line so far.
+    bool lineStart = (pos == 0);
+
+    while (pos < length) {
+        char c = line[pos];
+        if (c == ' ' || c == '\t') {
+            pos++;
+            continue;
+        }
+
+        size_t start = pos;
+        for (size_t i = 0; i < _regions.size(); i++) {
+            const SyntaxRegion& region = _regions[i];
+            if ((lineStart || !region._lineStart) &&
+            at(line, length, pos, region._open)) {
+                state_type inside = i + 1;
+                pos = close(line, length, pos + strlen(region._open),
+                    inside);
+                add(spans, start, pos, region._face);
+                state = inside;
+                break;
+            }
+        }
+        lineStart = false;
+        if (pos != start) {
+            continue;
+        }
+
+        if (isWordStart(c)) {
+            while (pos < length && isWord(line[pos])) {
+                pos++;
+            }
+            if (pos - start <= _longest) {
+                auto word = _words.find(string(line + start, pos - start));
+                if (word != _words.end()) {
+                    add(spans, start, pos, word->second);
+                }
+            }
+        } else if (_numbers && isdigit(static_cast<unsigned char>(c))) {
+            while (pos < length && (isWord(line[pos]) || line[pos] == '.')) {
+                pos++;
+            }
+            add(spans, start, pos, Face::NUMBER);
+        } else {
+            pos++;
+        }
+    }
+
+    return state;
+}
+
+// Finds the end of the region state is for, looking from pos on.  Returns
+// the position after its closing string and sets state to 0, or if it isn't
+// closed on this line, returns length and leaves state as it is if the region
+// goes on to the next line or sets it to 0 if not.
+size_t Syntax::close(const char* line, size_t length, size_t pos,
+state_type& state) const {
+    const SyntaxRegion& region = _regions[state - 1];
+
+    for (; pos < length; pos++) {
+        if (region._escape != '\0' && line[pos] == region._escape) {
+            if (pos + 1 == length) {
+                return length;
+            }
+            pos++;
+        } else if (region._close != nullptr &&
+        at(line, length, pos, region._close)) {
+            state = 0;
+            return pos + strlen(region._close);
+        }
+    }
+
+    if (!region._multiline) {
+        state = 0;
+    }
+    return length;
+}
@@ -0,0 +1,377 @@
+// Highlight -- syntax highlighting for a simple text editor (Interface)
+//
+// By Jaldhar H. Vyas <jaldhar@braincells.com>
+// Copyright (C) 2017, Consolidated Braincells Inc. All rights reserved.
+// "Do what thou wilt" shall be the whole of the license.
+//
+// A Syntax is a table of the regions a kind of file has (comments, strings,
+// preprocessor lines and so on), the words which stand out in it and whether
+// numbers do.  A line is lexed from the state it starts in, which is the
+// region it starts inside of if any, and the state it ends in is the one the
+// next line starts in.
+//
+// A Highlighter keeps the state every line of a buffer starts in.  After an
+// edit, only the states from the line it was on are lexed again, and that
+// stops as soon as a line after the edit starts in the same state it did
+// before; all the states after that are still right.  The lines about to be
+// painted are lexed then and there, along with any between them and the
+// last state that is known if there aren't too many.  The rest of the buffer
+// is lexed a slice at a time by lexSome() while there is nothing else to do.
+// If the lines to be painted are too far past what has been lexed, they are
+// lexed from a guess and changed() reports them when the real states reach
+// them and turn out to be different.
+//
+// Works with any backend of Buffer:
+//
+//     Highlighter highlighter;
+//     highlighter.reset(Syntax::forFile("editor.cc"), buffer.lines());
+//     highlighter.prepare(buffer, 0, 24);
+//     highlighter.spans(buffer, 0, spans);
+
+#ifndef _HIGHLIGHT_H_
+#define _HIGHLIGHT_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <initializer_list>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// How a piece of text is shown.
+enum class Face : unsigned char {
+    PLAIN, COMMENT, STRING, KEYWORD, NUMBER, PREPROCESSOR, WARNING, ERROR,
+    FACES // How many there are.
+};
+
+// A run of text shown in face, as offsets from the start of its line.
+struct FaceSpan {
+    std::size_t _start;
+    std::size_t _end;
+    Face        _face;
+};
+
+// Text from _open up to and including _close.
+struct SyntaxRegion {
+    const char* _open;
+    const char* _close;     // nullptr if it goes to the end of the line.
+    char        _escape;    // Stops the character after it from closing the
+                            // region, or at the end of a line carries it on
+                            // to the next one.  '\0' if there isn't one.
+    bool        _lineStart; // It can only be the first thing on a line.
+    bool        _multiline; // It goes on past the end of a line until
+                            // _close.
+    Face        _face;
+};
+
+class Syntax {
+public:
+    // 0 outside any region, otherwise one more than the index of the region
+    // the text is in.
+    using state_type = unsigned char;
+
+    Syntax(const char* name, std::initializer_list<const char*> suffixes,
+        std::initializer_list<SyntaxRegion> regions,
+        std::initializer_list<std::pair<const char*, Face>> words,
+        bool numbers);
+
+    // The syntax of a file called filename or nullptr if it has none.
+    static const Syntax* forFile(const std::string& filename);
+
+    const std::string& name() const;
+
+    // Lexes the length characters of a line (without its newline) starting
+    // in state.  Appends whatever is not plain to spans unless it is nullptr
+    // and returns the state the next line starts in.
+    state_type lex(const char* line, std::size_t length, state_type state,
+        std::vector<FaceSpan>* spans) const;
+
+private:
+    std::string                           _name;
+    std::vector<std::string>              _suffixes;
+    std::vector<SyntaxRegion>             _regions;
+    std::unordered_map<std::string, Face> _words;
+    std::size_t                           _longest; // The longest of _words.
+    bool                                  _numbers;
+
+    std::size_t close(const char* line, std::size_t length, std::size_t pos,
+        state_type& state) const;
+};
+
+class Highlighter {
+public:
+    using state_type = Syntax::state_type;
+    using span_list = std::vector<FaceSpan>;
+
+    static const std::size_t npos = -1;
+
+    // At most this many bytes are lexed to reach the lines being painted
+    // before they are guessed at instead.
+    static const std::size_t SYNCBYTES = std::size_t(256) << 10;
+
+    // How many bytes lexSome() lexes at a time.
+    static const std::size_t SLICEBYTES = std::size_t(64) << 10;
+
+    Highlighter() : _syntax{nullptr}, _states(), _known{0}, _converge{0},
+    _lines{0}, _guessTop{0}, _guesses(), _changedFirst{npos},
+    _changedLast{0}, _line() {
+    }
+
+    // Starts again on a buffer of lines lines in syntax, which may be
+    // nullptr to highlight nothing.
+    void reset(const Syntax* syntax, std::size_t lines) {
+        _syntax = syntax;
+        _states.assign(1, 0);
+        _known = 1;
+        _converge = 0;
+        _lines = lines;
+        _guesses.clear();
+        _changedFirst = npos;
+        _changedLast = 0;
+    }
+
+    const Syntax* syntax() const {
+        return _syntax;
+    }
+
+    // Whether every line has been lexed.
+    bool done() const {
+        return _syntax == nullptr || _known >= _lines;
+    }
+
+    // Takes in buffer's damage.  This has to be done once for each edit (or
+    // run of edits) before the damage is cleared, and before anything else
+    // is lexed.
+    template<typename B>
+    void edited(const B& buffer) {
+        const auto& damage = buffer.damage();
+        std::size_t lines = buffer.lines();
+        if (_syntax == nullptr || !damage._damaged) {
+            _lines = lines;
+            return;
+        }
+
+        // Lines were added or removed somewhere between first and last, so
+        // the states after first move with the lines after last.
+        std::size_t first = buffer.lineOf(damage._first);
+        std::size_t last = buffer.lineOf(damage._last);
+        // If the last edit hasn't converged yet, the states from _converge
+        // up to _known have been lexed again since, so only a line past them
+        // can be compared with the state it started in before.
+        bool converging = _known < _states.size();
+        if (converging) {
+            _converge = std::max(_converge, _known);
+        }
+        if (converging && _converge > first) {
+            _converge = (_converge + lines > _lines + first + 1) ?
+                _converge + lines - _lines : first + 1;
+        }
+        if (first + 1 < _states.size()) {
+            auto at = _states.begin() + first + 1;
+            if (lines > _lines) {
+                _states.insert(at, lines - _lines, 0);
+            } else {
+                _states.erase(at, at + std::min(_lines - lines,
+                    _states.size() - (first + 1)));
+            }
+        }
+        _known = std::min(_known, first + 1);
+        _converge = converging ? std::max(_converge, last + 1) : last + 1;
+
+        // Rather than keep track of where guessed lines have gone, they are
+        // all painted again.
+        if (!_guesses.empty()) {
+            changed(std::min(first, _guessTop), npos);
+            _guesses.clear();
+        }
+        _lines = lines;
+    }
+
+    // Gets the states of the lines in [first, last) ready to be painted.
+    template<typename B>
+    void prepare(const B& buffer, std::size_t first, std::size_t last) {
+        last = std::min(last, buffer.lines());
+        if (_syntax == nullptr || last <= _known) {
+            return;
+        }
+
+        std::size_t from = buffer.lineStart(_known - 1);
+        if (buffer.lineStart(last - 1) - from <= SYNCBYTES) {
+            while (_known < last) {
+                from = advance(buffer, from);
+            }
+            return;
+        }
+
+        // The first line after what is known is guessed to start in the
+        // state it did before the last edit, if there was one.
+        std::size_t top = std::max(first, _known);
+        std::vector<state_type> guesses;
+        state_type state = (top < _states.size()) ? _states[top] : 0;
+        from = buffer.lineStart(top);
+        for (std::size_t line = top; line < last; line++) {
+            guesses.push_back(state);
+            from = lex(buffer, from, state, nullptr) + 1;
+        }
+
+        // A line that was painted from a different guess before needs
+        // painting again.
+        for (std::size_t line = top; line < last; line++) {
+            if (guessed(line) && _guesses[line - _guessTop] !=
+            guesses[line - top]) {
+                changed(line, line + 1);
+            }
+        }
+        _guessTop = top;
+        _guesses.swap(guesses);
+    }
+
+    // Sets spans to the parts of line that are not plain.  line must have
+    // been in the range of the last call to prepare().  A line longer than
+    // SYNCBYTES is left plain as it would have to be lexed all over again
+    // each time any of it is painted.
+    template<typename B>
+    void spans(const B& buffer, std::size_t line, span_list& spans) {
+        spans.clear();
+        if (_syntax != nullptr &&
+        buffer.lineEnd(line) - buffer.lineStart(line) <= SYNCBYTES) {
+            state_type state = stateOf(line);
+            lex(buffer, buffer.lineStart(line), state, &spans);
+        }
+    }
+
+    // Lexes about another SLICEBYTES of buffer.  Returns false once all of it
+    // has been.
+    template<typename B>
+    bool lexSome(const B& buffer) {
+        if (done()) {
+            return false;
+        }
+
+        std::size_t from = buffer.lineStart(_known - 1);
+        std::size_t end = from + SLICEBYTES;
+        while (_known < _lines && from < end) {
+            from = advance(buffer, from);
+        }
+        return !done();
+    }
+
+    // Whether any of the lines [first, last) are among those changed() would
+    // give.
+    bool changedIn(std::size_t first, std::size_t last) const {
+        return _changedFirst < last && first < _changedLast;
+    }
+
+    // The lines [first, last) which should be painted again because they
+    // were painted as starting in a state they turned out not to, since the
+    // last call.  Empty if first >= last.
+    std::pair<std::size_t, std::size_t> changed() {
+        auto lines = std::make_pair(_changedFirst, _changedLast);
+        _changedFirst = npos;
+        _changedLast = 0;
+        return lines;
+    }
+
+private:
+    const Syntax*           _syntax;
+    std::vector<state_type> _states;   // The state each line starts in.
+    std::size_t             _known;    // How many of _states are right.  The
+    std::size_t             _converge; // rest are as they were before an
+                                       // edit and are right again once a
+                                       // line from _converge on starts in
+                                       // the same state as it did.
+    std::size_t             _lines;    // How many lines the buffer has.
+    std::size_t             _guessTop; // The first line painted from a
+    std::vector<state_type> _guesses;  // guess and the states they were.
+    std::size_t             _changedFirst;
+    std::size_t             _changedLast;
+    std::vector<char>       _line;     // The line being lexed.
+
+    void changed(std::size_t first, std::size_t last) {
+        _changedFirst = std::min(_changedFirst, first);
+        _changedLast = std::max(_changedLast, last);
+    }
+
+    state_type stateOf(std::size_t line) const {
+        if (line < _known) {
+            return _states[line];
+        }
+        if (guessed(line)) {
+            return _guesses[line - _guessTop];
+        }
+        return 0;
+    }
+
+    bool guessed(std::size_t line) const {
+        return line >= _guessTop && line - _guessTop < _guesses.size();
+    }
+
+    // Lexes the line starting at from in state, leaving state as the state
+    // the next line starts in.  Returns where the line ends.
+    template<typename B>
+    std::size_t lex(const B& buffer, std::size_t from, state_type& state,
+    span_list* spans) {
+        std::vector<char>& text = _line;
+        text.clear();
+        buffer.for_each_segment(from, buffer.size(),
+            [&text](const char* data, std::size_t length) {
+                const char* end = std::find(data, data + length, '\n');
+                text.insert(text.end(), data, end);
+                return end == data + length;
+            });
+        state = _syntax->lex(text.data(), text.size(), state, spans);
+        return from + text.size();
+    }
+
+    // Lexes the line before the first one whose state is not known yet,
+    // which starts at from, to find that state.  Returns where the line
+    // before the next unknown one starts, which is further on if the states
+    // settled.
+    template<typename B>
+    std::size_t advance(const B& buffer, std::size_t from) {
+        std::size_t line = _known;
+        state_type state = _states[line - 1];
+        from = lex(buffer, from, state, nullptr) + 1;
+
+        // What line was painted as starting in, if it was painted at all.
+        state_type painted = state;
+        if (guessed(line)) {
+            painted = _guesses[line - _guessTop];
+        } else if (line < _states.size()) {
+            painted = _states[line];
+        }
+
+        _known++;
+        if (line < _states.size()) {
+            bool same = (_states[line] == state);
+            _states[line] = state;
+            if (same && line >= _converge) {
+                settle(line);
+                from = buffer.lineStart(_known - 1);
+            }
+        } else {
+            _states.push_back(state);
+        }
+        if (painted != state) {
+            changed(line, line + 1);
+        }
+        return from;
+    }
+
+    // line starts in the same state it did before the last edit so the
+    // states after it are all right.  Any lines after it that were guessed
+    // differently need painting again.
+    void settle(std::size_t line) {
+        _known = _states.size();
+        std::size_t first = std::max(line + 1, _guessTop);
+        std::size_t last = std::min(_known, _guessTop + _guesses.size());
+        for (std::size_t i = first; i < last; i++) {
+            if (_guesses[i - _guessTop] != _states[i]) {
+                changed(i, i + 1);
+            }
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,359 @@
+// Journal -- crash recovery for a text editor (Implementation)
+//
+// By Jaldhar H. Vyas <jaldhar@braincells.com>
+// Copyright (C) 2017, Consolidated Braincells Inc. All rights reserved.
+// "Do what thou wilt" shall be the whole of the license.
+
+#include <algorithm>
+#include <cerrno>
+using namespace std;
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "file.h"
+#include "journal.h"
+
+const size_t Journal::BLOCKSIZE;
+const size_t Journal::BATCH;
+const size_t Journal::BACKLOG;
+constexpr chrono::milliseconds Journal::INTERVAL;
+
+Journal::Block::Block(size_t size) : _data(new char[size]), _size{size},
+_ready{0}, _next{nullptr} {
+}
+
+Journal::Journal() : _filename(), _path(), _fd{-1}, _head{nullptr},
+_read{0}, _mark{0}, _tail{nullptr}, _used{0}, _queued{0}, _unsignalled{0},
+_written{0}, _abandoned{false}, _marked{false}, _writer(), _mutex(), _wake(),
+_signalled{false}, _stopping{false} {
+}
+
+Journal::~Journal() {
+    close();
+}
+
+// #name# in the same directory as filename.
+string Journal::path(const string& filename) {
+    size_t slash = filename.rfind('/');
+    size_t name = (slash == string::npos) ? 0 : slash + 1;
+    return filename.substr(0, name) + "#" + filename.substr(name) + "#";
+}
+
+bool Journal::open(const string& filename, size_t keep) {
+    close();
+    _filename = filename;
+    _path = path(filename);
+    _fd = ::open(_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (_fd == -1) {
+        return false;
+    }
+    if (keep != 0 && ftruncate(_fd, keep) == -1) {
+        ::close(_fd);
+        _fd = -1;
+        return false;
+    }
+
+    _head = _tail = new Block(BLOCKSIZE);
+    _used = _queued = _unsignalled = _read = _mark = 0;
+    _written = 0;
+    _abandoned = _marked = false;
+    _signalled = _stopping = false;
+    if (keep == 0) {
+        mark();
+        checkpoint();
+    }
+    _writer = thread(&Journal::run, this, keep);
+    return true;
+}
+
+void Journal::mark() {
+    if (_fd == -1) {
+        return;
+    }
+
+    Record mark = { MARK, 0, 0, 0 };
+    memcpy(reserve(sizeof(Record)), &mark, sizeof(Record));
+    _abandoned = false;
+    _marked = true;
+    commit();
+}
+
+void Journal::checkpoint() {
+    if (_fd == -1 || !_marked) {
+        return;
+    }
+
+    Record checkpoint = { CHECKPOINT, 0, 0, 0 };
+    describe(_filename, checkpoint);
+    memcpy(reserve(sizeof(Record)), &checkpoint, sizeof(Record));
+    _marked = false;
+    commit();
+    signal();
+}
+
+void Journal::erased(size_t pos, size_t n) {
+    if (record(ERASE, pos, n, 0) != nullptr) {
+        commit();
+    }
+}
+
+// Queues the header of a record with bytes of data to follow and returns
+// where the data goes, or nullptr if nothing is being recorded.
+char* Journal::record(Type type, size_t pos, size_t length, size_t bytes) {
+    if (_fd == -1 || _abandoned) {
+        return nullptr;
+    }
+
+    Record header = { type, pos, length, bytes };
+    if (_queued - _written.load(memory_order_relaxed) + bytes > BACKLOG) {
+        header = { ABANDON, 0, 0, 0 };
+        _abandoned = true;
+        _marked = false;
+    }
+    char* p = reserve(sizeof(Record) + header._bytes);
+    memcpy(p, &header, sizeof(Record));
+    if (_abandoned) {
+        commit();
+        signal();
+        return nullptr;
+    }
+    return p + sizeof(Record);
+}
+
+// Room for bytes at the end of the queue.  A record is never split between
+// blocks so one that doesn't fit gets a new block (of its own if it is
+// bigger than usual.)  The writer is told about the new block only after
+// everything in the old one has been committed.
+char* Journal::reserve(size_t bytes) {
+    if (_tail->_size - _used < bytes) {
+        Block* block = new Block(max(BLOCKSIZE, bytes));
+        _tail->_next.store(block, memory_order_release);
+        _tail = block;
+        _used = 0;
+    }
+
+    char* p = _tail->_data.get() + _used;
+    _used += bytes;
+    _queued += bytes;
+    _unsignalled += bytes;
+    return p;
+}
+
+// Lets the writer have everything reserved so far.
+void Journal::commit() {
+    _tail->_ready.store(_used, memory_order_release);
+    if (_unsignalled >= BATCH) {
+        signal();
+    }
+}
+
+// Wakes the writer up early.  If it is just about to go to sleep it may
+// miss this but then it will only sleep for INTERVAL.
+void Journal::signal() {
+    _unsignalled = 0;
+    _signalled = true;
+    _wake.notify_one();
+}
+
+// The writer thread.  offset is where the journal file ends.
+void Journal::run(size_t offset) {
+    bool writing = true;
+    bool stopping = false;
+
+    while (!stopping) {
+        {
+            unique_lock<mutex> lock(_mutex);
+            _wake.wait_for(lock, INTERVAL, [this] {
+                return _signalled || _stopping;
+            });
+            _signalled = false;
+        }
+        // Anything queued before the journal was stopped is still written.
+        stopping = _stopping;
+        if (drain(offset, writing) && writing) {
+            fdatasync(_fd);
+        }
+    }
+}
+
+// Writes out everything that is ready and frees the blocks that are done
+// with.  A checkpoint replaces everything in the journal before the last
+// mark.  Returns true if anything was written.
+bool Journal::drain(size_t& offset, bool& writing) {
+    bool wrote = false;
+
+    while (true) {
+        size_t ready = _head->_ready.load(memory_order_acquire);
+        Block* next = _head->_next.load(memory_order_acquire);
+        if (next != nullptr) {
+            ready = _head->_ready.load(memory_order_acquire);
+        }
+
+        const char* first = _head->_data.get() + _read;
+        const char* last = _head->_data.get() + ready;
+        const char* from = first;
+        for (const char* p = first; p < last; ) {
+            Record record;
+            memcpy(&record, p, sizeof(Record));
+            if (record._type == MARK && !writing) {
+                // The changes before this weren't all written so the ones
+                // after it can't be made again without them.
+                record._pos = 1;
+                writing = write(reinterpret_cast<const char*>(&record),
+                    reinterpret_cast<const char*>(&record + 1), offset);
+                _mark = offset;
+                from = p + sizeof(Record);
+                wrote = true;
+            } else if (record._type == MARK) {
+                writing = write(from, p + sizeof(Record), offset);
+                _mark = offset;
+                from = p + sizeof(Record);
+                wrote = true;
+            } else if (record._type == CHECKPOINT ||
+            record._type == ABANDON) {
+                if (writing) {
+                    writing = write(from, p, offset);
+                }
+                if (record._type == CHECKPOINT && writing) {
+                    writing = rewrite(record, _mark, offset);
+                } else {
+                    writing = false;
+                }
+                from = p + sizeof(Record);
+                wrote = true;
+            }
+            p += sizeof(Record) + record._bytes;
+        }
+        if (writing && from != last) {
+            writing = write(from, last, offset);
+            wrote = true;
+        }
+        _written.fetch_add(ready - _read, memory_order_relaxed);
+        _read = ready;
+
+        if (next == nullptr) {
+            break;
+        }
+        delete _head;
+        _head = next;
+        _read = 0;
+    }
+
+    return wrote;
+}
+
+// Writes [first, last) to fd at offset, which it moves past what was written.
+static bool writeAt(int fd, const char* first, const char* last,
+size_t& offset) {
+    while (first < last) {
+        ssize_t n = pwrite(fd, first, last - first, offset);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        first += n;
+        offset += n;
+    }
+    return true;
+}
+
+// Returns false if [first, last) couldn't all be written, after which the
+// journal isn't added to until the next checkpoint.
+bool Journal::write(const char* first, const char* last, size_t& offset) {
+    return writeAt(_fd, first, last, offset);
+}
+
+// Makes the journal checkpoint followed by what was written after mark.  The
+// new journal is written beside the old one and renamed over it once it is
+// synced, so a crash at any point leaves one or the other whole.  It takes
+// the old one's place under the same descriptor, which the editor's thread
+// also looks at.
+bool Journal::rewrite(const Record& checkpoint, size_t mark, size_t& offset) {
+    vector<char> changes(sizeof(Record) + (offset - mark));
+    memcpy(changes.data(), &checkpoint, sizeof(Record));
+    for (size_t done = sizeof(Record); done < changes.size(); ) {
+        ssize_t n = pread(_fd, changes.data() + done, changes.size() - done,
+            mark + (done - sizeof(Record)));
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        done += n;
+    }
+
+    string temp = _path + ".XXXXXX";
+    int fd = mkstemp(&temp[0]);
+    if (fd == -1) {
+        return false;
+    }
+    size_t written = 0;
+    if (!writeAt(fd, changes.data(), changes.data() + changes.size(),
+    written) || fdatasync(fd) == -1 ||
+    rename(temp.c_str(), _path.c_str()) == -1) {
+        ::close(fd);
+        unlink(temp.c_str());
+        return false;
+    }
+    syncDirectory(_path);
+
+    bool swapped = dup2(fd, _fd) != -1;
+    ::close(fd);
+    if (!swapped) {
+        return false;
+    }
+    fcntl(_fd, F_SETFD, FD_CLOEXEC);
+    offset = written;
+    return true;
+}
+
+// Stops the writer once it has written everything and removes the journal.
+void Journal::close() {
+    if (_writer.joinable()) {
+        {
+            lock_guard<mutex> lock(_mutex);
+            _stopping = true;
+        }
+        _wake.notify_one();
+        _writer.join();
+    }
+
+    while (_head != nullptr) {
+        Block* next = _head->_next.load(memory_order_relaxed);
+        delete _head;
+        _head = next;
+    }
+    _tail = nullptr;
+
+    if (_fd != -1) {
+        ::close(_fd);
+        _fd = -1;
+        unlink(_path.c_str());
+    }
+}
+
+bool Journal::read(FILE* file, Record& record) {
+    return fread(&record, sizeof(Record), 1, file) == 1;
+}
+
+// Whether filename is still as it was at the checkpoint.
+bool Journal::matches(const string& filename, const Record& record) {
+    Record now = { CHECKPOINT, 0, 0, 0 };
+    describe(filename, now);
+    return now._pos == record._pos && now._length == record._length;
+}
+
+// Puts the size and modification time of filename in a checkpoint record,
+// or leaves them 0 if it doesn't exist.
+void Journal::describe(const string& filename, Record& record) {
+    struct stat st;
+    if (::stat(filename.c_str(), &st) == 0) {
+        record._pos = st.st_size;
+        record._length = uint64_t(st.st_mtim.tv_sec) * 1000000000 +
+            st.st_mtim.tv_nsec;
+    }
+}
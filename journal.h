@@ -0,0 +1,212 @@
+// Journal -- crash recovery for a text editor (Interface)
+//
+// By Jaldhar H. Vyas <jaldhar@braincells.com>
+// Copyright (C) 2017, Consolidated Braincells Inc. All rights reserved.
+// "Do what thou wilt" shall be the whole of the license.
+//
+// Every change made to a buffer is appended to a journal file (#name# next to
+// the file) so if the editor dies, the changes made since the file was last
+// saved can be made again.  The journal starts with a checkpoint saying what
+// the file was like (its size and when it was modified) when it was loaded or
+// saved, followed by an insertion or a deletion record for each change.
+//
+// The editor doesn't wait for the journal.  A change is only copied into a
+// queue of blocks in memory, which a thread of the journal's own writes out
+// (and syncs) every INTERVAL or sooner once BATCH bytes are waiting.  The
+// editor is the only one to add to the queue and the writer the only one to
+// take from it, so they need nothing more than an atomic count of how much of
+// a block is ready and an atomic pointer to the next block; neither ever
+// waits for the other.  If the writer falls more than BACKLOG behind (or
+// can't write) nothing more is recorded until the next mark, so the
+// journal still holds the changes up to then and recovering from it gets the
+// buffer back as it was at that point.
+//
+// A file can be saved while the buffer goes on being changed, so saving is in
+// two steps: mark() when the text to be saved is taken and checkpoint() once
+// it is safely in the file.  The changes made in between are kept; the
+// checkpoint goes in front of them and everything before the mark goes.  That
+// makes a new journal, which is renamed over the old one only once it is
+// synced, so a crash meanwhile still leaves a whole journal behind.
+//
+// When the editor ends normally the journal is removed.
+
+#ifndef _JOURNAL_H_
+#define _JOURNAL_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class Journal {
+public:
+    static const std::size_t BLOCKSIZE = std::size_t(64) << 10;
+    static const std::size_t BATCH = std::size_t(256) << 10;
+    static const std::size_t BACKLOG = std::size_t(64) << 20;
+    static constexpr std::chrono::milliseconds INTERVAL{100};
+
+    Journal();
+    Journal(const Journal&) = delete;
+    Journal& operator=(const Journal&) = delete;
+    ~Journal();
+
+    // The journal for filename.
+    static std::string path(const std::string& filename);
+
+    // Starts journaling changes to filename.  If keep is 0 the journal
+    // starts again with a checkpoint of the file as it is now; otherwise the
+    // first keep bytes of the journal that is there (as returned by
+    // recover()) are kept and added to.  Returns false if the journal can't
+    // be written.
+    bool open(const std::string& filename, std::size_t keep = 0);
+
+    // The text as it is now is going to be saved.  If nothing was being
+    // recorded, recording starts again from here.
+    void mark();
+
+    // The text as it was at the last mark() has been saved so the changes
+    // up to then are no longer needed.  Does nothing if the changes since
+    // the mark couldn't all be recorded.
+    void checkpoint();
+
+    // n elements were inserted at pos in buffer.
+    template<typename B>
+    void inserted(const B& buffer, std::size_t pos, std::size_t n) {
+        using T = typename B::value_type;
+        char* p = record(INSERT, pos, n, n * sizeof(T));
+        if (p != nullptr) {
+            buffer.for_each_segment(pos, pos + n,
+                [&p](const T* data, std::size_t length) {
+                    std::memcpy(p, data, length * sizeof(T));
+                    p += length * sizeof(T);
+                    return true;
+                });
+            commit();
+        }
+    }
+
+    // n elements were deleted at pos.
+    void erased(std::size_t pos, std::size_t n);
+
+    // Makes the changes in the journal for filename again in buffer, which
+    // must have just been loaded from filename.  Returns how many bytes of
+    // the journal were good (to pass to open()) or 0 if there is no journal
+    // or it is not for the file as it is now.
+    template<typename B>
+    static std::size_t recover(B& buffer, const std::string& filename) {
+        using T = typename B::value_type;
+        std::unique_ptr<std::FILE, int (*)(std::FILE*)> file(
+            std::fopen(path(filename).c_str(), "rb"), std::fclose);
+        if (!file) {
+            return 0;
+        }
+
+        Record checkpoint;
+        if (!read(file.get(), checkpoint) || checkpoint._type != CHECKPOINT ||
+        !matches(filename, checkpoint)) {
+            return 0;
+        }
+        std::size_t good = sizeof(Record);
+
+        // A record cut short by the crash, or one that doesn't fit the
+        // buffer, ends the journal.
+        Record record;
+        std::vector<T> text;
+        while (read(file.get(), record)) {
+            if (record._type == INSERT &&
+            record._bytes == record._length * sizeof(T) &&
+            record._pos <= buffer.size()) {
+                text.resize(record._length);
+                if (std::fread(text.data(), sizeof(T), text.size(),
+                file.get()) != text.size()) {
+                    break;
+                }
+                buffer.pointSet(record._pos);
+                buffer.insert(text.begin(), text.end());
+            } else if (record._type == ERASE && record._bytes == 0 &&
+            record._pos <= buffer.size() &&
+            record._length <= buffer.size() - record._pos) {
+                buffer.erase(record._pos, record._pos + record._length);
+            } else if (record._type == MARK && record._bytes == 0 &&
+            record._pos == 0) {
+                // Only changes after a mark that started recording again
+                // don't follow on from the ones before.
+            } else {
+                break;
+            }
+            good += sizeof(Record) + record._bytes;
+        }
+
+        return good;
+    }
+
+private:
+    enum Type : std::uint64_t {
+        CHECKPOINT = 'C', INSERT = 'I', ERASE = 'E', MARK = 'M',
+        ABANDON = 'X'
+    };
+
+    // A checkpoint has the size of the file in _pos and the time it was
+    // modified (in nanoseconds) in _length.  A mark has 1 in _pos if
+    // recording started again there.
+    struct Record {
+        std::uint64_t _type;
+        std::uint64_t _pos;
+        std::uint64_t _length;  // In elements.
+        std::uint64_t _bytes;   // How much data follows.
+    };
+
+    struct Block {
+        std::unique_ptr<char[]> _data;
+        std::size_t             _size;
+        std::atomic<std::size_t> _ready;  // How much the writer can have.
+        std::atomic<Block*>     _next;    // Set once nothing more is added.
+
+        explicit Block(std::size_t size);
+    };
+
+    std::string             _filename;
+    std::string             _path;
+    int                     _fd;
+    Block*                  _head;      // The writer's block.
+    std::size_t             _read;      // How much of _head is written.
+    std::size_t             _mark;      // Where the changes after it begin.
+    Block*                  _tail;      // The editor's block.
+    std::size_t             _used;      // How much of _tail is filled.
+    std::size_t             _queued;    // Bytes queued so far.
+    std::size_t             _unsignalled; // Bytes queued since last signal.
+    std::atomic<std::size_t> _written;  // Bytes the writer has taken.
+    bool                    _abandoned; // Nothing is recorded till a mark.
+    bool                    _marked;    // Everything since mark() is recorded.
+    std::thread             _writer;
+    std::mutex              _mutex;     // Only for sleeping on _wake.
+    std::condition_variable _wake;
+    std::atomic<bool>       _signalled;
+    std::atomic<bool>       _stopping;
+
+    char* record(Type type, std::size_t pos, std::size_t length,
+        std::size_t bytes);
+    char* reserve(std::size_t bytes);
+    void commit();
+    void signal();
+    void run(std::size_t offset);
+    bool drain(std::size_t& offset, bool& writing);
+    bool write(const char* first, const char* last, std::size_t& offset);
+    bool rewrite(const Record& checkpoint, std::size_t mark,
+        std::size_t& offset);
+    void close();
+
+    static bool read(std::FILE* file, Record& record);
+    static bool matches(const std::string& filename, const Record& record);
+    static void describe(const std::string& filename, Record& record);
+};
+
+#endif
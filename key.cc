@@ -4,11 +4,16 @@
 // Copyright (C) 2017, Consolidated Braincells Inc. All rights reserved.
 // "Do what thou wilt" shall be the whole of the license.
 
+#include <cstdio>
+#include <string>
 using namespace std;
 
 #include <curses.h>
 #include "key.h"
 
+const int Key::PASTE = KEY_MAX + 1;
+static const int PASTEEND = KEY_MAX + 2;
+
 bool Key::init() {
     raw();
     noecho();
@@ -18,10 +23,20 @@ bool Key::init() {
     intrflush(stdscr, FALSE);
     nodelay(stdscr, FALSE);
 
+    // Ask the terminal to bracket pastes so they can be told apart from
+    // typing.  Terminals that don't know how just ignore this.
+    define_key("\x1b[200~", PASTE);
+    define_key("\x1b[201~", PASTEEND);
+    putp("\x1b[?2004h");
+    fflush(stdout);
+
     return true;
 }
 
 bool Key::fini() {
+    putp("\x1b[?2004l");
+    fflush(stdout);
+
     return true;
 }
 
@@ -31,4 +46,42 @@ void Key::beep() {
 
 int Key::get() {
     return getch();
-}
\ No newline at end of file
+}
+
+// Returns the next key if one has already been typed or ERR if not.  Never
+// waits.
+int Key::poll() {
+    nodelay(stdscr, TRUE);
+    int c = getch();
+    nodelay(stdscr, FALSE);
+
+    return c;
+}
+
+int Key::wait(int milliseconds) {
+    timeout(milliseconds);
+    int c = getch();
+    timeout(-1);
+
+    return c;
+}
+
+// Puts c back so it is the next key returned.
+void Key::unget(int c) {
+    ungetch(c);
+}
+
+// Reads the text of a bracketed paste, after PASTE, up to the end of the
+// paste.  Anything curses took for a function key is left out.
+string Key::paste() {
+    string text;
+    int c;
+
+    while ((c = getch()) != PASTEEND && c != ERR) {
+        if (c < 0x100) {
+            text += static_cast<char>(c);
+        }
+    }
+
+    return text;
+}
@@ -6,12 +6,24 @@
 #ifndef _KEY_H_
 #define _KEY_H_
 
-class Key {
+#include <string>
+#include "keysource.h"
+
+// Keys from the terminal.
+class Key : public KeySource {
 public:
+    // get() returns this when the terminal starts a bracketed paste.  The
+    // pasted text is then read with paste().
+    static const int PASTE;
+
     bool init();
     bool fini();
-    void beep();
-    int  get();
+    void beep() override;
+    int  get() override;
+    int  poll() override;
+    int  wait(int milliseconds) override;
+    void unget(int c) override;
+    std::string paste() override;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,54 @@
+// Keymap -- binds keys to commands in a text editor (Implementation)
+//
+// By Jaldhar H. Vyas <jaldhar@braincells.com>
+// Copyright (C) 2017, Consolidated Braincells Inc. All rights reserved.
+// "Do what thou wilt" shall be the whole of the license.
+
+#include <vector>
+using namespace std;
+
+#include <curses.h>
+#include "keymap.h"
+
+Keymap::Keymap() :
+_bindings(KEY_MAX + 1, Binding{nullptr, nullptr, nullptr}) {
+}
+
+void Keymap::bind(int key, COMMAND function, const char* name) {
+    if (inRange(key)) {
+        _bindings[key] = { function, name, nullptr };
+    }
+}
+
+void Keymap::bind(int key, const Keymap* keymap) {
+    if (inRange(key)) {
+        _bindings[key] = { nullptr, nullptr, keymap };
+    }
+}
+
+bool Keymap::bound(int key) const {
+    return inRange(key) &&
+        (_bindings[key]._command != nullptr ||
+        _bindings[key]._prefix != nullptr);
+}
+
+// The command key is bound to or nullptr if it is not bound to one.
+COMMAND Keymap::command(int key) const {
+    return inRange(key) ? _bindings[key]._command : nullptr;
+}
+
+// The name of the command key is bound to or nullptr if it is not bound to
+// one.
+const char* Keymap::name(int key) const {
+    return inRange(key) ? _bindings[key]._name : nullptr;
+}
+
+// The keymap the next key should be looked up in if key is a prefix key,
+// otherwise nullptr.
+const Keymap* Keymap::prefix(int key) const {
+    return inRange(key) ? _bindings[key]._prefix : nullptr;
+}
+
+bool Keymap::inRange(int key) const {
+    return key >= 0 && static_cast<size_t>(key) < _bindings.size();
+}
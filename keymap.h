@@ -0,0 +1,42 @@
+// Keymap -- binds keys to commands in a text editor (Interface)
+//
+// By Jaldhar H. Vyas <jaldhar@braincells.com>
+// Copyright (C) 2017, Consolidated Braincells Inc. All rights reserved.
+// "Do what thou wilt" shall be the whole of the license.
+
+#ifndef _KEYMAP_H_
+#define _KEYMAP_H_
+
+#include <vector>
+
+class Subeditor;
+using COMMAND = bool (Subeditor::*)(bool& isArg, int& arg, bool& isExit,
+    int c);
+
+// A table indexed directly by key code, from 0 up to the last curses
+// function key, so looking a key up is one array access.  A key can be bound
+// to a command (along with its name, for reports) or to another keymap in
+// which the key after it is looked up (a prefix key like CTRL-x.)
+class Keymap {
+public:
+    Keymap();
+    void bind(int key, COMMAND function, const char* name);
+    void bind(int key, const Keymap* keymap);
+    bool bound(int key) const;
+    COMMAND command(int key) const;
+    const char* name(int key) const;
+    const Keymap* prefix(int key) const;
+
+private:
+    struct Binding {
+        COMMAND        _command;
+        const char*    _name;
+        const Keymap*  _prefix;
+    };
+
+    std::vector<Binding>    _bindings;
+
+    bool inRange(int key) const;
+};
+
+#endif
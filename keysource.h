@@ -0,0 +1,40 @@
+// KeySource -- where a text editor gets its keys from
+//
+// By Jaldhar H. Vyas <jaldhar@braincells.com>
+// Copyright (C) 2017, Consolidated Braincells Inc. All rights reserved.
+// "Do what thou wilt" shall be the whole of the license.
+//
+// Evaluate reads keys through this so they can come from the terminal (Key),
+// a recorded script (Script) or either of those while being recorded
+// (Recorder.)
+
+#ifndef _KEYSOURCE_H_
+#define _KEYSOURCE_H_
+
+#include <string>
+
+class KeySource {
+public:
+    virtual ~KeySource() {
+    }
+
+    virtual void beep() = 0;
+
+    // The next key, waiting for it if need be.  ERR if there will never be
+    // another one.
+    virtual int get() = 0;
+
+    // The next key if it is already there or ERR if not.  Never waits.
+    virtual int poll() = 0;
+
+    // The next key, or ERR if none comes within milliseconds.
+    virtual int wait(int milliseconds) = 0;
+
+    // Puts c back so it is the next key returned.
+    virtual void unget(int c) = 0;
+
+    // The text of a paste after get() has returned Key::PASTE.
+    virtual std::string paste() = 0;
+};
+
+#endif
@@ -0,0 +1,64 @@
+// KillRing -- text killed from a buffer in a text editor
+//
+// By Jaldhar H. Vyas <jaldhar@braincells.com>
+// Copyright (C) 2017, Consolidated Braincells Inc. All rights reserved.
+// "Do what thou wilt" shall be the whole of the license.
+//
+// The most recent kills, newest first.  Each one is a TextChunk so the ring
+// only holds a reference; the text itself was copied once when it was killed
+// and the undo log shares the same copy.
+
+#ifndef _KILLRING_H_
+#define _KILLRING_H_
+
+#include <cstddef>
+#include <deque>
+#include <utility>
+#include "undo.h"
+
+template<typename T>
+class KillRing {
+public:
+    using chunk_type = TextChunk<T>;
+
+    static const std::size_t DEFAULTSIZE = 60;
+
+    KillRing() : _kills(), _yank{0}, _max{DEFAULTSIZE} {
+    }
+
+    bool empty() const {
+        return _kills.empty();
+    }
+
+    // Adds text as the newest kill and makes it the one to yank.  The oldest
+    // kill is forgotten if the ring is full.
+    void push(chunk_type text) {
+        _kills.push_front(std::move(text));
+        if (_kills.size() > _max) {
+            _kills.pop_back();
+        }
+        _yank = 0;
+    }
+
+    // The kill to yank, or nullptr if there are none.
+    chunk_type yank() const {
+        return _kills.empty() ? nullptr : _kills[_yank];
+    }
+
+    // Moves on to the next older kill (and round to the newest after the
+    // oldest) and returns it.
+    chunk_type rotate() {
+        if (_kills.empty()) {
+            return nullptr;
+        }
+        _yank = (_yank + 1) % _kills.size();
+        return _kills[_yank];
+    }
+
+private:
+    std::deque<chunk_type> _kills;
+    std::size_t            _yank;
+    std::size_t            _max;
+};
+
+#endif
@@ -0,0 +1,91 @@
+// LineIndex -- counts newlines in a text editor buffer
+//
+// By Jaldhar H. Vyas <jaldhar@braincells.com>
+// Copyright (C) 2017, Consolidated Braincells Inc. All rights reserved.
+// "Do what thou wilt" shall be the whole of the license.
+//
+// The storage of a buffer is divided into fixed-size chunks and the number of
+// newlines in each chunk is kept in a Fenwick tree.  The owner reports every
+// newline that enters or leaves its storage; in return, how many newlines
+// come before a chunk and which chunk holds the k'th newline are both
+// answered in O(log chunks).  The owner finishes the job by scanning at most
+// one chunk.
+
+#ifndef _LINEINDEX_H_
+#define _LINEINDEX_H_
+
+#include <cstddef>
+#include <vector>
+
+class LineIndex {
+public:
+    static const std::size_t CHUNKBITS = 12;
+    static const std::size_t CHUNKSIZE = std::size_t(1) << CHUNKBITS;
+
+    LineIndex() : _tree(1, 0), _total{0} {
+    }
+
+    // Forgets all the newlines and makes room for storage of the given size.
+    void reset(std::size_t capacity) {
+        _tree.assign(chunks(capacity) + 1, 0);
+        _total = 0;
+    }
+
+    // count newlines have been added to (or if negative, removed from) the
+    // chunk holding offset.
+    void add(std::size_t offset, std::ptrdiff_t count) {
+        for (std::size_t i = (offset >> CHUNKBITS) + 1; i < _tree.size();
+        i += i & -i) {
+            _tree[i] += count;
+        }
+        _total += count;
+    }
+
+    // The number of newlines in the chunks before chunk.
+    std::size_t before(std::size_t chunk) const {
+        std::size_t count = 0;
+        for (std::size_t i = chunk; i > 0; i -= i & -i) {
+            count += _tree[i];
+        }
+        return count;
+    }
+
+    // The number of newlines in chunk.
+    std::size_t count(std::size_t chunk) const {
+        return before(chunk + 1) - before(chunk);
+    }
+
+    // The chunk holding the k'th newline (counting from 1).  before is set to
+    // the number of newlines in the chunks before it.
+    std::size_t find(std::size_t k, std::size_t& before) const {
+        std::size_t chunk = 0;
+        std::size_t step = 1;
+        while (step * 2 < _tree.size()) {
+            step *= 2;
+        }
+
+        before = 0;
+        for (; step > 0; step /= 2) {
+            if (chunk + step < _tree.size() &&
+            before + _tree[chunk + step] < k) {
+                chunk += step;
+                before += _tree[chunk];
+            }
+        }
+        return chunk;
+    }
+
+    std::size_t total() const {
+        return _total;
+    }
+
+    static std::size_t chunks(std::size_t capacity) {
+        return (capacity + CHUNKSIZE - 1) >> CHUNKBITS;
+    }
+
+private:
+    std::vector<std::size_t> _tree;
+    std::size_t              _total;
+};
+
+#endif
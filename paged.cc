@@ -0,0 +1,114 @@
+// PagedText -- paged storage for Buffer (Implementation)
+//
+// By Jaldhar H. Vyas <jaldhar@braincells.com>
+// Copyright (C) 2017, Consolidated Braincells Inc. All rights reserved.
+// "Do what thou wilt" shall be the whole of the license.
+
+#include <cerrno>
+#include <cstdlib>
+#include <string>
+#include <system_error>
+using namespace std;
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "paged.h"
+
+PageStore::PageStore() : _fd{-1}, _swap{-1}, _size{0}, _swapEnd{0} {
+}
+
+PageStore::~PageStore() {
+    if (_fd != -1) {
+        ::close(_fd);
+    }
+    if (_swap != -1) {
+        ::close(_swap);
+    }
+}
+
+bool PageStore::open(const string& filename) {
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        ::close(fd);
+        return false;
+    }
+
+    // The whole file is read once, from beginning to end, to count its
+    // newlines and after that pages are read wherever the user goes.
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    _fd = fd;
+    _size = st.st_size;
+    return true;
+}
+
+size_t PageStore::size() const {
+    return _size;
+}
+
+void PageStore::read(size_t offset, void* data, size_t bytes) const {
+    readAll(_fd, offset, data, bytes);
+}
+
+// Appends bytes of data to the swap file and returns where they went.  The
+// swap file is made the first time it is needed and unlinked straight away so
+// it goes when the store does.  Space in it is never reused.
+size_t PageStore::swapOut(const void* data, size_t bytes) {
+    if (_swap == -1) {
+        const char* dir = getenv("TMPDIR");
+        string name = string((dir != nullptr) ? dir : "/tmp") +
+            "/editor-swap.XXXXXX";
+        _swap = mkstemp(&name[0]);
+        if (_swap == -1) {
+            throw system_error(errno, generic_category(), "swap file");
+        }
+        unlink(name.c_str());
+    }
+
+    size_t offset = _swapEnd;
+    const char* p = static_cast<const char*>(data);
+    size_t done = 0;
+    while (done < bytes) {
+        ssize_t written = pwrite(_swap, p + done, bytes - done,
+            offset + done);
+        if (written == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw system_error(errno, generic_category(), "swap file");
+        }
+        done += written;
+    }
+
+    _swapEnd += bytes;
+    return offset;
+}
+
+void PageStore::swapIn(size_t offset, void* data, size_t bytes) const {
+    readAll(_swap, offset, data, bytes);
+}
+
+// There is no way to carry on editing if a page can't be read back so an
+// error is thrown rather than returned.
+void PageStore::readAll(int fd, size_t offset, void* data, size_t bytes) {
+    char* p = static_cast<char*>(data);
+    size_t done = 0;
+    while (done < bytes) {
+        ssize_t n = pread(fd, p + done, bytes - done, offset + done);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw system_error(errno, generic_category(), "reading page");
+        }
+        if (n == 0) {
+            throw system_error(EIO, generic_category(), "file shrank");
+        }
+        done += n;
+    }
+}
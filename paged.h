@@ -0,0 +1,1291 @@
+// PagedText -- paged storage for Buffer
+//
+// By Jaldhar H. Vyas <jaldhar@braincells.com>
+// Copyright (C) 2017, Consolidated Braincells Inc. All rights reserved.
+// "Do what thou wilt" shall be the whole of the license.
+//
+// Using PagedText<T> as the Container parameter of Buffer keeps the text in
+// fixed-size pages, only some of which are in memory at any time, so a file
+// much bigger than memory can be edited:
+//
+//     Buffer<char, 80, PagedText<char>> buffer;
+//     buffer.open("huge.log");
+//
+// Pages are allocated with Allocator, like the storage of a gap buffer is by
+// its Container.
+//
+// Opening a file reads it once from beginning to end, to count the newlines
+// in each page, but keeps none of it.  After that a page is read with pread()
+// the first time something looks at it.  Pages stay in memory, most recently
+// used first, until together they are over the memory limit and then the
+// least recently used ones are dropped.  A page that has not been changed is
+// simply read from the file again when it is next wanted; a changed one is
+// written to a swap file before it is dropped.
+//
+// An edit changes one page in place.  A page that grows to twice PAGESIZE is
+// split up and one that shrinks to nothing is removed.  The length and
+// newlines of every page are kept in Fenwick trees so finding the page that
+// holds a position or a line is O(log pages).  The trees are rebuilt in one
+// pass the next time they are needed after pages come or go.
+
+#ifndef _PAGED_H_
+#define _PAGED_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <list>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "buffer.h"
+#include "scan.h"
+
+// The file a PagedText was opened from and its swap file.  The swap file is
+// made the first time a page is written to it and unlinked straight away so
+// it goes away with the store.  It is only ever appended to, so pages already
+// in it can be read by other threads (for snapshots) while more are written.
+// Errors reading or writing pages throw std::system_error.
+class PageStore {
+public:
+    PageStore();
+    PageStore(const PageStore&) = delete;
+    PageStore& operator=(const PageStore&) = delete;
+    ~PageStore();
+
+    // Returns false and sets errno if filename can't be opened.
+    bool open(const std::string& filename);
+
+    // The size of the file in bytes.
+    std::size_t size() const;
+
+    void read(std::size_t offset, void* data, std::size_t bytes) const;
+    std::size_t swapOut(const void* data, std::size_t bytes);
+    void swapIn(std::size_t offset, void* data, std::size_t bytes) const;
+
+private:
+    int         _fd;
+    int         _swap;
+    std::size_t _size;
+    std::size_t _swapEnd;
+
+    static void readAll(int fd, std::size_t offset, void* data,
+        std::size_t bytes);
+};
+
+template<typename T, typename Allocator> class PagedTextIterator;
+
+template<typename T, typename Allocator = std::allocator<T>>
+class PagedText {
+public:
+    using self_type = PagedText<T, Allocator>;
+    using value_type = T;
+    using size_type = std::size_t;
+    using difference_type = std::ptrdiff_t;
+    using const_pointer = const T*;
+    using page_type = std::shared_ptr<const std::vector<T, Allocator>>;
+
+    static const size_type PAGESIZE = (size_type(64) << 10) / sizeof(T);
+    static const size_type DEFAULTLIMIT = size_type(256) << 20;
+
+    // The text as it was when snapshot() was called.  It holds on to the
+    // pages that were in memory then (a page is copied before it is changed
+    // if a snapshot has it) and reads the others from the file or the swap
+    // file as they are wanted, without keeping them, so another thread can
+    // read it while the text goes on being changed.  Reading a page that
+    // can't be read throws std::system_error.
+    class Snapshot {
+    public:
+        using value_type = T;
+        using size_type = std::size_t;
+
+        static const size_type npos = -1;
+
+        Snapshot() : _store{}, _pages{}, _ends{}, _size{0} {
+        }
+
+        size_type size() const {
+            return _size;
+        }
+
+        bool empty() const {
+            return _size == 0;
+        }
+
+        // As Buffer::for_each_segment().
+        template<typename F>
+        bool for_each_segment(size_type from, size_type to, F fn,
+        size_type chunk = npos) const {
+            to = std::min(to, _size);
+            std::vector<T, Allocator> buffer;
+            for (size_type i = std::upper_bound(_ends.begin(), _ends.end(),
+            from) - _ends.begin(); i < _pages.size() && from < to; i++) {
+                const Part& part = _pages[i];
+                const_pointer data;
+                if (part.data) {
+                    data = part.data->data();
+                } else {
+                    buffer.resize(part.length);
+                    if (part.swapped) {
+                        _store->swapIn(part.offset, buffer.data(),
+                            part.length * sizeof(T));
+                    } else {
+                        _store->read(part.offset, buffer.data(),
+                            part.length * sizeof(T));
+                    }
+                    data = buffer.data();
+                }
+
+                size_type start = _ends[i] - part.length;
+                size_type last = std::min(_ends[i], to);
+                if (!forEachChunk(data + (from - start), last - from, chunk,
+                fn)) {
+                    return false;
+                }
+                from = last;
+            }
+            return true;
+        }
+
+    private:
+        friend class PagedText;
+
+        struct Part {
+            size_type length;
+            bool      swapped; // In the swap file, not the original.
+            size_type offset;
+            page_type data;    // nullptr if it wasn't in memory.
+        };
+
+        std::shared_ptr<const PageStore> _store;
+        std::vector<Part>                _pages;
+        std::vector<size_type>           _ends;  // Where each page ends.
+        size_type                        _size;
+    };
+
+    PagedText() : _store{}, _pages{}, _lru{}, _lengths{}, _lines{},
+    _size{0}, _newlines{0}, _resident{0}, _limit{DEFAULTLIMIT},
+    _stale{true} {
+    }
+
+    // Makes the contents of filename the text.  Returns false and sets errno
+    // (leaving the text empty) if it can't be read.
+    bool open(const std::string& filename) {
+        clear();
+        std::unique_ptr<PageStore> store(new PageStore());
+        if (!store->open(filename)) {
+            return false;
+        }
+
+        try {
+            std::vector<T> buffer(PAGESIZE);
+            size_type length = store->size() / sizeof(T);
+            for (size_type offset = 0; offset < length; offset += PAGESIZE) {
+                size_type n = std::min(PAGESIZE, length - offset);
+                store->read(offset * sizeof(T), buffer.data(),
+                    n * sizeof(T));
+                Page* page = new Page{ n,
+                    countNewlines(buffer.data(), buffer.data() + n),
+                    Source::ORIGINAL, offset * sizeof(T), nullptr, false,
+                    _lru.end(), {} };
+                _pages.emplace_back(page);
+                _size += n;
+                _newlines += page->lines;
+            }
+        } catch (const std::system_error& e) {
+            clear();
+            errno = e.code().value();
+            return false;
+        }
+
+        _store = std::move(store);
+        return true;
+    }
+
+    // Copies [first, last) into pages of its own.  Pages beyond the memory
+    // limit go to the swap file as they are filled.
+    template<typename ForwardIt>
+    void assign(ForwardIt first, ForwardIt last) {
+        clear();
+        while (first != last) {
+            ForwardIt next = first;
+            size_type n = 0;
+            while (next != last && n < PAGESIZE) {
+                ++next;
+                n++;
+            }
+            auto data = std::make_shared<std::vector<T, Allocator>>(first,
+                next);
+            Page* page = append(data);
+            _size += page->length;
+            _newlines += page->lines;
+            evict(page);
+            first = next;
+        }
+    }
+
+    void clear() {
+        _store.reset();
+        _pages.clear();
+        _lru.clear();
+        _size = _newlines = _resident = 0;
+        _stale = true;
+    }
+
+    // How many bytes of pages to keep in memory.
+    void limit(size_type bytes) {
+        _limit = bytes;
+        evict(nullptr);
+    }
+
+    size_type limit() const {
+        return _limit;
+    }
+
+    size_type size() const {
+        return _size;
+    }
+
+    size_type max_size() const {
+        return static_cast<size_type>(-1) / sizeof(T);
+    }
+
+    size_type pages() const {
+        return _pages.size();
+    }
+
+    // How many bytes of pages are in memory.
+    size_type resident() const {
+        return _resident;
+    }
+
+    size_type newlines() const {
+        return _newlines;
+    }
+
+    // The number of newlines before pos.
+    size_type newlinesBefore(size_type pos) const {
+        if (pos >= _size) {
+            return _newlines;
+        }
+
+        size_type start;
+        size_type i = locate(pos, start);
+        page_type data = load(i);
+        const std::vector<std::uint32_t>& offsets = newlineOffsets(i);
+        return prefix(_lines, i) + (std::lower_bound(offsets.begin(),
+            offsets.end(), pos - start) - offsets.begin());
+    }
+
+    // The position of the k'th newline (counting from 1.)  k must be between
+    // 1 and newlines().
+    size_type newline(size_type k) const {
+        rebuild();
+        size_type before;
+        size_type i = descend(_lines, k, before);
+        page_type data = load(i);
+        return prefix(_lengths, i) + newlineOffsets(i)[k - before - 1];
+    }
+
+    // Inserts the range [first, last) before pos.
+    template<typename ForwardIt>
+    void insert(size_type pos, ForwardIt first, ForwardIt last) {
+        if (first == last) {
+            return;
+        }
+
+        size_type start;
+        size_type i = place(pos, start);
+        auto& data = writable(i);
+        size_type offset = pos - start;
+        size_type n = data.size();
+        data.insert(data.begin() + offset, first, last);
+        n = data.size() - n;
+        inserted(i, offset, n);
+    }
+
+    // Inserts n copies of c before pos.
+    void insert(size_type pos, size_type n, value_type c) {
+        if (n == 0) {
+            return;
+        }
+
+        size_type start;
+        size_type i = place(pos, start);
+        auto& data = writable(i);
+        size_type offset = pos - start;
+        data.insert(data.begin() + offset, n, c);
+        inserted(i, offset, n);
+    }
+
+    // Removes n elements starting at pos.  Pages that are removed entirely
+    // are dropped without being read.
+    void erase(size_type pos, size_type n) {
+        while (n > 0 && pos < _size) {
+            size_type start;
+            size_type i = locate(pos, start);
+            size_type offset = pos - start;
+
+            if (offset == 0 && n >= _pages[i]->length) {
+                size_type j = i;
+                size_type removed = 0;
+                while (j < _pages.size() &&
+                removed + _pages[j]->length <= n) {
+                    removed += _pages[j]->length;
+                    j++;
+                }
+                removePages(i, j);
+                n -= removed;
+            } else {
+                auto& data = writable(i);
+                size_type k = std::min(n, data.size() - offset);
+                size_type lines = countNewlines(data.data() + offset,
+                    data.data() + offset + k);
+                data.erase(data.begin() + offset, data.begin() + offset + k);
+                changed(i, -static_cast<difference_type>(k),
+                    -static_cast<difference_type>(lines));
+                n -= k;
+            }
+        }
+    }
+
+    value_type at(size_type pos) const {
+        size_type start;
+        page_type data = page(pos, start);
+        return (*data)[pos - start];
+    }
+
+    // The page holding pos, read in if need be, and the position of its first
+    // element.  It stays valid for as long as it is held even if the page is
+    // dropped or changed.
+    page_type page(size_type pos, size_type& start) const {
+        return load(locate(pos, start));
+    }
+
+    // The text as it is now.  It costs O(pages) however much of the text is
+    // in memory.
+    Snapshot snapshot() const {
+        Snapshot snapshot;
+        snapshot._store = _store;
+        snapshot._pages.reserve(_pages.size());
+        snapshot._ends.reserve(_pages.size());
+        for (auto& page: _pages) {
+            snapshot._pages.push_back({ page->length,
+                page->source == Source::SWAP, page->offset, page->data });
+            snapshot._size += page->length;
+            snapshot._ends.push_back(snapshot._size);
+        }
+        return snapshot;
+    }
+
+    // Calls fn(pointer, length, position) for each page, or part of one, in
+    // [from, to), in order, until it returns false.  Returns false if fn did.
+    // The pointer is only valid until fn returns.
+    template<typename F>
+    bool forEach(size_type from, size_type to, F fn) const {
+        to = std::min(to, _size);
+        if (from >= to) {
+            return true;
+        }
+
+        size_type start;
+        for (size_type i = locate(from, start); start < to; i++) {
+            page_type data = load(i);
+            size_type first = std::max(start, from);
+            size_type last = std::min(start + data->size(), to);
+            if (!fn(data->data() + (first - start), last - first, first)) {
+                return false;
+            }
+            start += data->size();
+        }
+        return true;
+    }
+
+    // As forEach() but visits the pages from last to first.
+    template<typename F>
+    bool forEachReverse(size_type from, size_type to, F fn) const {
+        to = std::min(to, _size);
+        if (from >= to) {
+            return true;
+        }
+
+        size_type start;
+        size_type i = locate(to - 1, start);
+        for (;;) {
+            page_type data = load(i);
+            size_type first = std::max(start, from);
+            size_type last = std::min(start + data->size(), to);
+            if (!fn(data->data() + (first - start), last - first, first)) {
+                return false;
+            }
+            if (start <= from || i == 0) {
+                return true;
+            }
+            i--;
+            start -= _pages[i]->length;
+        }
+    }
+
+private:
+    enum class Source { NONE, ORIGINAL, SWAP };
+
+    struct Page;
+    using page_data = std::shared_ptr<std::vector<T, Allocator>>;
+    using lru_list = std::list<Page*>;
+
+    struct Page {
+        size_type                   length;
+        size_type                   lines;    // Newlines in this page.
+        Source                      source;   // Where to read it back from
+        size_type                   offset;   // and where in there it is.
+        page_data                   data;     // nullptr if not in memory.
+        bool                        dirty;    // Changed since it was read.
+        typename lru_list::iterator used;     // Its place in _lru.
+        std::vector<std::uint32_t>  newlines; // Where they are, once asked.
+    };
+
+    mutable std::shared_ptr<PageStore> _store;
+    std::vector<std::unique_ptr<Page>> _pages;
+    mutable lru_list                   _lru;      // Most recently used first.
+    mutable std::vector<size_type>     _lengths;  // Fenwick trees over
+    mutable std::vector<size_type>     _lines;    // the pages.
+    size_type                          _size;
+    size_type                          _newlines;
+    mutable size_type                  _resident;
+    size_type                          _limit;
+    mutable bool                       _stale;    // The trees need rebuilding.
+
+    static size_type countNewlines(const_pointer first, const_pointer last) {
+        return scanCount(first, last, value_type('\n'));
+    }
+
+    static size_type prefix(const std::vector<size_type>& tree, size_type i) {
+        size_type sum = 0;
+        for (; i > 0; i -= i & -i) {
+            sum += tree[i];
+        }
+        return sum;
+    }
+
+    static void add(std::vector<size_type>& tree, size_type i,
+    difference_type n) {
+        for (i++; i < tree.size(); i += i & -i) {
+            tree[i] += n;
+        }
+    }
+
+    // The index of the last page whose preceding pages add up to less than
+    // k, and in before, what they do add up to.
+    static size_type descend(const std::vector<size_type>& tree, size_type k,
+    size_type& before) {
+        size_type i = 0;
+        size_type step = 1;
+        while (step * 2 < tree.size()) {
+            step *= 2;
+        }
+
+        before = 0;
+        for (; step > 0; step /= 2) {
+            if (i + step < tree.size() && before + tree[i + step] < k) {
+                i += step;
+                before += tree[i];
+            }
+        }
+        return i;
+    }
+
+    void rebuild() const {
+        if (!_stale) {
+            return;
+        }
+
+        size_type n = _pages.size();
+        _lengths.assign(n + 1, 0);
+        _lines.assign(n + 1, 0);
+        for (size_type i = 1; i <= n; i++) {
+            _lengths[i] += _pages[i - 1]->length;
+            _lines[i] += _pages[i - 1]->lines;
+            size_type parent = i + (i & -i);
+            if (parent <= n) {
+                _lengths[parent] += _lengths[i];
+                _lines[parent] += _lines[i];
+            }
+        }
+        _stale = false;
+    }
+
+    // The index of the page holding pos and the position of its first
+    // element.  A pos at (or past) the end is in the last page.  There must
+    // be at least one page.
+    size_type locate(size_type pos, size_type& start) const {
+        rebuild();
+        size_type i = descend(_lengths, pos + 1, start);
+        if (i >= _pages.size()) {
+            i = _pages.size() - 1;
+            start = _size - _pages[i]->length;
+        }
+        return i;
+    }
+
+    // As locate() but makes a page to put things in if there isn't one.
+    size_type place(size_type pos, size_type& start) {
+        if (_pages.empty()) {
+            append(std::make_shared<std::vector<T, Allocator>>());
+        }
+        return locate(pos, start);
+    }
+
+    // Adds a page holding data to the end and counts its newlines.  The
+    // caller adds it to the totals.
+    Page* append(const page_data& data) {
+        Page* page = new Page{ data->size(),
+            countNewlines(data->data(), data->data() + data->size()),
+            Source::NONE, 0, data, true, _lru.end(), {} };
+        _pages.emplace_back(page);
+        _lru.push_front(page);
+        page->used = _lru.begin();
+        _resident += page->length * sizeof(T);
+        _stale = true;
+        return page;
+    }
+
+    // Reads page i into memory if it isn't already and makes it the most
+    // recently used.
+    page_type load(size_type i) const {
+        Page& page = *_pages[i];
+        if (page.data) {
+            _lru.splice(_lru.begin(), _lru, page.used);
+            return page.data;
+        }
+
+        auto data = std::make_shared<std::vector<T, Allocator>>(page.length);
+        if (page.source == Source::ORIGINAL) {
+            _store->read(page.offset, data->data(), page.length * sizeof(T));
+        } else {
+            _store->swapIn(page.offset, data->data(),
+                page.length * sizeof(T));
+        }
+        page.data = data;
+        _lru.push_front(&page);
+        page.used = _lru.begin();
+        _resident += page.length * sizeof(T);
+        evict(&page);
+        return data;
+    }
+
+    // The offsets of the newlines in page i, which must be in memory.  They
+    // are found the first time they are wanted and forgotten when the page
+    // changes or is dropped.
+    const std::vector<std::uint32_t>& newlineOffsets(size_type i) const {
+        Page& page = *_pages[i];
+        if (page.newlines.empty() && page.lines > 0) {
+            const_pointer first = page.data->data();
+            const_pointer last = first + page.length;
+            for (const_pointer p = first;
+            (p = scanFind(p, last, value_type('\n'))) != last; p++) {
+                page.newlines.push_back(p - first);
+            }
+        }
+        return page.newlines;
+    }
+
+    // Page i's text, ready to be changed.  If anything else (a snapshot, say)
+    // still has the page, it is given a copy to change instead.
+    std::vector<T, Allocator>& writable(size_type i) {
+        load(i);
+        Page& page = *_pages[i];
+        if (page.data.use_count() > 1) {
+            page.data = std::make_shared<std::vector<T, Allocator>>(
+                *page.data);
+        } else {
+            // No snapshot has it any more (see BufferSnapshot.)
+            std::atomic_thread_fence(std::memory_order_acquire);
+        }
+        page.dirty = true;
+        return *page.data;
+    }
+
+    // Drops the least recently used pages, other than keep, until the ones
+    // left fit within the limit.
+    void evict(const Page* keep) const {
+        auto i = _lru.end();
+        while (_resident > _limit && i != _lru.begin()) {
+            --i;
+            if (*i == keep) {
+                continue;
+            }
+
+            Page& page = **i;
+            if (page.dirty) {
+                if (!_store) {
+                    _store.reset(new PageStore());
+                }
+                page.offset = _store->swapOut(page.data->data(),
+                    page.length * sizeof(T));
+                page.source = Source::SWAP;
+                page.dirty = false;
+            }
+            page.data.reset();
+            std::vector<std::uint32_t>().swap(page.newlines);
+            _resident -= page.length * sizeof(T);
+            i = _lru.erase(i);
+        }
+    }
+
+    // Page i has gained (or if negative, lost) length elements and lines
+    // newlines.
+    void changed(size_type i, difference_type length, difference_type lines) {
+        _pages[i]->length += length;
+        _pages[i]->lines += lines;
+        _pages[i]->newlines.clear();
+        _size += length;
+        _newlines += lines;
+        _resident += length * sizeof(T);
+        if (!_stale) {
+            add(_lengths, i, length);
+            add(_lines, i, lines);
+        }
+    }
+
+    // n elements have been put in page i at offset.  If it is now too big it
+    // is split into pages of PAGESIZE.
+    void inserted(size_type i, size_type offset, size_type n) {
+        Page& page = *_pages[i];
+        auto data = page.data;
+        changed(i, n, countNewlines(data->data() + offset,
+            data->data() + offset + n));
+
+        if (data->size() >= 2 * PAGESIZE) {
+            std::vector<std::unique_ptr<Page>> tail;
+            for (size_type first = PAGESIZE; first < data->size();
+            first += PAGESIZE) {
+                size_type last = std::min(first + PAGESIZE, data->size());
+                auto piece = std::make_shared<std::vector<T, Allocator>>(
+                    data->begin() + first, data->begin() + last);
+                Page* next = new Page{ piece->size(),
+                    countNewlines(piece->data(), piece->data() + piece->size()),
+                    Source::NONE, 0, piece, true, _lru.end(), {} };
+                _lru.push_front(next);
+                next->used = _lru.begin();
+                tail.emplace_back(next);
+                page.lines -= next->lines;
+            }
+            data->resize(PAGESIZE);
+            data->shrink_to_fit();
+            page.length = PAGESIZE;
+            _pages.insert(_pages.begin() + i + 1,
+                std::make_move_iterator(tail.begin()),
+                std::make_move_iterator(tail.end()));
+            _stale = true;
+        }
+
+        evict(&page);
+    }
+
+    // Removes the pages [first, last).
+    void removePages(size_type first, size_type last) {
+        for (size_type i = first; i < last; i++) {
+            Page& page = *_pages[i];
+            if (page.data) {
+                _lru.erase(page.used);
+                _resident -= page.length * sizeof(T);
+            }
+            _size -= page.length;
+            _newlines -= page.lines;
+        }
+        _pages.erase(_pages.begin() + first, _pages.begin() + last);
+        _stale = true;
+    }
+};
+
+template<typename T, typename Allocator>
+const typename PagedText<T, Allocator>::size_type
+PagedText<T, Allocator>::PAGESIZE;
+
+template<typename T, typename Allocator>
+const typename PagedText<T, Allocator>::size_type
+PagedText<T, Allocator>::DEFAULTLIMIT;
+
+template<typename T, std::size_t N, typename Allocator>
+class Buffer<T, N, PagedText<T, Allocator>> {
+public:
+    using self_type = Buffer<T, N, PagedText<T, Allocator>>;
+    using value_type = T;
+    using size_type = std::size_t;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const T*;
+    using const_pointer = const T*;
+    using reference = T;
+    using const_reference = T;
+    using iterator = PagedTextIterator<T, Allocator>;
+    using const_iterator = PagedTextIterator<T, Allocator>;
+    using reverse_iterator = std::reverse_iterator<iterator>;
+    using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+    using span_type = BufferSpan<T>;
+    using chunk_type = TextChunk<T>;
+    using snapshot_type = typename PagedText<T, Allocator>::Snapshot;
+
+    static const size_type npos = -1;
+
+    Buffer() : _text(), _point{0}, _mark{npos}, _columns(), _damage(),
+    _undo(), _journal{nullptr}, _counters() {
+        _damage.clear();
+    }
+
+    bool operator==(const self_type& that) const {
+        return this->_point == that._point &&
+            std::equal(begin(), end(), that.begin(), that.end());
+    }
+
+    bool operator!=(const self_type& that) const {
+        return !operator==(that);
+    }
+
+    // The page an element is in may be dropped at any time so it is returned
+    // by value.
+    value_type operator[](size_type n) const {
+        return _text.at(n);
+    }
+
+    const_iterator begin() const {
+        return const_iterator(&_text, 0);
+    }
+
+    const_iterator end() const {
+        return const_iterator(&_text, size());
+    }
+
+    const_iterator cbegin() const {
+        return begin();
+    }
+
+    const_iterator cend() const {
+        return end();
+    }
+
+    const_reverse_iterator rbegin() const {
+        return const_reverse_iterator(end());
+    }
+
+    const_reverse_iterator rend() const {
+        return const_reverse_iterator(begin());
+    }
+
+    const_reverse_iterator crbegin() const {
+        return rbegin();
+    }
+
+    const_reverse_iterator crend() const {
+        return rend();
+    }
+
+    size_type capacity() const {
+        return size();
+    }
+
+    bool empty() const {
+        return !size();
+    }
+
+    size_type max_size() const {
+        return _text.max_size();
+    }
+
+    size_type size() const {
+        return _text.size();
+    }
+
+    size_type front() const {
+        return 0;
+    }
+
+    size_type back() const {
+        return (size() == 0) ? 0 : size() - 1;
+    }
+
+    friend void swap(self_type& lhs, self_type& rhs) {
+        std::swap(lhs._text, rhs._text);
+        std::swap(lhs._point, rhs._point);
+        std::swap(lhs._mark, rhs._mark);
+        std::swap(lhs._columns, rhs._columns);
+        std::swap(lhs._damage, rhs._damage);
+        std::swap(lhs._undo, rhs._undo);
+        std::swap(lhs._counters, rhs._counters);
+    }
+
+    bool deletePrevious(size_type n = 1) {
+        if (n == 0 || _point < n || _point > size()) {
+            return false;
+        }
+
+        return remove(_point - n, n, true);
+    }
+
+    bool deleteNext(size_type n = 1) {
+        if (n == 0 || _point > size() || n > size() - _point) {
+            return false;
+        }
+
+        return remove(_point, n, false);
+    }
+
+    bool erase(size_type from, size_type to) {
+        if (from > to) {
+            return false;
+        }
+
+        return remove(from, to - from);
+    }
+
+    bool erase(size_type from, size_type to, const chunk_type& text) {
+        if (from > to || text->size() != to - from) {
+            return false;
+        }
+
+        return remove(from, to - from, false, text);
+    }
+
+    chunk_type copy(size_type from, size_type to) const {
+        auto text = std::make_shared<std::vector<T>>();
+        if (from < to) {
+            text->reserve(std::min(to, size()) - from);
+            for_each_segment(from, to, [&text](const_pointer p, size_type n) {
+                text->insert(text->end(), p, p + n);
+                return true;
+            });
+        }
+        return text;
+    }
+
+    bool insert(value_type c) {
+        return insert(1, c);
+    }
+
+    bool insert(size_type n, value_type c) {
+        if (_point > size()) {
+            return false;
+        }
+
+        _text.insert(_point, n, c);
+        _undo.inserted(_point, n);
+        markInserted(_point, n);
+        _damage.inserted(_point, n, c == value_type('\n'));
+        _columns.inserted(_point, n);
+        journalInserted(_point, n);
+        return pointMove(n);
+    }
+
+    template<typename ForwardIt, typename = typename std::enable_if<
+        !std::is_integral<ForwardIt>::value>::type>
+    bool insert(ForwardIt first, ForwardIt last) {
+        if (_point > size()) {
+            return false;
+        }
+
+        size_type n = size();
+        size_type newlines = _text.newlines();
+        _text.insert(_point, first, last);
+        _undo.inserted(_point, size() - n);
+        markInserted(_point, size() - n);
+        _damage.inserted(_point, size() - n, _text.newlines() != newlines);
+        _columns.inserted(_point, size() - n);
+        journalInserted(_point, size() - n);
+        return pointMove(size() - n);
+    }
+
+    template<typename ForwardIt, typename = typename std::enable_if<
+        !std::is_integral<ForwardIt>::value>::type>
+    void assign(ForwardIt first, ForwardIt last) {
+        _text.assign(first, last);
+        reset();
+    }
+
+    // Makes the contents of filename the text, reading it a page at a time
+    // as it is needed.  Returns false and sets errno if it can't be opened,
+    // in which case the buffer is left empty.
+    bool open(const std::string& filename) {
+        bool opened = _text.open(filename);
+        reset();
+        return opened;
+    }
+
+    // How many bytes of the text to keep in memory at most.  (A page that is
+    // being used is kept even if it is over.)
+    void memoryLimit(size_type bytes) {
+        _text.limit(bytes);
+    }
+
+    // As with the piece table every page is a segment.  A segment's data is
+    // only valid until fn returns.
+    template<typename F>
+    bool for_each_segment(size_type from, size_type to, F fn,
+    size_type chunk = npos) const {
+        return _text.forEach(from, to,
+            [&fn, chunk](const_pointer p, size_type n, size_type) {
+                return forEachChunk(p, n, chunk, fn);
+            });
+    }
+
+    snapshot_type snapshot() const {
+        return _text.snapshot();
+    }
+
+    difference_type point() const {
+        return _point;
+    }
+
+    bool pointSet(size_type n) {
+        _point = n;
+        return true;
+    }
+
+    bool pointMove(difference_type count) {
+        size_type loc = _point + count;
+        if (loc > size()) {
+            return false;
+        }
+
+        _point = loc;
+        return true;
+    }
+
+    size_type mark() const {
+        return _mark;
+    }
+
+    bool markSet(size_type n) {
+        if (n != npos && n > size()) {
+            return false;
+        }
+
+        _mark = n;
+        return true;
+    }
+
+    size_type lines() const {
+        return _text.newlines() + 1;
+    }
+
+    size_type lineOf(size_type pos) const {
+        return _text.newlinesBefore(pos);
+    }
+
+    size_type lineStart(size_type line) const {
+        if (line == 0) {
+            return 0;
+        }
+        if (line > _text.newlines()) {
+            return npos;
+        }
+        return _text.newline(line) + 1;
+    }
+
+    size_type lineEnd(size_type line) const {
+        size_type next = lineStart(line + 1);
+        return (next == npos) ? size() : next - 1;
+    }
+
+    // The column (counting from 0) at which pos is shown on its line, with
+    // tabs, wide characters and combining marks taken into account.
+    size_type column(size_type pos) const {
+        return _columns.measure(*this, lineStart(lineOf(pos)), pos).apply(0);
+    }
+
+    // The position of the character shown at column on line or, if the line
+    // is not that long, of its end.
+    size_type columnStart(size_type line, size_type column) const {
+        return _columns.find(*this, lineStart(line), lineEnd(line),
+            [column](const TextAdvance& advance) {
+                return advance.apply(0) > column;
+            });
+    }
+
+    // The position count characters after pos, or size() if there aren't
+    // that many.  A character is a codepoint together with any combining
+    // marks after it.
+    size_type nextChar(size_type pos, size_type count = 1) const {
+        return _columns.find(*this, pos, size(),
+            [count](const TextAdvance& advance) {
+                return advance._chars > count;
+            });
+    }
+
+    // The position count characters before pos, or 0 if there aren't that
+    // many.
+    size_type previousChar(size_type pos, size_type count = 1) const {
+        return _columns.findBackward(*this, 0, pos,
+            [count](const TextAdvance& advance) {
+                return advance._chars >= count;
+            });
+    }
+
+    size_type searchBackward(value_type c, size_type pos) const {
+        size_type result = npos;
+        size_type& scanned = _counters._scanned;
+        _text.forEachReverse(0, std::min(pos + 1, size()),
+            [&result, &scanned, c](const_pointer p, size_type n,
+            size_type start) {
+                const_pointer i = scanFindLast(p, p + n, c);
+                scanned += ((i != p + n) ? (p + n) - i : n) * sizeof(T);
+                if (i != p + n) {
+                    result = start + (i - p) + 1;
+                    return false;
+                }
+                return true;
+            });
+        return result;
+    }
+
+    size_type searchForward(value_type c, size_type pos) const {
+        size_type result = npos;
+        size_type& scanned = _counters._scanned;
+        _text.forEach(pos, size(),
+            [&result, &scanned, c](const_pointer p, size_type n,
+            size_type start) {
+                const_pointer i = scanFind(p, p + n, c);
+                scanned += ((i != p + n) ? (i - p) + 1 : n) * sizeof(T);
+                if (i != p + n) {
+                    result = start + (i - p);
+                    return false;
+                }
+                return true;
+            });
+        return result;
+    }
+
+    const BufferDamage& damage() const {
+        return _damage;
+    }
+
+    void clearDamage() {
+        _damage.clear();
+    }
+
+    bool undo() {
+        return _undo.undo(*this);
+    }
+
+    bool redo() {
+        return _undo.redo(*this);
+    }
+
+    void undoBoundary() {
+        _undo.boundary();
+    }
+
+    void undoLimit(size_type bytes) {
+        _undo.limit(bytes);
+    }
+
+    void journal(Journal* journal) {
+        _journal = journal;
+    }
+
+    size_type pages() const {
+        return _text.pages();
+    }
+
+    size_type resident() const {
+        return _text.resident();
+    }
+
+    // Pages are never moved or reallocated as a whole so only searches are
+    // counted.
+    const BufferCounters& counters() const {
+        return _counters;
+    }
+
+private:
+    friend class UndoLog<T>;
+
+    PagedText<T, Allocator> _text;
+    size_type     _point;
+    size_type     _mark;
+    mutable ColumnIndex _columns;
+    BufferDamage  _damage;
+    UndoLog<T>    _undo;
+    Journal*      _journal;
+    mutable BufferCounters _counters;
+
+    void reset() {
+        _point = 0;
+        _mark = npos;
+        _columns.reset(size());
+        _damage.clear();
+        _damage.inserted(0, size(), true);
+        _undo.clear();
+    }
+
+    // Deletes the n elements from pos and leaves point there.
+    bool remove(size_type pos, size_type n, bool backward = false,
+    const chunk_type& text = nullptr) {
+        if (pos > size() || n > size() - pos) {
+            return false;
+        }
+
+        if (text) {
+            _undo.erasing(pos, text);
+        } else {
+            _undo.erasing(*this, pos, n, backward);
+        }
+        markRemoved(pos, n);
+        size_type newlines = _text.newlines();
+        _text.erase(pos, n);
+        _damage.erased(pos, n, _text.newlines() != newlines);
+        _columns.erased(pos, n);
+        _point = pos;
+        if (_journal != nullptr) {
+            _journal->erased(pos, n);
+        }
+        return true;
+    }
+
+    void journalInserted(size_type pos, size_type n) {
+        if (_journal != nullptr) {
+            _journal->inserted(*this, pos, n);
+        }
+    }
+
+    void markInserted(size_type pos, size_type n) {
+        if (_mark != npos && _mark > pos) {
+            _mark += n;
+        }
+    }
+
+    void markRemoved(size_type pos, size_type n) {
+        if (_mark != npos && _mark > pos) {
+            _mark = (_mark > pos + n) ? _mark - n : pos;
+        }
+    }
+};
+
+// A random access iterator over paged text.  It holds on to the page it last
+// looked at, so that page stays valid even if it is dropped, and only looks
+// for another when it steps off that one.  Elements are given by value, since
+// a reference into that page would only last as long as the iterator (and
+// std::reverse_iterator dereferences a copy which is gone straight after.)
+template<typename T, typename Allocator>
+class PagedTextIterator {
+public:
+    using self_type         = PagedTextIterator<T, Allocator>;
+    using value_type        = T;
+    using size_type         = std::size_t;
+    using difference_type   = std::ptrdiff_t;
+    using pointer           = const T*;
+    using reference         = T;
+    using iterator_category = std::random_access_iterator_tag;
+
+    PagedTextIterator() : _text{nullptr}, _pos{0}, _page{}, _pageStart{0},
+    _pageEnd{0} {
+    }
+
+    PagedTextIterator(const PagedText<T, Allocator>* text, size_type pos) :
+    _text{text}, _pos{pos}, _page{}, _pageStart{0}, _pageEnd{0} {
+    }
+
+    bool operator==(const self_type& that) const {
+        return _text == that._text && _pos == that._pos;
+    }
+
+    bool operator!=(const self_type& that) const {
+        return !operator==(that);
+    }
+
+    bool operator<(const self_type& that) const {
+        return _pos < that._pos;
+    }
+
+    bool operator>(const self_type& that) const {
+        return _pos > that._pos;
+    }
+
+    bool operator<=(const self_type& that) const {
+        return _pos <= that._pos;
+    }
+
+    bool operator>=(const self_type& that) const {
+        return _pos >= that._pos;
+    }
+
+    self_type& operator+=(difference_type n) {
+        _pos += n;
+        return *this;
+    }
+
+    self_type operator+(difference_type n) const {
+        return self_type(*this) += n;
+    }
+
+    friend self_type operator+(difference_type n, const self_type& i) {
+        return i + n;
+    }
+
+    self_type& operator++() {
+        _pos++;
+        return *this;
+    }
+
+    self_type operator++(int) {
+        self_type tmp(*this);
+        _pos++;
+        return tmp;
+    }
+
+    self_type& operator-=(difference_type n) {
+        _pos -= n;
+        return *this;
+    }
+
+    self_type operator-(difference_type n) const {
+        return self_type(*this) -= n;
+    }
+
+    difference_type operator-(const self_type& that) const {
+        return static_cast<difference_type>(_pos) -
+            static_cast<difference_type>(that._pos);
+    }
+
+    self_type& operator--() {
+        _pos--;
+        return *this;
+    }
+
+    self_type operator--(int) {
+        self_type tmp(*this);
+        _pos--;
+        return tmp;
+    }
+
+    reference operator*() const {
+        if (_pos < _pageStart || _pos >= _pageEnd) {
+            _page = _text->page(_pos, _pageStart);
+            _pageEnd = _pageStart + _page->size();
+        }
+        return (*_page)[_pos - _pageStart];
+    }
+
+    reference operator[](difference_type n) const {
+        return *(*this + n);
+    }
+
+    size_type pos() const {
+        return _pos;
+    }
+
+private:
+    using page_type = typename PagedText<T, Allocator>::page_type;
+
+    const PagedText<T, Allocator>* _text;
+    size_type            _pos;
+    mutable page_type    _page;
+    mutable size_type    _pageStart;
+    mutable size_type    _pageEnd;
+};
+
+#endif
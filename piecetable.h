@@ -0,0 +1,1081 @@
+// PieceTable -- piece table storage for Buffer
+//
+// By Jaldhar H. Vyas <jaldhar@braincells.com>
+// Copyright (C) 2017, Consolidated Braincells Inc. All rights reserved.
+// "Do what thou wilt" shall be the whole of the license.
+//
+// Using PieceTable<T> as the Container parameter of Buffer selects a piece
+// table instead of a gap buffer:
+//
+//     Buffer<char, 80, PieceTable<char>> buffer;
+//
+// The add buffer is allocated with Allocator, like the storage of a gap
+// buffer is by its Container.
+//
+// The text is described by a sequence of pieces, each of which refers to a
+// run of elements in one of two places: the original text, which is never
+// modified (and can be a read-only mapping of a file) and the add buffer, to
+// which inserted text is only ever appended.  The pieces are kept in a treap
+// ordered by position in the text and annotated with the length of each
+// subtree, so finding, splitting or joining pieces at any position costs
+// O(log pieces) regardless of how big the text is or where the last edit
+// was.
+//
+// The offsets of the newlines in the original text and the add buffer are
+// kept in sorted lists (the add buffer is only appended to so its list is
+// too) and each node also counts the newlines in its subtree.  Line number
+// to position and position to line number are therefore O(log pieces +
+// log lines) as well.
+
+#ifndef _PIECETABLE_H_
+#define _PIECETABLE_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "buffer.h"
+#include "scan.h"
+
+template<typename T, typename Allocator> class PieceTableIterator;
+
+template<typename T, typename Allocator = std::allocator<T>>
+class PieceTable {
+public:
+    using self_type = PieceTable<T, Allocator>;
+    using value_type = T;
+    using size_type = std::size_t;
+    using difference_type = std::ptrdiff_t;
+    using const_pointer = const T*;
+
+    PieceTable() : _original{nullptr}, _originalSize{0}, _owner{},
+    _add{std::make_shared<std::vector<T, Allocator>>()},
+    _originalLines{}, _addLines{}, _nodes{}, _free{NIL}, _root{NIL},
+    _seed{0x9e3779b9} {
+    }
+
+    // Makes [first, last) the original text.  It is referred to in place, not
+    // copied, and must stay valid for as long as owner is alive.
+    void assign(const_pointer first, const_pointer last,
+    std::shared_ptr<const void> owner) {
+        clear();
+        _original = first;
+        _originalSize = last - first;
+        _owner = std::move(owner);
+        findNewlines(_original, _originalSize, 0, _originalLines);
+        if (_originalSize > 0) {
+            _root = makeNode(false, 0, _originalSize);
+        }
+    }
+
+    void clear() {
+        _original = nullptr;
+        _originalSize = 0;
+        _owner.reset();
+        _add = std::make_shared<std::vector<T, Allocator>>();
+        _originalLines.clear();
+        _addLines.clear();
+        _nodes.clear();
+        _free = NIL;
+        _root = NIL;
+    }
+
+    size_type size() const {
+        return total(_root);
+    }
+
+    size_type capacity() const {
+        return _originalSize + _add->capacity();
+    }
+
+    size_type max_size() const {
+        return _add->max_size();
+    }
+
+    size_type pieces() const {
+        return _nodes.size() - freeCount();
+    }
+
+    size_type newlines() const {
+        return totalLines(_root);
+    }
+
+    // The number of newlines before pos.
+    size_type newlinesBefore(size_type pos) const {
+        size_type count = 0;
+        int t = _root;
+        while (t != NIL) {
+            const Node& node = _nodes[t];
+            size_type left = total(node.left);
+            if (pos < left) {
+                t = node.left;
+            } else if (pos < left + node.length) {
+                return count + totalLines(node.left) +
+                    countNewlines(node, 0, pos - left);
+            } else {
+                pos -= left + node.length;
+                count += totalLines(node.left) + node.lines;
+                t = node.right;
+            }
+        }
+        return count;
+    }
+
+    // The position of the k'th newline (counting from 1.)  k must be between
+    // 1 and newlines().
+    size_type newline(size_type k) const {
+        size_type pos = 0;
+        int t = _root;
+        while (t != NIL) {
+            const Node& node = _nodes[t];
+            size_type left = totalLines(node.left);
+            if (k <= left) {
+                t = node.left;
+            } else if (k <= left + node.lines) {
+                const std::vector<size_type>& lines = lineList(node);
+                auto first = std::lower_bound(lines.begin(), lines.end(),
+                    node.start);
+                return pos + total(node.left) +
+                    (first[k - left - 1] - node.start);
+            } else {
+                k -= left + node.lines;
+                pos += total(node.left) + node.length;
+                t = node.right;
+            }
+        }
+        return pos;
+    }
+
+    // Inserts the range [first, last) before pos.
+    template<typename ForwardIt>
+    void insert(size_type pos, ForwardIt first, ForwardIt last) {
+        reserveAdd(std::distance(first, last));
+        size_type start = _add->size();
+        _add->insert(_add->end(), first, last);
+        findNewlines(_add->data() + start, _add->size() - start, start,
+            _addLines);
+        link(pos, start, _add->size() - start);
+    }
+
+    // Inserts n copies of c before pos.
+    void insert(size_type pos, size_type n, value_type c) {
+        reserveAdd(n);
+        size_type start = _add->size();
+        _add->insert(_add->end(), n, c);
+        findNewlines(_add->data() + start, n, start, _addLines);
+        link(pos, start, n);
+    }
+
+    // Removes n elements starting at pos.
+    void erase(size_type pos, size_type n) {
+        int left, middle, right;
+        split(_root, pos, left, middle);
+        split(middle, n, middle, right);
+        release(middle);
+        _root = merge(left, right);
+    }
+
+    // Adds the pieces, in order, to snapshot along with the original text
+    // and the add buffer they are in.
+    void snapshot(BufferSnapshot<T>& snapshot) const {
+        forEach(0, size(), [&snapshot](const_pointer p, size_type n,
+        size_type) {
+            snapshot.append(p, n);
+            return true;
+        });
+        snapshot.own(_owner);
+        snapshot.own(_add);
+    }
+
+    // Returns a pointer to the element at pos and the number of elements that
+    // follow it contiguously in memory.
+    std::pair<const_pointer, size_type> run(size_type pos) const {
+        int t = _root;
+        while (t != NIL) {
+            const Node& node = _nodes[t];
+            size_type left = total(node.left);
+            if (pos < left) {
+                t = node.left;
+            } else if (pos < left + node.length) {
+                pos -= left;
+                return { data(node) + pos, node.length - pos };
+            } else {
+                pos -= left + node.length;
+                t = node.right;
+            }
+        }
+        return { nullptr, 0 };
+    }
+
+    // Calls fn(pointer, length, position) for each contiguous run of
+    // elements in [from, to), in order, until it returns false.  Returns
+    // false if fn did.
+    template<typename F>
+    bool forEach(size_type from, size_type to, F fn) const {
+        return visit(_root, 0, from, to, fn);
+    }
+
+    // As forEach() but visits the runs from last to first.
+    template<typename F>
+    bool forEachReverse(size_type from, size_type to, F fn) const {
+        return visitReverse(_root, 0, from, to, fn);
+    }
+
+private:
+    static const int NIL = -1;
+
+    struct Node {
+        bool          add;      // Refers to the add buffer, not the original.
+        size_type     start;
+        size_type     length;
+        size_type     total;    // Length of this subtree.
+        size_type     lines;    // Newlines in this piece.
+        size_type     totalLines; // Newlines in this subtree.
+        std::uint32_t priority;
+        int           left;
+        int           right;
+    };
+
+    const_pointer               _original;
+    size_type                   _originalSize;
+    std::shared_ptr<const void> _owner;
+    std::shared_ptr<std::vector<T, Allocator>> _add;
+    std::vector<size_type>      _originalLines;
+    std::vector<size_type>      _addLines;
+    std::vector<Node>           _nodes;
+    int                         _free;
+    int                         _root;
+    std::uint32_t               _seed;
+
+    // Makes room for n more elements in the add buffer.  What is already in
+    // it never changes, so a snapshot can refer to it, but if it has to grow
+    // while a snapshot does, the elements are copied to a new one and the old
+    // one is left to the snapshots.
+    void reserveAdd(size_type n) {
+        size_type size = _add->size();
+        if (n <= _add->capacity() - size) {
+            return;
+        }
+
+        if (_add.use_count() > 1) {
+            auto add = std::make_shared<std::vector<T, Allocator>>();
+            add->reserve(std::max(size + n, 2 * size));
+            add->assign(_add->begin(), _add->end());
+            _add = std::move(add);
+        } else {
+            // No snapshot has it any more (see BufferSnapshot.)
+            std::atomic_thread_fence(std::memory_order_acquire);
+        }
+    }
+
+    size_type total(int t) const {
+        return (t == NIL) ? 0 : _nodes[t].total;
+    }
+
+    size_type totalLines(int t) const {
+        return (t == NIL) ? 0 : _nodes[t].totalLines;
+    }
+
+    const_pointer data(const Node& node) const {
+        return (node.add ? _add->data() : _original) + node.start;
+    }
+
+    const std::vector<size_type>& lineList(const Node& node) const {
+        return node.add ? _addLines : _originalLines;
+    }
+
+    // The number of newlines in [first, last) of node's piece.
+    size_type countNewlines(const Node& node, size_type first,
+    size_type last) const {
+        const std::vector<size_type>& lines = lineList(node);
+        return std::lower_bound(lines.begin(), lines.end(), node.start + last) -
+            std::lower_bound(lines.begin(), lines.end(), node.start + first);
+    }
+
+    // Appends the offsets (starting from offset) of the newlines in
+    // [p, p + n) to lines.
+    static void findNewlines(const_pointer p, size_type n, size_type offset,
+    std::vector<size_type>& lines) {
+        const value_type newline('\n');
+        for (const_pointer i = p, end = p + n;
+        (i = scanFind(i, end, newline)) != end; i++) {
+            lines.push_back(offset + (i - p));
+        }
+    }
+
+    void update(int t) {
+        Node& node = _nodes[t];
+        node.total = total(node.left) + node.length + total(node.right);
+        node.totalLines = totalLines(node.left) + node.lines +
+            totalLines(node.right);
+    }
+
+    std::uint32_t random() {
+        // xorshift32; all the treap needs is a cheap, well spread priority.
+        _seed ^= _seed << 13;
+        _seed ^= _seed >> 17;
+        _seed ^= _seed << 5;
+        return _seed;
+    }
+
+    int makeNode(bool add, size_type start, size_type length) {
+        Node node = { add, start, length, length, 0, 0, random(), NIL, NIL };
+        node.lines = node.totalLines = countNewlines(node, 0, length);
+        if (_free != NIL) {
+            int t = _free;
+            _free = _nodes[t].left;
+            _nodes[t] = node;
+            return t;
+        }
+        _nodes.push_back(node);
+        return static_cast<int>(_nodes.size()) - 1;
+    }
+
+    void release(int t) {
+        if (t == NIL) {
+            return;
+        }
+        release(_nodes[t].left);
+        release(_nodes[t].right);
+        _nodes[t].left = _free;
+        _nodes[t].length = 0;
+        _free = t;
+    }
+
+    size_type freeCount() const {
+        size_type count = 0;
+        for (int t = _free; t != NIL; t = _nodes[t].left) {
+            count++;
+        }
+        return count;
+    }
+
+    // Splits t into the first n elements (left) and the rest (right),
+    // cutting a piece in two if the boundary falls inside it.
+    void split(int t, size_type n, int& left, int& right) {
+        if (t == NIL) {
+            left = right = NIL;
+            return;
+        }
+
+        size_type before = total(_nodes[t].left);
+        if (n <= before) {
+            int l;
+            split(_nodes[t].left, n, left, l);
+            _nodes[t].left = l;
+            update(t);
+            right = t;
+        } else if (n >= before + _nodes[t].length) {
+            int r;
+            split(_nodes[t].right, n - before - _nodes[t].length, r, right);
+            _nodes[t].right = r;
+            update(t);
+            left = t;
+        } else {
+            size_type offset = n - before;
+            int tail = makeNode(_nodes[t].add, _nodes[t].start + offset,
+                _nodes[t].length - offset);
+            _nodes[t].length = offset;
+            _nodes[t].lines -= _nodes[tail].lines;
+            right = merge(tail, _nodes[t].right);
+            _nodes[t].right = NIL;
+            update(t);
+            left = t;
+        }
+    }
+
+    int merge(int left, int right) {
+        if (left == NIL) {
+            return right;
+        }
+        if (right == NIL) {
+            return left;
+        }
+
+        if (_nodes[left].priority > _nodes[right].priority) {
+            _nodes[left].right = merge(_nodes[left].right, right);
+            update(left);
+            return left;
+        }
+        _nodes[right].left = merge(left, _nodes[right].left);
+        update(right);
+        return right;
+    }
+
+    // Puts a piece for add buffer elements [start, start + length) at pos.
+    // Typing appends to the add buffer right after the previous insertion so
+    // if the piece before pos ends where the new one starts, it is simply
+    // lengthened instead.
+    void link(size_type pos, size_type start, size_type length) {
+        if (length == 0) {
+            return;
+        }
+
+        int left, right;
+        split(_root, pos, left, right);
+
+        int last = left;
+        while (last != NIL && _nodes[last].right != NIL) {
+            last = _nodes[last].right;
+        }
+
+        if (last != NIL && _nodes[last].add &&
+        _nodes[last].start + _nodes[last].length == start) {
+            size_type lines = countNewlines(_nodes[last], _nodes[last].length,
+                _nodes[last].length + length);
+            for (int t = left; t != NIL; t = _nodes[t].right) {
+                _nodes[t].total += length;
+                _nodes[t].totalLines += lines;
+            }
+            _nodes[last].length += length;
+            _nodes[last].lines += lines;
+        } else {
+            left = merge(left, makeNode(true, start, length));
+        }
+
+        _root = merge(left, right);
+    }
+
+    // offset is the position of the first element of subtree t.
+    template<typename F>
+    bool visit(int t, size_type offset, size_type from, size_type to,
+    F& fn) const {
+        if (t == NIL || from >= to || offset >= to ||
+        offset + _nodes[t].total <= from) {
+            return true;
+        }
+
+        const Node& node = _nodes[t];
+        if (!visit(node.left, offset, from, to, fn)) {
+            return false;
+        }
+
+        size_type start = offset + total(node.left);
+        size_type first = std::max(start, from);
+        size_type last = std::min(start + node.length, to);
+        if (first < last &&
+        !fn(data(node) + (first - start), last - first, first)) {
+            return false;
+        }
+
+        return visit(node.right, start + node.length, from, to, fn);
+    }
+
+    template<typename F>
+    bool visitReverse(int t, size_type offset, size_type from, size_type to,
+    F& fn) const {
+        if (t == NIL || from >= to || offset >= to ||
+        offset + _nodes[t].total <= from) {
+            return true;
+        }
+
+        const Node& node = _nodes[t];
+        size_type start = offset + total(node.left);
+        if (!visitReverse(node.right, start + node.length, from, to, fn)) {
+            return false;
+        }
+
+        size_type first = std::max(start, from);
+        size_type last = std::min(start + node.length, to);
+        if (first < last &&
+        !fn(data(node) + (first - start), last - first, first)) {
+            return false;
+        }
+
+        return visitReverse(node.left, offset, from, to, fn);
+    }
+};
+
+template<typename T, std::size_t N, typename Allocator>
+class Buffer<T, N, PieceTable<T, Allocator>> {
+public:
+    using self_type = Buffer<T, N, PieceTable<T, Allocator>>;
+    using value_type = T;
+    using size_type = std::size_t;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const T*;
+    using const_pointer = const T*;
+    using reference = const T&;
+    using const_reference = const T&;
+    using iterator = PieceTableIterator<T, Allocator>;
+    using const_iterator = PieceTableIterator<T, Allocator>;
+    using reverse_iterator = std::reverse_iterator<iterator>;
+    using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+    using span_type = BufferSpan<T>;
+    using chunk_type = TextChunk<T>;
+    using snapshot_type = BufferSnapshot<T>;
+
+    static const size_type npos = -1;
+
+    Buffer() : _text(), _point{0}, _mark{npos}, _columns(), _damage(),
+    _undo(), _journal{nullptr}, _counters() {
+        _damage.clear();
+    }
+
+    bool operator==(const self_type& that) const {
+        return this->_point == that._point &&
+            std::equal(begin(), end(), that.begin(), that.end());
+    }
+
+    bool operator!=(const self_type& that) const {
+        return !operator==(that);
+    }
+
+    const_reference operator[](size_type n) const {
+        return *_text.run(n).first;
+    }
+
+    const_iterator begin() const {
+        return const_iterator(&_text, 0);
+    }
+
+    const_iterator end() const {
+        return const_iterator(&_text, size());
+    }
+
+    const_iterator cbegin() const {
+        return begin();
+    }
+
+    const_iterator cend() const {
+        return end();
+    }
+
+    const_reverse_iterator rbegin() const {
+        return const_reverse_iterator(end());
+    }
+
+    const_reverse_iterator rend() const {
+        return const_reverse_iterator(begin());
+    }
+
+    const_reverse_iterator crbegin() const {
+        return rbegin();
+    }
+
+    const_reverse_iterator crend() const {
+        return rend();
+    }
+
+    size_type capacity() const {
+        return _text.capacity();
+    }
+
+    bool empty() const {
+        return !size();
+    }
+
+    size_type max_size() const {
+        return _text.max_size();
+    }
+
+    size_type size() const {
+        return _text.size();
+    }
+
+    size_type front() const {
+        return 0;
+    }
+
+    size_type back() const {
+        return (size() == 0) ? 0 : size() - 1;
+    }
+
+    friend void swap(self_type& lhs, self_type& rhs) {
+        std::swap(lhs._text, rhs._text);
+        std::swap(lhs._point, rhs._point);
+        std::swap(lhs._mark, rhs._mark);
+        std::swap(lhs._columns, rhs._columns);
+        std::swap(lhs._damage, rhs._damage);
+        std::swap(lhs._undo, rhs._undo);
+        std::swap(lhs._counters, rhs._counters);
+    }
+
+    bool deletePrevious(size_type n = 1) {
+        if (n == 0 || _point < n || _point > size()) {
+            return false;
+        }
+
+        return remove(_point - n, n, true);
+    }
+
+    bool deleteNext(size_type n = 1) {
+        if (n == 0 || _point > size() || n > size() - _point) {
+            return false;
+        }
+
+        return remove(_point, n, false);
+    }
+
+    // Removing a range is one erase from the tree whatever its length.
+    bool erase(size_type from, size_type to) {
+        if (from > to) {
+            return false;
+        }
+
+        return remove(from, to - from);
+    }
+
+    bool erase(size_type from, size_type to, const chunk_type& text) {
+        if (from > to || text->size() != to - from) {
+            return false;
+        }
+
+        return remove(from, to - from, false, text);
+    }
+
+    chunk_type copy(size_type from, size_type to) const {
+        auto text = std::make_shared<std::vector<T>>();
+        if (from < to) {
+            text->reserve(std::min(to, size()) - from);
+            for_each_segment(from, to, [&text](const_pointer p, size_type n) {
+                text->insert(text->end(), p, p + n);
+                return true;
+            });
+        }
+        return text;
+    }
+
+    bool insert(value_type c) {
+        return insert(1, c);
+    }
+
+    bool insert(size_type n, value_type c) {
+        if (_point > size()) {
+            return false;
+        }
+
+        size_type capacity = _text.capacity();
+        _text.insert(_point, n, c);
+        countGrowth(capacity);
+        _undo.inserted(_point, n);
+        markInserted(_point, n);
+        _damage.inserted(_point, n, c == value_type('\n'));
+        _columns.inserted(_point, n);
+        journalInserted(_point, n);
+        return pointMove(n);
+    }
+
+    template<typename ForwardIt, typename = typename std::enable_if<
+        !std::is_integral<ForwardIt>::value>::type>
+    bool insert(ForwardIt first, ForwardIt last) {
+        if (_point > size()) {
+            return false;
+        }
+
+        size_type n = size();
+        size_type newlines = _text.newlines();
+        size_type capacity = _text.capacity();
+        _text.insert(_point, first, last);
+        countGrowth(capacity);
+        _undo.inserted(_point, size() - n);
+        markInserted(_point, size() - n);
+        _damage.inserted(_point, size() - n, _text.newlines() != newlines);
+        _columns.inserted(_point, size() - n);
+        journalInserted(_point, size() - n);
+        return pointMove(size() - n);
+    }
+
+    // The range is copied into the add buffer; use the overload taking an
+    // owner to refer to it in place.
+    template<typename ForwardIt, typename = typename std::enable_if<
+        !std::is_integral<ForwardIt>::value>::type>
+    void assign(ForwardIt first, ForwardIt last) {
+        _text.clear();
+        _point = 0;
+        insert(first, last);
+        _point = 0;
+        _mark = npos;
+        _columns.reset(size());
+        _damage.clear();
+        _damage.inserted(0, size(), true);
+        _undo.clear();
+    }
+
+    // Makes [first, last) the original text without copying it.  owner keeps
+    // the memory (e.g. a File mapping) alive for as long as it is needed.
+    void assign(const_pointer first, const_pointer last,
+    std::shared_ptr<const void> owner) {
+        _text.assign(first, last, std::move(owner));
+        _point = 0;
+        _mark = npos;
+        _columns.reset(size());
+        _damage.clear();
+        _damage.inserted(0, size(), true);
+        _undo.clear();
+    }
+
+    // As with the gap buffer except that every piece is a segment.
+    template<typename F>
+    bool for_each_segment(size_type from, size_type to, F fn,
+    size_type chunk = npos) const {
+        return _text.forEach(from, std::min(to, size()),
+            [&fn, chunk](const_pointer p, size_type n, size_type) {
+                return forEachChunk(p, n, chunk, fn);
+            });
+    }
+
+    // Nothing in the original text or the add buffer ever changes so a
+    // snapshot is just the list of pieces, which costs O(pieces) however big
+    // the text is.
+    snapshot_type snapshot() const {
+        snapshot_type snapshot;
+        _text.snapshot(snapshot);
+        return snapshot;
+    }
+
+    difference_type point() const {
+        return _point;
+    }
+
+    bool pointSet(size_type n) {
+        _point = n;
+        return true;
+    }
+
+    bool pointMove(difference_type count) {
+        size_type loc = _point + count;
+        if (loc > size()) {
+            return false;
+        }
+
+        _point = loc;
+        return true;
+    }
+
+    size_type mark() const {
+        return _mark;
+    }
+
+    bool markSet(size_type n) {
+        if (n != npos && n > size()) {
+            return false;
+        }
+
+        _mark = n;
+        return true;
+    }
+
+    size_type lines() const {
+        return _text.newlines() + 1;
+    }
+
+    size_type lineOf(size_type pos) const {
+        return _text.newlinesBefore(pos);
+    }
+
+    size_type lineStart(size_type line) const {
+        if (line == 0) {
+            return 0;
+        }
+        if (line > _text.newlines()) {
+            return npos;
+        }
+        return _text.newline(line) + 1;
+    }
+
+    size_type lineEnd(size_type line) const {
+        size_type next = lineStart(line + 1);
+        return (next == npos) ? size() : next - 1;
+    }
+
+    // The column (counting from 0) at which pos is shown on its line, with
+    // tabs, wide characters and combining marks taken into account.
+    size_type column(size_type pos) const {
+        return _columns.measure(*this, lineStart(lineOf(pos)), pos).apply(0);
+    }
+
+    // The position of the character shown at column on line or, if the line
+    // is not that long, of its end.
+    size_type columnStart(size_type line, size_type column) const {
+        return _columns.find(*this, lineStart(line), lineEnd(line),
+            [column](const TextAdvance& advance) {
+                return advance.apply(0) > column;
+            });
+    }
+
+    // The position count characters after pos, or size() if there aren't
+    // that many.  A character is a codepoint together with any combining
+    // marks after it.
+    size_type nextChar(size_type pos, size_type count = 1) const {
+        return _columns.find(*this, pos, size(),
+            [count](const TextAdvance& advance) {
+                return advance._chars > count;
+            });
+    }
+
+    // The position count characters before pos, or 0 if there aren't that
+    // many.
+    size_type previousChar(size_type pos, size_type count = 1) const {
+        return _columns.findBackward(*this, 0, pos,
+            [count](const TextAdvance& advance) {
+                return advance._chars >= count;
+            });
+    }
+
+    // Like the gap buffer version, looks at pos and then backwards and
+    // returns the position just after the match.
+    size_type searchBackward(value_type c, size_type pos) const {
+        size_type result = npos;
+        size_type& scanned = _counters._scanned;
+        _text.forEachReverse(0, std::min(pos + 1, size()),
+            [&result, &scanned, c](const_pointer p, size_type n,
+            size_type start) {
+                const_pointer i = scanFindLast(p, p + n, c);
+                scanned += ((i != p + n) ? (p + n) - i : n) * sizeof(T);
+                if (i != p + n) {
+                    result = start + (i - p) + 1;
+                    return false;
+                }
+                return true;
+            });
+        return result;
+    }
+
+    size_type searchForward(value_type c, size_type pos) const {
+        size_type result = npos;
+        size_type& scanned = _counters._scanned;
+        _text.forEach(pos, size(),
+            [&result, &scanned, c](const_pointer p, size_type n,
+            size_type start) {
+                const_pointer i = scanFind(p, p + n, c);
+                scanned += ((i != p + n) ? (i - p) + 1 : n) * sizeof(T);
+                if (i != p + n) {
+                    result = start + (i - p);
+                    return false;
+                }
+                return true;
+            });
+        return result;
+    }
+
+    const BufferDamage& damage() const {
+        return _damage;
+    }
+
+    void clearDamage() {
+        _damage.clear();
+    }
+
+    bool undo() {
+        return _undo.undo(*this);
+    }
+
+    bool redo() {
+        return _undo.redo(*this);
+    }
+
+    void undoBoundary() {
+        _undo.boundary();
+    }
+
+    void undoLimit(size_type bytes) {
+        _undo.limit(bytes);
+    }
+
+    void journal(Journal* journal) {
+        _journal = journal;
+    }
+
+    size_type pieces() const {
+        return _text.pieces();
+    }
+
+    // There is no gap so only reallocations of the add buffer and searches
+    // are counted.
+    const BufferCounters& counters() const {
+        return _counters;
+    }
+
+private:
+    friend class UndoLog<T>;
+
+    PieceTable<T, Allocator> _text;
+    size_type     _point;
+    size_type     _mark;
+    mutable ColumnIndex _columns;
+    BufferDamage  _damage;
+    UndoLog<T>    _undo;
+    Journal*      _journal;
+    mutable BufferCounters _counters;
+
+    void countGrowth(size_type capacity) {
+        if (_text.capacity() != capacity) {
+            _counters._reallocations++;
+        }
+    }
+
+    // Deletes the n elements from pos and leaves point there.
+    bool remove(size_type pos, size_type n, bool backward = false,
+    const chunk_type& text = nullptr) {
+        if (pos > size() || n > size() - pos) {
+            return false;
+        }
+
+        if (text) {
+            _undo.erasing(pos, text);
+        } else {
+            _undo.erasing(*this, pos, n, backward);
+        }
+        markRemoved(pos, n);
+        size_type newlines = _text.newlines();
+        _text.erase(pos, n);
+        _damage.erased(pos, n, _text.newlines() != newlines);
+        _columns.erased(pos, n);
+        _point = pos;
+        if (_journal != nullptr) {
+            _journal->erased(pos, n);
+        }
+        return true;
+    }
+
+    void journalInserted(size_type pos, size_type n) {
+        if (_journal != nullptr) {
+            _journal->inserted(*this, pos, n);
+        }
+    }
+
+    void markInserted(size_type pos, size_type n) {
+        if (_mark != npos && _mark > pos) {
+            _mark += n;
+        }
+    }
+
+    void markRemoved(size_type pos, size_type n) {
+        if (_mark != npos && _mark > pos) {
+            _mark = (_mark > pos + n) ? _mark - n : pos;
+        }
+    }
+};
+
+// A random access iterator over a piece table.  It remembers the run of
+// contiguous elements it last looked at so stepping through the text only
+// searches the tree when it crosses from one piece to the next.
+template<typename T, typename Allocator>
+class PieceTableIterator {
+public:
+    using self_type         = PieceTableIterator<T, Allocator>;
+    using value_type        = T;
+    using size_type         = std::size_t;
+    using difference_type   = std::ptrdiff_t;
+    using pointer           = const T*;
+    using reference         = const T&;
+    using iterator_category = std::random_access_iterator_tag;
+
+    PieceTableIterator() : _table{nullptr}, _pos{0}, _run{nullptr},
+    _runStart{0}, _runEnd{0} {
+    }
+
+    PieceTableIterator(const PieceTable<T, Allocator>* table, size_type pos) :
+    _table{table}, _pos{pos}, _run{nullptr}, _runStart{0}, _runEnd{0} {
+    }
+
+    bool operator==(const self_type& that) const {
+        return _table == that._table && _pos == that._pos;
+    }
+
+    bool operator!=(const self_type& that) const {
+        return !operator==(that);
+    }
+
+    bool operator<(const self_type& that) const {
+        return _pos < that._pos;
+    }
+
+    bool operator>(const self_type& that) const {
+        return _pos > that._pos;
+    }
+
+    bool operator<=(const self_type& that) const {
+        return _pos <= that._pos;
+    }
+
+    bool operator>=(const self_type& that) const {
+        return _pos >= that._pos;
+    }
+
+    self_type& operator+=(difference_type n) {
+        _pos += n;
+        return *this;
+    }
+
+    self_type operator+(difference_type n) const {
+        return self_type(*this) += n;
+    }
+
+    friend self_type operator+(difference_type n, const self_type& i) {
+        return i + n;
+    }
+
+    self_type& operator++() {
+        _pos++;
+        return *this;
+    }
+
+    self_type operator++(int) {
+        self_type tmp(*this);
+        _pos++;
+        return tmp;
+    }
+
+    self_type& operator-=(difference_type n) {
+        _pos -= n;
+        return *this;
+    }
+
+    self_type operator-(difference_type n) const {
+        return self_type(*this) -= n;
+    }
+
+    difference_type operator-(const self_type& that) const {
+        return static_cast<difference_type>(_pos) -
+            static_cast<difference_type>(that._pos);
+    }
+
+    self_type& operator--() {
+        _pos--;
+        return *this;
+    }
+
+    self_type operator--(int) {
+        self_type tmp(*this);
+        _pos--;
+        return tmp;
+    }
+
+    reference operator*() const {
+        if (_pos < _runStart || _pos >= _runEnd) {
+            auto run = _table->run(_pos);
+            _run = run.first;
+            _runStart = _pos;
+            _runEnd = _pos + run.second;
+        }
+        return _run[_pos - _runStart];
+    }
+
+    pointer operator->() const {
+        return &operator*();
+    }
+
+    reference operator[](difference_type n) const {
+        return *(*this + n);
+    }
+
+    size_type pos() const {
+        return _pos;
+    }
+
+private:
+    const PieceTable<T, Allocator>* _table;
+    size_type            _pos;
+    mutable pointer      _run;
+    mutable size_type    _runStart;
+    mutable size_type    _runEnd;
+};
+
+#endif
@@ -0,0 +1,142 @@
+// Pool -- memory shared by the buffers of a text editor (Implementation)
+//
+// By Jaldhar H. Vyas <jaldhar@braincells.com>
+// Copyright (C) 2017, Consolidated Braincells Inc. All rights reserved.
+// "Do what thou wilt" shall be the whole of the license.
+
+#include <new>
+using namespace std;
+
+#include <sys/mman.h>
+#include <unistd.h>
+#include "pool.h"
+
+Pool::Pool() : _free(), _slab{nullptr}, _slabLeft{0}, _used{0}, _cached{0},
+_mapped{0}, _mutex() {
+}
+
+Pool& Pool::instance() {
+    static Pool pool;
+    return pool;
+}
+
+void* Pool::allocate(size_t bytes) {
+    lock_guard<mutex> lock(_mutex);
+
+    if (bytes > MAXBLOCK) {
+        void* p = map(bytes);
+        _mapped += bytes;
+        _used += bytes;
+        return p;
+    }
+
+    size_t c = sizeClass(bytes);
+    size_t size = MINBLOCK << c;
+    if (_free[c] == nullptr) {
+        refill(c);
+    }
+    Free* block = _free[c];
+    _free[c] = block->next;
+    _cached -= size;
+    _used += size;
+    return block;
+}
+
+void Pool::deallocate(void* p, size_t bytes) {
+    if (p == nullptr) {
+        return;
+    }
+    lock_guard<mutex> lock(_mutex);
+
+    if (bytes > MAXBLOCK) {
+        unmap(p, bytes);
+        _mapped -= bytes;
+        _used -= bytes;
+        return;
+    }
+
+    size_t c = sizeClass(bytes);
+    size_t size = MINBLOCK << c;
+    Free* block = static_cast<Free*>(p);
+    block->next = _free[c];
+    _free[c] = block;
+    _cached += size;
+    _used -= size;
+}
+
+size_t Pool::used() const {
+    lock_guard<mutex> lock(_mutex);
+    return _used;
+}
+
+size_t Pool::cached() const {
+    lock_guard<mutex> lock(_mutex);
+    return _cached;
+}
+
+size_t Pool::mapped() const {
+    lock_guard<mutex> lock(_mutex);
+    return _mapped;
+}
+
+// The free list for blocks of bytes.  List c holds blocks of MINBLOCK << c.
+size_t Pool::sizeClass(size_t bytes) {
+    size_t c = 0;
+    while ((MINBLOCK << c) < bytes) {
+        c++;
+    }
+    return c;
+}
+
+// Large blocks are whole pages of their own.  The size they were allocated
+// with is rounded up the same way when they are unmapped.
+static size_t pages(size_t bytes) {
+    static const size_t pageSize = sysconf(_SC_PAGESIZE);
+    return (bytes + pageSize - 1) / pageSize * pageSize;
+}
+
+void* Pool::map(size_t bytes) {
+    void* p = mmap(NULL, pages(bytes), PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        throw bad_alloc();
+    }
+    return p;
+}
+
+void Pool::unmap(void* p, size_t bytes) {
+    munmap(p, pages(bytes));
+}
+
+// Puts a block on free list c, cutting it from the current slab or a new one
+// if that is used up.  What is left of the old slab is cut into the largest
+// blocks that fit and put on their lists so none of it is wasted.  Every
+// block is a multiple of MINBLOCK so they all stay aligned to it.
+void Pool::refill(size_t c) {
+    size_t size = MINBLOCK << c;
+
+    if (_slabLeft < size) {
+        for (size_t i = CLASSES; i-- > 0; ) {
+            size_t piece = MINBLOCK << i;
+            while (_slabLeft >= piece) {
+                Free* block = reinterpret_cast<Free*>(_slab);
+                block->next = _free[i];
+                _free[i] = block;
+                _cached += piece;
+                _slab += piece;
+                _slabLeft -= piece;
+            }
+        }
+
+        _slab = static_cast<char*>(map(SLABSIZE));
+        _slabLeft = SLABSIZE;
+        _mapped += SLABSIZE;
+    }
+
+    Free* block = reinterpret_cast<Free*>(_slab);
+    block->next = _free[c];
+    _free[c] = block;
+    _cached += size;
+    _slab += size;
+    _slabLeft -= size;
+}
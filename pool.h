@@ -0,0 +1,112 @@
+// Pool -- memory shared by the buffers of a text editor (Interface)
+//
+// By Jaldhar H. Vyas <jaldhar@braincells.com>
+// Copyright (C) 2017, Consolidated Braincells Inc. All rights reserved.
+// "Do what thou wilt" shall be the whole of the license.
+//
+// Every buffer's storage comes from one pool so that opening, growing and
+// killing dozens of buffers reuses the same memory instead of leaving holes
+// all over the heap.  Requests are rounded up to a power of two.  Blocks up
+// to MAXBLOCK are cut from large slabs and when freed go on a free list for
+// their size, ready for the next buffer that wants one.  Anything bigger is
+// mapped from the system on its own and unmapped as soon as it is freed, so
+// killing a buffer holding a large file gives the memory straight back.
+//
+// Use it through PoolAllocator, e.g. as the Container of a gap buffer:
+//
+//     Buffer<char, 80, std::vector<char, PoolAllocator<char>>> buffer;
+
+#ifndef _POOL_H_
+#define _POOL_H_
+
+#include <cstddef>
+#include <mutex>
+#include <new>
+
+class Pool {
+public:
+    static const std::size_t MINBITS = 6;
+    static const std::size_t MAXBITS = 20;
+    static const std::size_t MINBLOCK = std::size_t(1) << MINBITS;
+    static const std::size_t MAXBLOCK = std::size_t(1) << MAXBITS;
+    static const std::size_t SLABSIZE = std::size_t(4) << MAXBITS;
+
+    // The pool every PoolAllocator uses.
+    static Pool& instance();
+
+    Pool(const Pool&) = delete;
+    Pool& operator=(const Pool&) = delete;
+
+    // Returns a block of at least bytes bytes aligned for any type of size
+    // MINBLOCK or less.  Throws std::bad_alloc if there is no memory.
+    void* allocate(std::size_t bytes);
+
+    // p must have come from allocate(bytes) with the same value of bytes.
+    void deallocate(void* p, std::size_t bytes);
+
+    // How many bytes are in use by callers, held on free lists for reuse and
+    // mapped from the system altogether.
+    std::size_t used() const;
+    std::size_t cached() const;
+    std::size_t mapped() const;
+
+private:
+    static const std::size_t CLASSES = MAXBITS - MINBITS + 1;
+
+    struct Free {
+        Free* next;
+    };
+
+    Free*              _free[CLASSES];
+    char*              _slab;      // The unused end of the current slab.
+    std::size_t        _slabLeft;
+    std::size_t        _used;
+    std::size_t        _cached;
+    std::size_t        _mapped;
+    mutable std::mutex _mutex;
+
+    Pool();
+
+    static std::size_t sizeClass(std::size_t bytes);
+    static void* map(std::size_t bytes);
+    static void unmap(void* p, std::size_t bytes);
+    void refill(std::size_t sizeClass);
+};
+
+// An allocator for the standard containers which takes its memory from
+// Pool::instance().  It has no state so any two of them are interchangeable.
+template<typename T>
+class PoolAllocator {
+public:
+    using value_type = T;
+
+    PoolAllocator() noexcept {
+    }
+
+    template<typename U>
+    PoolAllocator(const PoolAllocator<U>& /*that*/) noexcept {
+    }
+
+    T* allocate(std::size_t n) {
+        if (n > static_cast<std::size_t>(-1) / sizeof(T)) {
+            throw std::bad_alloc();
+        }
+        return static_cast<T*>(Pool::instance().allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, std::size_t n) noexcept {
+        Pool::instance().deallocate(p, n * sizeof(T));
+    }
+};
+
+template<typename T, typename U>
+bool operator==(const PoolAllocator<T>&, const PoolAllocator<U>&) {
+    return true;
+}
+
+template<typename T, typename U>
+bool operator!=(const PoolAllocator<T>&, const PoolAllocator<U>&) {
+    return false;
+}
+
+#endif
@@ -0,0 +1,300 @@
+// Scan -- byte scanning kernels for a simple text editor (Implementation)
+//
+// By Jaldhar H. Vyas <jaldhar@braincells.com>
+// Copyright (C) 2017, Consolidated Braincells Inc. All rights reserved.
+// "Do what thou wilt" shall be the whole of the license.
+
+#include <cstdint>
+#include <cstring>
+using namespace std;
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SCAN_X86
+#include <immintrin.h>
+#endif
+
+#include "scan.h"
+
+using FIND = const char* (*)(const char*, const char*, char);
+using COUNT = size_t (*)(const char*, const char*, char);
+using FINDPAIR = const char* (*)(const char*, const char*, char, char, size_t);
+
+struct Kernel {
+    const char* name;
+    FIND        find;
+    FIND        findLast;
+    COUNT       count;
+    FINDPAIR    findPair;
+};
+
+static const char* findScalar(const char* first, const char* last, char c) {
+    for (; first != last; first++) {
+        if (*first == c) {
+            return first;
+        }
+    }
+    return last;
+}
+
+static const char* findLastScalar(const char* first, const char* last,
+char c) {
+    for (const char* i = last; i != first;) {
+        if (*--i == c) {
+            return i;
+        }
+    }
+    return last;
+}
+
+static size_t countScalar(const char* first, const char* last, char c) {
+    size_t count = 0;
+    for (; first != last; first++) {
+        count += (*first == c);
+    }
+    return count;
+}
+
+static const char* findPairScalar(const char* first, const char* last,
+char a, char b, size_t distance) {
+    for (const char* i = first; last - i > static_cast<ptrdiff_t>(distance);
+    i++) {
+        if (*i == a && i[distance] == b) {
+            return i;
+        }
+    }
+    return last;
+}
+
+#ifdef SCAN_X86
+
+// SSE2 is part of x86-64 but not necessarily of 32 bit x86 so it still has to
+// be asked for.
+__attribute__((target("sse2")))
+static const char* findSSE2(const char* first, const char* last, char c) {
+    const __m128i needle = _mm_set1_epi8(c);
+
+    for (; last - first >= 16; first += 16) {
+        __m128i block =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(first));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, needle));
+        if (mask) {
+            return first + __builtin_ctz(mask);
+        }
+    }
+    return findScalar(first, last, c);
+}
+
+__attribute__((target("sse2")))
+static const char* findLastSSE2(const char* first, const char* last, char c) {
+    const __m128i needle = _mm_set1_epi8(c);
+    const char* i = last;
+
+    for (; i - first >= 16; i -= 16) {
+        __m128i block =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(i - 16));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, needle));
+        if (mask) {
+            return i - 16 + (31 - __builtin_clz(mask));
+        }
+    }
+
+    const char* found = findLastScalar(first, i, c);
+    return (found == i) ? last : found;
+}
+
+// Matches are counted in per-byte counters (each match subtracts -1) which
+// are folded into 64 bit sums with psadbw before they can overflow.
+__attribute__((target("sse2")))
+static size_t countSSE2(const char* first, const char* last, char c) {
+    const __m128i needle = _mm_set1_epi8(c);
+    const __m128i zero = _mm_setzero_si128();
+    __m128i sums = zero;
+
+    while (last - first >= 16) {
+        __m128i counts = zero;
+        for (int n = 0; n < 255 && last - first >= 16; n++, first += 16) {
+            __m128i block =
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(first));
+            counts = _mm_sub_epi8(counts, _mm_cmpeq_epi8(block, needle));
+        }
+        sums = _mm_add_epi64(sums, _mm_sad_epu8(counts, zero));
+    }
+
+    uint64_t total[2];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(total), sums);
+    return total[0] + total[1] + countScalar(first, last, c);
+}
+
+// Each block of starting places is compared with a and the block distance
+// further on with b, so one test covers both ends of 16 candidates.
+__attribute__((target("sse2")))
+static const char* findPairSSE2(const char* first, const char* last, char a,
+char b, size_t distance) {
+    const __m128i first8 = _mm_set1_epi8(a);
+    const __m128i last8 = _mm_set1_epi8(b);
+
+    for (; last - first >= static_cast<ptrdiff_t>(distance + 16);
+    first += 16) {
+        __m128i start =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(first));
+        __m128i end = _mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(first + distance));
+        int mask = _mm_movemask_epi8(_mm_and_si128(
+            _mm_cmpeq_epi8(start, first8), _mm_cmpeq_epi8(end, last8)));
+        if (mask) {
+            return first + __builtin_ctz(mask);
+        }
+    }
+    return findPairScalar(first, last, a, b, distance);
+}
+
+__attribute__((target("avx2")))
+static const char* findAVX2(const char* first, const char* last, char c) {
+    const __m256i needle = _mm256_set1_epi8(c);
+
+    for (; last - first >= 64; first += 64) {
+        __m256i a =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(first));
+        __m256i b =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(first + 32));
+        uint32_t lo = _mm256_movemask_epi8(_mm256_cmpeq_epi8(a, needle));
+        uint32_t hi = _mm256_movemask_epi8(_mm256_cmpeq_epi8(b, needle));
+        if (lo | hi) {
+            uint64_t mask = (uint64_t(hi) << 32) | lo;
+            return first + __builtin_ctzll(mask);
+        }
+    }
+    return findSSE2(first, last, c);
+}
+
+__attribute__((target("avx2")))
+static const char* findLastAVX2(const char* first, const char* last, char c) {
+    const __m256i needle = _mm256_set1_epi8(c);
+    const char* i = last;
+
+    for (; i - first >= 64; i -= 64) {
+        __m256i a =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(i - 64));
+        __m256i b =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(i - 32));
+        uint32_t lo = _mm256_movemask_epi8(_mm256_cmpeq_epi8(a, needle));
+        uint32_t hi = _mm256_movemask_epi8(_mm256_cmpeq_epi8(b, needle));
+        if (lo | hi) {
+            uint64_t mask = (uint64_t(hi) << 32) | lo;
+            return i - 64 + (63 - __builtin_clzll(mask));
+        }
+    }
+
+    const char* found = findLastSSE2(first, i, c);
+    return (found == i) ? last : found;
+}
+
+__attribute__((target("avx2")))
+static size_t countAVX2(const char* first, const char* last, char c) {
+    const __m256i needle = _mm256_set1_epi8(c);
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i sums = zero;
+
+    while (last - first >= 32) {
+        __m256i counts = zero;
+        for (int n = 0; n < 255 && last - first >= 32; n++, first += 32) {
+            __m256i block =
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(first));
+            counts = _mm256_sub_epi8(counts, _mm256_cmpeq_epi8(block, needle));
+        }
+        sums = _mm256_add_epi64(sums, _mm256_sad_epu8(counts, zero));
+    }
+
+    uint64_t total[4];
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(total), sums);
+    return total[0] + total[1] + total[2] + total[3] +
+        countSSE2(first, last, c);
+}
+
+__attribute__((target("avx2")))
+static const char* findPairAVX2(const char* first, const char* last, char a,
+char b, size_t distance) {
+    const __m256i first8 = _mm256_set1_epi8(a);
+    const __m256i last8 = _mm256_set1_epi8(b);
+
+    for (; last - first >= static_cast<ptrdiff_t>(distance + 32);
+    first += 32) {
+        __m256i start =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(first));
+        __m256i end = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(first + distance));
+        uint32_t mask = _mm256_movemask_epi8(_mm256_and_si256(
+            _mm256_cmpeq_epi8(start, first8), _mm256_cmpeq_epi8(end, last8)));
+        if (mask) {
+            return first + __builtin_ctz(mask);
+        }
+    }
+    return findPairSSE2(first, last, a, b, distance);
+}
+
+#endif
+
+static const Kernel kernels[] = {
+#ifdef SCAN_X86
+    { "avx2", findAVX2, findLastAVX2, countAVX2, findPairAVX2 },
+    { "sse2", findSSE2, findLastSSE2, countSSE2, findPairSSE2 },
+#endif
+    { "scalar", findScalar, findLastScalar, countScalar, findPairScalar },
+};
+
+static bool supported(const Kernel& kernel) {
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+    if (strcmp(kernel.name, "avx2") == 0) {
+        return __builtin_cpu_supports("avx2");
+    }
+    if (strcmp(kernel.name, "sse2") == 0) {
+        return __builtin_cpu_supports("sse2");
+    }
+#endif
+    return true;
+}
+
+// The kernels are listed fastest first so the first one that will run is the
+// one to use.
+static const Kernel* best() {
+    for (auto& kernel: kernels) {
+        if (supported(kernel)) {
+            return &kernel;
+        }
+    }
+    return &kernels[sizeof(kernels) / sizeof(kernels[0]) - 1];
+}
+
+static const Kernel* current = best();
+
+const char* scanFind(const char* first, const char* last, char c) {
+    return current->find(first, last, c);
+}
+
+const char* scanFindLast(const char* first, const char* last, char c) {
+    return current->findLast(first, last, c);
+}
+
+size_t scanCount(const char* first, const char* last, char c) {
+    return current->count(first, last, c);
+}
+
+const char* scanFindPair(const char* first, const char* last, char a, char b,
+size_t distance) {
+    return current->findPair(first, last, a, b, distance);
+}
+
+const char* scanKernel() {
+    return current->name;
+}
+
+bool scanUseKernel(const char* name) {
+    for (auto& k: kernels) {
+        if (strcmp(k.name, name) == 0 && supported(k)) {
+            current = &k;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,73 @@
+// Scan -- byte scanning kernels for a simple text editor (Interface)
+//
+// By Jaldhar H. Vyas <jaldhar@braincells.com>
+// Copyright (C) 2017, Consolidated Braincells Inc. All rights reserved.
+// "Do what thou wilt" shall be the whole of the license.
+//
+// Searching and counting within a contiguous run of characters.  On x86 the
+// char versions use SSE2 or AVX2 whichever the CPU supports (decided once at
+// startup), elsewhere they are plain loops.  The templates are there so
+// Buffer<T> can call the same names for any T; overload resolution picks the
+// fast version when T is char.
+
+#ifndef _SCAN_H_
+#define _SCAN_H_
+
+#include <algorithm>
+#include <cstddef>
+
+// The first c in [first, last) or last if there is none.
+const char* scanFind(const char* first, const char* last, char c);
+
+// The last c in [first, last) or last if there is none.
+const char* scanFindLast(const char* first, const char* last, char c);
+
+// The number of c in [first, last).
+std::size_t scanCount(const char* first, const char* last, char c);
+
+// The first place p in [first, last - distance) where p[0] is a and
+// p[distance] is b, or last if there is none.  Finds where a string that
+// starts with a and ends with b might be.
+const char* scanFindPair(const char* first, const char* last, char a, char b,
+    std::size_t distance);
+
+// The name of the kernel in use: "avx2", "sse2" or "scalar".
+const char* scanKernel();
+
+// Switches to the named kernel.  Returns false (and changes nothing) if it
+// does not exist or the CPU can't run it.  Meant for benchmarks and tests.
+bool scanUseKernel(const char* name);
+
+template<typename T>
+const T* scanFind(const T* first, const T* last, const T& c) {
+    return std::find(first, last, c);
+}
+
+template<typename T>
+const T* scanFindLast(const T* first, const T* last, const T& c) {
+    for (const T* i = last; i != first;) {
+        if (*--i == c) {
+            return i;
+        }
+    }
+    return last;
+}
+
+template<typename T>
+const T* scanFindPair(const T* first, const T* last, const T& a, const T& b,
+std::size_t distance) {
+    for (const T* i = first; static_cast<std::size_t>(last - i) > distance;
+    i++) {
+        if (*i == a && i[distance] == b) {
+            return i;
+        }
+    }
+    return last;
+}
+
+template<typename T>
+std::size_t scanCount(const T* first, const T* last, const T& c) {
+    return std::count(first, last, c);
+}
+
+#endif
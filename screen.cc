@@ -0,0 +1,579 @@
+// Screen -- what the terminal of a simple text editor shows (Implementation)
+//
+// By Jaldhar H. Vyas <jaldhar@braincells.com>
+// Copyright (C) 2017, Consolidated Braincells Inc. All rights reserved.
+// "Do what thou wilt" shall be the whole of the license.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+using namespace std;
+
+#include <curses.h>
+#include <term.h>
+
+#include "screen.h"
+
+// Cells which are already right are written again rather than moved past if
+// there are no more than this many of them in a row.
+static const size_t GAP = 4;
+
+// Characters are only inserted or deleted to shift the rest of a row along
+// if at least this many cells don't have to be written again because of it.
+static const size_t MINSHIFT = 4;
+
+// What is about to be sent to the terminal.
+static string* _output;
+
+static int output(int c) {
+    _output->push_back(static_cast<char>(c));
+    return c;
+}
+
+// What capability, whose parameters are filled in already, sends.  Nothing if
+// the terminal doesn't have it.
+static string expand(const char* capability) {
+    string sequence;
+    if (capability != nullptr) {
+        string* saved = _output;
+        _output = &sequence;
+        tputs(capability, 1, output);
+        _output = saved;
+    }
+    return sequence;
+}
+
+static const char* param(const char* capability, size_t a, size_t b = 0) {
+    return (capability != nullptr) ?
+        tiparm(capability, static_cast<int>(a), static_cast<int>(b)) :
+        nullptr;
+}
+
+// The shorter of what once sends n times and what parameterized sends for n.
+static string repeat(const char* parameterized, const char* once, size_t n) {
+    string sequence;
+    if (once != nullptr) {
+        string one = expand(once);
+        for (size_t i = 0; i < n; i++) {
+            sequence += one;
+        }
+    }
+    if (parameterized != nullptr) {
+        string all = expand(param(parameterized, n));
+        if (sequence.empty() || all.size() < sequence.size()) {
+            sequence = all;
+        }
+    }
+    return sequence;
+}
+
+Screen::Screen(FILE* terminal) : _terminal{terminal}, _shown(), _next(),
+_rows{0}, _cols{0}, _background{A_NORMAL}, _cleared{false}, _cursorRow{0},
+_cursorColumn{0}, _row{npos}, _column{npos}, _attributes{A_NORMAL},
+_lastRow{npos}, _lastColumn{0} {
+}
+
+void Screen::resize(size_t rows, size_t cols, attr_t background) {
+    _rows = rows;
+    _cols = cols;
+    _background = background;
+    _shown.assign(rows * cols, space(background));
+    _next.assign(rows * cols, space(background));
+    _cleared = false;
+    _cursorRow = 0;
+    _cursorColumn = 0;
+    _row = npos;
+    _column = npos;
+    _lastRow = npos;
+}
+
+size_t Screen::rows() const {
+    return _rows;
+}
+
+size_t Screen::cols() const {
+    return _cols;
+}
+
+void Screen::blank(size_t row, size_t column, attr_t attributes) {
+    if (row >= _rows || column >= _cols) {
+        return;
+    }
+
+    Cell* cells = &_next[row * _cols];
+    if (column > 0 && cells[column]._length == 0) {
+        cells[column - 1] = space(cells[column - 1]._attributes);
+    }
+    fill(cells + column, cells + _cols, space(attributes));
+}
+
+// Writing over half of a character two columns wide leaves the other half
+// blank.
+void Screen::put(size_t row, size_t column, const char* bytes,
+size_t length, size_t width, attr_t attributes) {
+    if (row >= _rows) {
+        return;
+    }
+
+    Cell* cells = &_next[row * _cols];
+    if (width == 0) {
+        if (row == _lastRow) {
+            Cell& cell = cells[_lastColumn];
+            if (cell._length + length <= CELLBYTES) {
+                memcpy(cell._bytes + cell._length, bytes, length);
+                cell._length += length;
+            }
+        }
+        return;
+    }
+    width = min<size_t>(width, 2);
+    if (column + width > _cols || length > CELLBYTES) {
+        return;
+    }
+
+    if (column > 0 && cells[column]._length == 0) {
+        cells[column - 1] = space(cells[column - 1]._attributes);
+    }
+    if (column + width < _cols && cells[column + width]._length == 0) {
+        cells[column + width] = space(cells[column + width]._attributes);
+    }
+    Cell& cell = cells[column];
+    cell._attributes = attributes;
+    cell._length = length;
+    memcpy(cell._bytes, bytes, length);
+    if (width == 2) {
+        cells[column + 1] = Cell{ attributes, 0, {} };
+    }
+    _lastRow = row;
+    _lastColumn = column;
+}
+
+void Screen::cursor(size_t row, size_t column) {
+    _cursorRow = row;
+    _cursorColumn = column;
+}
+
+// If the terminal can't be cleared, what is on it isn't known so every cell
+// has to be written.  Nothing is ever shown invisibly so that is what they
+// are taken to be until then.
+size_t Screen::update() {
+    string sent;
+    _output = &sent;
+
+    if (!_cleared) {
+        attributes(_background);
+        string clearScreen = expand(clear_screen);
+        if (!clearScreen.empty()) {
+            sent += clearScreen;
+            fill(_shown.begin(), _shown.end(), erased(_attributes));
+            _row = 0;
+            _column = 0;
+        } else {
+            fill(_shown.begin(), _shown.end(), space(A_INVIS));
+        }
+        _cleared = true;
+    }
+
+    scrollRows();
+    for (size_t row = 0; row < _rows; row++) {
+        shiftCells(row);
+        updateRow(row);
+    }
+    if (_cursorRow < _rows && _cursorColumn < _cols) {
+        moveTo(_cursorRow, _cursorColumn);
+    }
+
+    if (!sent.empty()) {
+        fwrite(sent.data(), 1, sent.size(), _terminal);
+        fflush(_terminal);
+    }
+    _output = nullptr;
+    return sent.size();
+}
+
+Screen::Cell Screen::space(attr_t attributes) {
+    return Cell{ attributes, 1, { ' ' } };
+}
+
+// What a cell which is erased while writing in attributes ends up as.  Only
+// terminals which erase in the current background color keep its color.
+Screen::Cell Screen::erased(attr_t attributes) {
+    return space(back_color_erase ? (attributes & A_COLOR) : A_NORMAL);
+}
+
+bool Screen::same(const Cell& a, const Cell& b) {
+    return a._attributes == b._attributes && a._length == b._length &&
+        memcmp(a._bytes, b._bytes, a._length) == 0;
+}
+
+// FNV-1a.
+uint64_t Screen::hash(const Cell* row, size_t cols) {
+    uint64_t h = UINT64_C(14695981039346656037);
+    auto add = [&h](unsigned char byte) {
+        h = (h ^ byte) * UINT64_C(1099511628211);
+    };
+
+    for (size_t i = 0; i < cols; i++) {
+        const Cell& cell = row[i];
+        for (size_t j = 0; j < sizeof(cell._attributes); j++) {
+            add(static_cast<unsigned char>(cell._attributes >> (8 * j)));
+        }
+        add(cell._length);
+        for (size_t j = 0; j < cell._length; j++) {
+            add(cell._bytes[j]);
+        }
+    }
+    return h;
+}
+
+void Screen::attributes(attr_t attributes) {
+    if (attributes != _attributes) {
+        vidputs(attributes, output);
+        _attributes = attributes;
+    }
+}
+
+// Every way the terminal has of getting there which is likely to be short is
+// tried and the shortest is used.  Some terminals can't move the cursor while
+// underlining and so on, so that is turned off first.
+void Screen::moveTo(size_t row, size_t column) {
+    if (row == _row && column == _column) {
+        return;
+    }
+
+    if (!move_standout_mode && (_attributes & ~A_COLOR) != 0) {
+        attributes(_attributes & A_COLOR);
+    }
+    *_output += movement(_row, _column, row, column);
+    _row = row;
+    _column = column;
+}
+
+// The shortest sequence which moves the cursor from fromRow and fromColumn
+// (npos if that isn't known) to row and column.  Nothing if it is there
+// already.
+string Screen::movement(size_t fromRow, size_t fromColumn, size_t row,
+size_t column) const {
+    if (row == fromRow && column == fromColumn) {
+        return string();
+    }
+
+    string best = expand(param(cursor_address, row, column));
+    auto consider = [&best](const string& sequence) {
+        if (!sequence.empty() &&
+        (best.empty() || sequence.size() < best.size())) {
+            best = sequence;
+        }
+    };
+
+    if (fromRow == row) {
+        string home = expand(carriage_return);
+        if (column == 0) {
+            consider(home);
+        } else if (!home.empty()) {
+            consider(home + repeat(parm_right_cursor, cursor_right, column));
+        }
+        consider(expand(param(column_address, column)));
+        if (column > fromColumn) {
+            consider(repeat(parm_right_cursor, cursor_right,
+                column - fromColumn));
+        } else {
+            consider(repeat(parm_left_cursor, cursor_left,
+                fromColumn - column));
+        }
+    } else if (fromRow != npos && fromColumn == column) {
+        // A newline may well be taken as a return as well.
+        const char* down = (cursor_down != nullptr &&
+            strcmp(cursor_down, "\n") != 0) ? cursor_down : nullptr;
+        consider(expand(param(row_address, row)));
+        if (row < fromRow) {
+            consider(repeat(parm_up_cursor, cursor_up, fromRow - row));
+        } else {
+            consider(repeat(parm_down_cursor, down, row - fromRow));
+        }
+    }
+    return best;
+}
+
+// Finds how far the rows which have changed would have to be scrolled to put
+// as many of them as possible where they need to be, and scrolls them that
+// far, either by setting a scroll region or by deleting lines from one end
+// of them and inserting as many at the other, whichever is shorter.  Blank
+// rows don't count as they are cheap to write anyway.
+void Screen::scrollRows() {
+    if (_rows < 2) {
+        return;
+    }
+
+    vector<uint64_t> shown(_rows);
+    vector<uint64_t> next(_rows);
+    size_t top = npos;
+    size_t bottom = 0;
+    for (size_t row = 0; row < _rows; row++) {
+        shown[row] = hash(&_shown[row * _cols], _cols);
+        next[row] = hash(&_next[row * _cols], _cols);
+        if (shown[row] != next[row]) {
+            if (top == npos) {
+                top = row;
+            }
+            bottom = row;
+        }
+    }
+    if (top == npos || top == bottom) {
+        return;
+    }
+
+    vector<Cell> blankRow(_cols, space(_background));
+    uint64_t empty = hash(blankRow.data(), _cols);
+    // How many rows would be right if [top, bottom] were scrolled up by by
+    // rows, or down if up is false.
+    auto right = [&shown, &next, top, bottom, empty](size_t by, bool up) {
+        size_t count = 0;
+        for (size_t row = top; row <= bottom; row++) {
+            if (up ? row + by > bottom : row < top + by) {
+                continue;
+            }
+            size_t from = up ? row + by : row - by;
+            if (next[row] != empty && next[row] == shown[from]) {
+                count++;
+            }
+        }
+        return count;
+    };
+
+    size_t most = right(0, true);
+    size_t by = 0;
+    bool up = true;
+    for (size_t distance = 1; distance <= bottom - top; distance++) {
+        for (bool direction: { true, false }) {
+            size_t count = right(distance, direction);
+            if (count > most) {
+                most = count;
+                by = distance;
+                up = direction;
+            }
+        }
+    }
+    if (by == 0) {
+        return;
+    }
+
+    size_t last = _rows - 1;
+    string region;
+    string shift = up ? repeat(parm_index, scroll_forward, by) :
+        repeat(parm_rindex, scroll_reverse, by);
+    if (change_scroll_region != nullptr && !shift.empty()) {
+        bool whole = (top == 0 && bottom == last);
+        if (!whole) {
+            region += expand(param(change_scroll_region, top, bottom));
+        }
+        // Setting a region may move the cursor anywhere.
+        region += whole ? movement(_row, _column, up ? bottom : top, 0) :
+            expand(param(cursor_address, up ? bottom : top, 0));
+        region += shift;
+        if (!whole) {
+            region += expand(param(change_scroll_region, 0, last));
+        }
+    }
+
+    // Deleting and inserting lines leaves the cursor where it can be found.
+    string edit;
+    size_t editRow = top;
+    string remove = repeat(parm_delete_line, delete_line, by);
+    string insert = repeat(parm_insert_line, insert_line, by);
+    if (!remove.empty() && !insert.empty()) {
+        if (up) {
+            edit = movement(_row, _column, top, 0) + remove;
+            if (bottom < last) {
+                editRow = bottom - by + 1;
+                edit += movement(top, 0, editRow, 0) + insert;
+            }
+        } else {
+            size_t row = _row;
+            size_t column = _column;
+            if (bottom < last) {
+                row = bottom - by + 1;
+                column = 0;
+                edit = movement(_row, _column, row, column) + remove;
+            }
+            edit += movement(row, column, top, 0) + insert;
+        }
+    }
+
+    if (region.empty() && edit.empty()) {
+        return;
+    }
+    attributes(_background);
+    if (edit.empty() || (!region.empty() && region.size() < edit.size())) {
+        *_output += region;
+        _row = npos;
+        _column = npos;
+    } else {
+        *_output += edit;
+        _row = editRow;
+        _column = 0;
+    }
+
+    auto rowOf = [this](size_t row) {
+        return _shown.begin() + row * _cols;
+    };
+    if (up) {
+        copy(rowOf(top + by), rowOf(bottom + 1), rowOf(top));
+        fill(rowOf(bottom + 1 - by), rowOf(bottom + 1), erased(_attributes));
+    } else {
+        copy_backward(rowOf(top), rowOf(bottom + 1 - by), rowOf(bottom + 1));
+        fill(rowOf(top), rowOf(top + by), erased(_attributes));
+    }
+}
+
+// If a row is the same as it was but for some cells which have been inserted
+// or deleted at one place in it, the rest of it is shifted along to make
+// room for them or to close them up.
+void Screen::shiftCells(size_t row) {
+    Cell* shown = &_shown[row * _cols];
+    const Cell* next = &_next[row * _cols];
+    size_t first = 0;
+    while (first < _cols && same(shown[first], next[first])) {
+        first++;
+    }
+    if (first == _cols || shown[first]._length == 0) {
+        return;
+    }
+
+    // Whatever the row ends with is what is shifted in at the end.
+    const Cell& trailing = next[_cols - 1];
+    if (trailing._length == 0 || !same(shown[_cols - 1], trailing)) {
+        return;
+    }
+    size_t shownEnd = _cols;
+    size_t nextEnd = _cols;
+    while (shownEnd > first && same(shown[shownEnd - 1], trailing)) {
+        shownEnd--;
+    }
+    while (nextEnd > first && same(next[nextEnd - 1], trailing)) {
+        nextEnd--;
+    }
+
+    if (nextEnd > shownEnd) {
+        size_t n = nextEnd - shownEnd;
+        if (shownEnd - first < MINSHIFT || next[first + n]._length == 0 ||
+        !equal(next + first + n, next + nextEnd, shown + first, same)) {
+            return;
+        }
+        string insert = repeat(parm_ich, insert_character, n);
+        if (insert.empty()) {
+            return;
+        }
+        moveTo(row, first);
+        attributes(_background);
+        *_output += insert;
+        copy_backward(shown + first, shown + _cols - n, shown + _cols);
+        fill(shown + first, shown + first + n, erased(_attributes));
+    } else if (shownEnd > nextEnd) {
+        size_t n = shownEnd - nextEnd;
+        if (nextEnd - first < MINSHIFT || shown[first + n]._length == 0 ||
+        !equal(next + first, next + nextEnd, shown + first + n, same)) {
+            return;
+        }
+        string remove = repeat(parm_dch, delete_character, n);
+        if (remove.empty()) {
+            return;
+        }
+        moveTo(row, first);
+        attributes(_background);
+        *_output += remove;
+        copy(shown + first + n, shown + _cols, shown + first);
+        fill(shown + _cols - n, shown + _cols, erased(_attributes));
+    }
+}
+
+// Writes the runs of cells in row which aren't right yet.  If the rest of
+// the row is to be blank it is cleared in one go when that is shorter.  On a
+// terminal which scrolls when its last cell is written, that is left alone.
+void Screen::updateRow(size_t row) {
+    Cell* shown = &_shown[row * _cols];
+    const Cell* next = &_next[row * _cols];
+
+    size_t end = _cols;
+    if (row == _rows - 1 && auto_right_margin && !eat_newline_glitch) {
+        end--;
+        if (end > 0 && next[end]._length == 0) {
+            end--;
+        }
+    }
+
+    string clearLine = expand(clr_eol);
+    const Cell& trailing = next[_cols - 1];
+    size_t blankFrom = _cols;
+    if (!clearLine.empty() && (trailing._attributes & ~A_COLOR) == 0 &&
+    same(trailing, erased(trailing._attributes))) {
+        while (blankFrom > 0 && same(next[blankFrom - 1], trailing)) {
+            blankFrom--;
+        }
+    }
+
+    size_t column = 0;
+    while (column < _cols) {
+        if (same(shown[column], next[column])) {
+            column++;
+            continue;
+        }
+
+        size_t from = column;
+        while (from > 0 && (shown[from]._length == 0 ||
+        next[from]._length == 0)) {
+            from--;
+        }
+        size_t to = column + 1;
+        for (size_t i = to, gap = 0; i < _cols && gap <= GAP; i++) {
+            if (same(shown[i], next[i])) {
+                gap++;
+            } else {
+                gap = 0;
+                to = i + 1;
+            }
+        }
+        while (to < _cols && (shown[to]._length == 0 ||
+        next[to]._length == 0)) {
+            to++;
+        }
+
+        size_t start = max(from, blankFrom);
+        if (to > blankFrom && to - start > clearLine.size()) {
+            write(row, from, start);
+            moveTo(row, start);
+            attributes(trailing._attributes);
+            *_output += clearLine;
+            fill(shown + start, shown + _cols, erased(_attributes));
+            break;
+        }
+        write(row, from, min(to, end));
+        column = to;
+    }
+}
+
+// Writes the cells of row in [from, to).  Once the last column has been
+// written, where the cursor is depends on the terminal.
+void Screen::write(size_t row, size_t from, size_t to) {
+    if (from >= to) {
+        return;
+    }
+
+    Cell* shown = &_shown[row * _cols];
+    const Cell* next = &_next[row * _cols];
+    moveTo(row, from);
+    for (size_t i = from; i < to; i++) {
+        shown[i] = next[i];
+        if (next[i]._length == 0) {
+            continue;
+        }
+        attributes(next[i]._attributes);
+        _output->append(next[i]._bytes, next[i]._length);
+        _column += (i + 1 < _cols && next[i + 1]._length == 0) ? 2 : 1;
+    }
+    if (_column >= _cols) {
+        _row = npos;
+        _column = npos;
+    }
+}
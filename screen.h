@@ -0,0 +1,109 @@
+// Screen -- what the terminal of a simple text editor shows (Interface)
+//
+// By Jaldhar H. Vyas <jaldhar@braincells.com>
+// Copyright (C) 2017, Consolidated Braincells Inc. All rights reserved.
+// "Do what thou wilt" shall be the whole of the license.
+//
+// What is to be shown is painted into a frame in memory, a grid of cells each
+// holding a character and the attributes it is shown in, and update() sends
+// as little as it can to take the terminal from the frame it showed last to
+// that one.  Rows which have only moved up or down are scrolled instead of
+// being sent again, a row which has had characters inserted into it or
+// deleted from it has the rest of it shifted along, and only the runs of
+// cells which are still different after that are written, with the cursor
+// moved to each one by the shortest sequence the terminal knows.  Over a slow
+// connection the bytes sent are most of the time it takes for a key to show,
+// so update() says how many there were.
+//
+// Curses still reads keys and says what the terminal can do, but it doesn't
+// draw anything.
+//
+//     Screen screen;
+//     screen.resize(LINES, COLS, A_NORMAL);
+//     screen.put(0, 0, "x", 1, 1, A_BOLD);
+//     screen.cursor(0, 1);
+//     std::size_t sent = screen.update();
+
+#ifndef _SCREEN_H_
+#define _SCREEN_H_
+
+#include <curses.h>
+#include <cstddef>
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class Screen {
+public:
+    // Frames are sent to terminal, which curses has to have been set up
+    // for.
+    explicit Screen(std::FILE* terminal = stdout);
+
+    // Starts again with a terminal rows by cols which has to be cleared to
+    // background before anything else is shown on it.  Until they are
+    // painted, the cells of the next frame are blank in background too.
+    void resize(std::size_t rows, std::size_t cols, attr_t background);
+
+    std::size_t rows() const;
+    std::size_t cols() const;
+
+    // Blanks row of the next frame in attributes from column to the end.
+    void blank(std::size_t row, std::size_t column, attr_t attributes);
+
+    // Puts the character whose UTF-8 is the length bytes at bytes, and which
+    // is width columns wide, at row and column of the next frame.  One which
+    // is 0 columns wide goes with the character put before it.  Anything
+    // which doesn't fit is left out.
+    void put(std::size_t row, std::size_t column, const char* bytes,
+        std::size_t length, std::size_t width, attr_t attributes);
+
+    // Where the cursor is left after the next frame is shown.
+    void cursor(std::size_t row, std::size_t column);
+
+    // Makes the terminal show the next frame.  Returns how many bytes were
+    // sent to it.
+    std::size_t update();
+
+private:
+    static const std::size_t npos = -1;
+    static const std::size_t CELLBYTES = 11;
+
+    // The right half of a character two columns wide has no bytes of its
+    // own.
+    struct Cell {
+        attr_t        _attributes;
+        unsigned char _length;
+        char          _bytes[CELLBYTES];
+    };
+
+    std::FILE*        _terminal;
+    std::vector<Cell> _shown;       // What the terminal shows
+    std::vector<Cell> _next;        // and what it is to show.
+    std::size_t       _rows;
+    std::size_t       _cols;
+    attr_t            _background;
+    bool              _cleared;     // The terminal has been cleared.
+    std::size_t       _cursorRow;   // Where the cursor is to be left.
+    std::size_t       _cursorColumn;
+    std::size_t       _row;         // Where the cursor is, or npos if that
+    std::size_t       _column;      // isn't known.
+    attr_t            _attributes;  // What is being written in.
+    std::size_t       _lastRow;     // The cell put() put a character in last.
+    std::size_t       _lastColumn;
+
+    static Cell space(attr_t attributes);
+    static Cell erased(attr_t attributes);
+    static bool same(const Cell& a, const Cell& b);
+    static std::uint64_t hash(const Cell* row, std::size_t cols);
+    void attributes(attr_t attributes);
+    void moveTo(std::size_t row, std::size_t column);
+    std::string movement(std::size_t fromRow, std::size_t fromColumn,
+        std::size_t row, std::size_t column) const;
+    void scrollRows();
+    void shiftCells(std::size_t row);
+    void updateRow(std::size_t row);
+    void write(std::size_t row, std::size_t from, std::size_t to);
+};
+
+#endif
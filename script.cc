@@ -0,0 +1,192 @@
+// Script -- recorded keys for a text editor (Implementation)
+//
+// By Jaldhar H. Vyas <jaldhar@braincells.com>
+// Copyright (C) 2017, Consolidated Braincells Inc. All rights reserved.
+// "Do what thou wilt" shall be the whole of the license.
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+using namespace std;
+
+#include <curses.h>
+#include "file.h"
+#include "key.h"
+#include "script.h"
+
+Script::Script() : _keys(), _pastes(), _ungot(), _next{0}, _nextPaste{0},
+_beeps{0} {
+}
+
+// Reads filename.  Returns false and sets errno to EINVAL if it isn't a
+// proper script.
+bool Script::load(const string& filename) {
+    File file;
+    if (!file.open(filename)) {
+        return false;
+    }
+
+    _keys.clear();
+    _pastes.clear();
+    _ungot.clear();
+    _next = _nextPaste = 0;
+
+    // The mapping isn't terminated so it is parsed by hand rather than with
+    // strtol().
+    const char* p = file.begin();
+    const char* end = file.end();
+    auto number = [&p, end](size_t& n) {
+        const char* start = p;
+        n = 0;
+        while (p != end && *p >= '0' && *p <= '9') {
+            n = n * 10 + (*p++ - '0');
+        }
+        return p != start;
+    };
+
+    while (p != end) {
+        size_t c;
+        if (!number(c) || c > static_cast<size_t>(Key::PASTE)) {
+            errno = EINVAL;
+            return false;
+        }
+        _keys.push_back(static_cast<int>(c));
+
+        if (static_cast<int>(c) == Key::PASTE) {
+            size_t length;
+            if (p == end || *p++ != ' ' || !number(length) || p == end ||
+            *p++ != '\n' || static_cast<size_t>(end - p) < length) {
+                errno = EINVAL;
+                return false;
+            }
+            _pastes.emplace_back(p, length);
+            p += length;
+        }
+
+        if (p == end || *p++ != '\n') {
+            errno = EINVAL;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+size_t Script::keys() const {
+    return _keys.size();
+}
+
+size_t Script::position() const {
+    return _next;
+}
+
+size_t Script::beeps() const {
+    return _beeps;
+}
+
+void Script::beep() {
+    _beeps++;
+}
+
+int Script::get() {
+    if (!_ungot.empty()) {
+        int c = _ungot.back();
+        _ungot.pop_back();
+        return c;
+    }
+
+    return (_next < _keys.size()) ? _keys[_next++] : ERR;
+}
+
+int Script::poll() {
+    return get();
+}
+
+int Script::wait(int /*milliseconds*/) {
+    return get();
+}
+
+void Script::unget(int c) {
+    _ungot.push_back(c);
+}
+
+string Script::paste() {
+    return (_nextPaste < _pastes.size()) ? _pastes[_nextPaste++] : string();
+}
+
+Recorder::Recorder(KeySource& source) : _source(source), _file{nullptr},
+_ungot{0} {
+}
+
+Recorder::~Recorder() {
+    close();
+}
+
+bool Recorder::open(const string& filename) {
+    close();
+    _file = fopen(filename.c_str(), "w");
+
+    return _file != nullptr;
+}
+
+void Recorder::close() {
+    if (_file != nullptr) {
+        fclose(_file);
+    }
+    _file = nullptr;
+}
+
+void Recorder::beep() {
+    _source.beep();
+}
+
+int Recorder::get() {
+    return record(_source.get());
+}
+
+int Recorder::poll() {
+    return record(_source.poll());
+}
+
+int Recorder::wait(int milliseconds) {
+    return record(_source.wait(milliseconds));
+}
+
+void Recorder::unget(int c) {
+    _source.unget(c);
+    _ungot++;
+}
+
+// A paste is written when its text is read, not when PASTE is, as the text
+// has to follow the code on the same line.
+string Recorder::paste() {
+    string text = _source.paste();
+    if (_file != nullptr) {
+        fprintf(_file, "%d %zu\n", Key::PASTE, text.size());
+        fwrite(text.data(), 1, text.size(), _file);
+        fputc('\n', _file);
+        fflush(_file);
+    }
+
+    return text;
+}
+
+// Writes c to the script unless it is ERR (no key,) PASTE (see paste()) or
+// a key that was put back and so is already there.  Keys are written as
+// soon as they are read so a session that crashes is recorded up to the
+// crash.
+int Recorder::record(int c) {
+    if (c == ERR) {
+        return c;
+    }
+
+    if (_ungot > 0) {
+        _ungot--;
+    } else if (_file != nullptr && c != Key::PASTE) {
+        fprintf(_file, "%d\n", c);
+        fflush(_file);
+    }
+
+    return c;
+}
@@ -0,0 +1,81 @@
+// Script -- recorded keys for a text editor (Interface)
+//
+// By Jaldhar H. Vyas <jaldhar@braincells.com>
+// Copyright (C) 2017, Consolidated Braincells Inc. All rights reserved.
+// "Do what thou wilt" shall be the whole of the license.
+//
+// A script is a text file with one key per line, given by its code in
+// decimal.  A paste is the code of Key::PASTE, a space and the length of the
+// pasted text, then a newline followed by the text itself and another
+// newline.  A Recorder writes scripts of real sessions and a Script plays
+// them back without a terminal.
+
+#ifndef _SCRIPT_H_
+#define _SCRIPT_H_
+
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "keysource.h"
+
+// Keys read from a script.  The whole script is read in before it is played
+// so playing it costs no I/O.  Every key counts as typed ahead, i.e. poll()
+// never has to wait for the next one.
+class Script : public KeySource {
+public:
+    Script();
+
+    bool load(const std::string& filename);
+
+    // How many keys there are altogether and how many have been read.
+    std::size_t keys() const;
+    std::size_t position() const;
+
+    // How many times beep() has been called.
+    std::size_t beeps() const;
+
+    void beep() override;
+    int  get() override;
+    int  poll() override;
+    int  wait(int milliseconds) override;
+    void unget(int c) override;
+    std::string paste() override;
+
+private:
+    std::vector<int>         _keys;
+    std::vector<std::string> _pastes;  // The text of each PASTE in order.
+    std::vector<int>         _ungot;
+    std::size_t              _next;
+    std::size_t              _nextPaste;
+    std::size_t              _beeps;
+};
+
+// Passes keys through from another source, writing each one to a script as
+// it goes.
+class Recorder : public KeySource {
+public:
+    explicit Recorder(KeySource& source);
+    Recorder(const Recorder&) = delete;
+    Recorder& operator=(const Recorder&) = delete;
+    ~Recorder();
+
+    bool open(const std::string& filename);
+    void close();
+
+    void beep() override;
+    int  get() override;
+    int  poll() override;
+    int  wait(int milliseconds) override;
+    void unget(int c) override;
+    std::string paste() override;
+
+private:
+    KeySource&  _source;
+    std::FILE*  _file;
+    std::size_t _ungot;  // Keys put back which have been recorded already.
+
+    int record(int c);
+};
+
+#endif
@@ -0,0 +1,277 @@
+// Search -- finds strings in a text editor buffer
+//
+// By Jaldhar H. Vyas <jaldhar@braincells.com>
+// Copyright (C) 2017, Consolidated Braincells Inc. All rights reserved.
+// "Do what thou wilt" shall be the whole of the license.
+//
+// A string is looked for directly in the segments of a buffer (the text
+// either side of the gap, the pieces of a piece table or the pages of paged
+// text) so nothing is copied to search it.  Within a segment, char strings
+// are found with the scan kernels and anything else with Horspool's
+// algorithm.  Only a match that starts in one segment and ends in a later one
+// needs any extra work: the last n - 1 elements before each segment (for a
+// string of length n) are kept and searched together with the first n - 1 of
+// the segment.
+//
+// Works with any backend of Buffer:
+//
+//     Search<char> search("needle");
+//     std::size_t pos = search.forward(buffer, buffer.point());
+//
+// all() finds every match in a buffer at once by splitting it into chunks
+// which are searched by several threads at the same time.  Each chunk is
+// searched n - 1 elements past its end so no match is missed, but a match is
+// only kept by the chunk it starts in.
+
+#ifndef _SEARCH_H_
+#define _SEARCH_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include "scan.h"
+
+template<typename T>
+class Search {
+public:
+    using size_type = std::size_t;
+
+    static const size_type npos = -1;
+
+    Search() : _needle(), _skip() {
+        assign(nullptr, 0);
+    }
+
+    explicit Search(const std::basic_string<T>& needle) : _needle(),
+    _skip() {
+        assign(needle.data(), needle.size());
+    }
+
+    void assign(const T* needle, size_type n) {
+        _needle.assign(needle, needle + n);
+
+        // How far the window can move along when its last element is c: to
+        // the last place c is in the needle (not counting the end) or all
+        // the way past it if it isn't there.
+        std::fill(std::begin(_skip), std::end(_skip),
+            std::max(n, size_type(1)));
+        for (size_type i = 0; i + 1 < n; i++) {
+            _skip[bucket(_needle[i])] = n - 1 - i;
+        }
+    }
+
+    const std::vector<T>& needle() const {
+        return _needle;
+    }
+
+    bool empty() const {
+        return _needle.empty();
+    }
+
+    size_type size() const {
+        return _needle.size();
+    }
+
+    // The first match in [first, last) or last if there is none.
+    const T* find(const T* first, const T* last) const {
+        size_type n = _needle.size();
+        if (n == 1) {
+            return scanFind(first, last, _needle[0]);
+        }
+        if (n == 0 || static_cast<size_type>(last - first) < n) {
+            return last;
+        }
+        return find(first, last, std::is_same<T, char>());
+    }
+
+    // Calls fn(pos) with the position of each match in buffer that starts in
+    // [from, to), in order, until it returns false.  Matches can overlap.
+    template<typename B, typename F>
+    void each(const B& buffer, size_type from, size_type to, F fn) const {
+        size_type n = _needle.size();
+        size_type end = (to >= buffer.size()) ? buffer.size() :
+            std::min(buffer.size(), to + n - 1);
+        if (n == 0 || from >= end || end - from < n) {
+            return;
+        }
+
+        std::vector<T> carry;   // The n - 1 elements before the segment.
+        size_type pos = from;   // Where the segment starts.
+        buffer.for_each_segment(from, end,
+            [this, n, to, &carry, &pos, &fn](const T* data, size_type length) {
+                if (!carry.empty()) {
+                    size_type carried = carry.size();
+                    carry.insert(carry.end(), data,
+                        data + std::min(length, n - 1));
+                    if (!report(carry.data(), carry.data() + carry.size(),
+                    pos - carried, carried, to, fn)) {
+                        return false;
+                    }
+                    carry.resize(carried);
+                }
+
+                if (!report(data, data + length, pos, length, to, fn)) {
+                    return false;
+                }
+
+                if (length >= n - 1) {
+                    carry.assign(data + length - (n - 1), data + length);
+                } else {
+                    carry.insert(carry.end(), data, data + length);
+                    if (carry.size() > n - 1) {
+                        carry.erase(carry.begin(),
+                            carry.end() - (n - 1));
+                    }
+                }
+                pos += length;
+                return true;
+            });
+    }
+
+    // The position of the first match at or after pos, or npos.
+    template<typename B>
+    size_type forward(const B& buffer, size_type pos) const {
+        size_type match = npos;
+        each(buffer, pos, npos, [&match](size_type at) {
+            match = at;
+            return false;
+        });
+        return match;
+    }
+
+    // The position of the last match at or before pos, or npos.  The text
+    // is searched forwards in blocks going back from pos, each twice as big
+    // as the one before, so finding a match costs about as much as the
+    // distance to it.
+    template<typename B>
+    size_type backward(const B& buffer, size_type pos) const {
+        size_type match = npos;
+        size_type to = std::min(pos, buffer.size()) + 1;
+        size_type block = BLOCKSIZE;
+        while (match == npos && to > 0) {
+            size_type from = (to > block) ? to - block : 0;
+            each(buffer, from, to, [&match](size_type at) {
+                match = at;
+                return true;
+            });
+            to = from;
+            block *= 2;
+        }
+        return match;
+    }
+
+    // The positions of the matches in buffer, in order, leaving out any that
+    // overlap the one before (so they can all be replaced.)  The buffer is
+    // searched by up to threads threads, each of which takes the next chunk
+    // that hasn't been searched yet until there are none left, so a thread
+    // that gets easy chunks does more of them.  The buffer must not change
+    // and its for_each_segment() must be safe to call from several threads
+    // at once.
+    template<typename B>
+    std::vector<size_type> all(const B& buffer, unsigned threads) const {
+        size_type chunks = (buffer.size() + CHUNKSIZE - 1) / CHUNKSIZE;
+        std::vector<std::vector<size_type>> found(chunks);
+        std::atomic<size_type> next{0};
+
+        auto work = [this, &buffer, chunks, &found, &next]() {
+            size_type chunk;
+            while ((chunk = next++) < chunks) {
+                std::vector<size_type>& matches = found[chunk];
+                each(buffer, chunk * CHUNKSIZE, (chunk + 1) * CHUNKSIZE,
+                    [&matches](size_type at) {
+                        matches.push_back(at);
+                        return true;
+                    });
+            }
+        };
+
+        std::vector<std::thread> pool;
+        for (unsigned i = 1; i < threads && i < chunks; i++) {
+            pool.emplace_back(work);
+        }
+        work();
+        for (auto& thread: pool) {
+            thread.join();
+        }
+
+        std::vector<size_type> matches;
+        size_type end = 0;
+        for (auto& chunk: found) {
+            for (auto at: chunk) {
+                if (at >= end) {
+                    matches.push_back(at);
+                    end = at + _needle.size();
+                }
+            }
+        }
+        return matches;
+    }
+
+private:
+    static const size_type BLOCKSIZE = size_type(64) << 10;
+    static const size_type CHUNKSIZE = size_type(4) << 20;
+
+    std::vector<T> _needle;
+    size_type      _skip[256];
+
+    static size_type bucket(const T& c) {
+        return static_cast<size_type>(c) & 0xff;
+    }
+
+    // For char, the scan kernels look for places with the first and the last
+    // character of the needle the right distance apart, many places at a
+    // time, which in ordinary text rules out nearly all of them without
+    // looking any further.
+    const T* find(const T* first, const T* last, std::true_type) const {
+        size_type n = _needle.size();
+        const T* needle = _needle.data();
+        for (const T* p = first;
+        (p = scanFindPair(p, last, needle[0], needle[n - 1], n - 1)) != last;
+        p++) {
+            if (std::equal(needle + 1, needle + n - 1, p + 1)) {
+                return p;
+            }
+        }
+        return last;
+    }
+
+    // Otherwise, Horspool's algorithm.
+    const T* find(const T* first, const T* last, std::false_type) const {
+        size_type n = _needle.size();
+        const T* needle = _needle.data();
+        const T& end = needle[n - 1];
+        for (const T* p = first + (n - 1); p < last; ) {
+            if (*p == end && std::equal(needle, needle + n - 1,
+            p - (n - 1))) {
+                return p - (n - 1);
+            }
+            p += _skip[bucket(*p)];
+        }
+        return last;
+    }
+
+    // Calls fn for each match in [first, last), which is the text at
+    // position start, that starts in the first limit elements and before to.
+    // Returns false once there is no point looking any further.
+    template<typename F>
+    bool report(const T* first, const T* last, size_type start,
+    size_type limit, size_type to, F& fn) const {
+        for (const T* p = first; (p = find(p, last)) != last; p++) {
+            size_type offset = p - first;
+            if (offset >= limit) {
+                break;
+            }
+            if (start + offset >= to || !fn(start + offset)) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+#endif
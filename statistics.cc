@@ -0,0 +1,181 @@
+// Statistics -- how long commands take in a text editor (Implementation)
+//
+// By Jaldhar H. Vyas <jaldhar@braincells.com>
+// Copyright (C) 2017, Consolidated Braincells Inc. All rights reserved.
+// "Do what thou wilt" shall be the whole of the license.
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <string>
+using namespace std;
+
+#include "statistics.h"
+
+Statistics::Histogram::Histogram(const char* command) : _command{command},
+_count{0}, _total{0}, _max{0}, _buckets() {
+}
+
+void Statistics::Histogram::add(uint64_t us) {
+    size_t bucket = 0;
+    for (uint64_t i = us; i > 0 && bucket < BUCKETS - 1; i >>= 1) {
+        bucket++;
+    }
+
+    _buckets[bucket]++;
+    _count++;
+    _total += us;
+    _max = max(_max, us);
+}
+
+// The time under which at least p of the keys took, to the nearest bucket.
+uint64_t Statistics::Histogram::percentile(double p) const {
+    size_t wanted = static_cast<size_t>(p * _count);
+    size_t seen = 0;
+
+    for (size_t i = 0; i < BUCKETS; i++) {
+        seen += _buckets[i];
+        if (seen > wanted || seen == _count) {
+            return uint64_t(1) << i;
+        }
+    }
+    return uint64_t(1) << (BUCKETS - 1);
+}
+
+Statistics::Statistics() : _all("all"), _frames("frames"), _commands(),
+_pending() {
+}
+
+void Statistics::started(const char* command) {
+    _pending.emplace_back(find(command), clock::now());
+}
+
+void Statistics::painted() {
+    if (_pending.empty()) {
+        return;
+    }
+
+    auto now = clock::now();
+    for (auto& pending: _pending) {
+        uint64_t us = chrono::duration_cast<chrono::microseconds>(
+            now - pending.second).count();
+        _commands[pending.first].add(us);
+        _all.add(us);
+    }
+    _pending.clear();
+}
+
+// A frame which sent nothing left the terminal as it was, most often when
+// nothing had changed since the last one, and would only pull the
+// percentiles towards zero.
+void Statistics::sent(size_t bytes) {
+    if (bytes != 0) {
+        _frames.add(bytes);
+    }
+}
+
+static string bytes(size_t n) {
+    static const char* const units[] = { "B", "K", "M", "G", "T" };
+    double value = n;
+    size_t unit = 0;
+    while (value >= 1024 && unit < 4) {
+        value /= 1024;
+        unit++;
+    }
+
+    char text[32];
+    snprintf(text, sizeof(text), (unit == 0) ? "%.0f%s" : "%.1f%s", value,
+        units[unit]);
+    return text;
+}
+
+string Statistics::summary(const BufferCounters& counters) const {
+    const Histogram* slowest = nullptr;
+    for (auto& histogram: _commands) {
+        if (slowest == nullptr ||
+        histogram.percentile(0.99) > slowest->percentile(0.99)) {
+            slowest = &histogram;
+        }
+    }
+
+    char text[512];
+    int length = snprintf(text, sizeof(text),
+        "%zu keys p50<%" PRIu64 "us p99<%" PRIu64 "us max %" PRIu64 "us",
+        _all._count, _all.percentile(0.5), _all.percentile(0.99), _all._max);
+    if (slowest != nullptr) {
+        length += snprintf(text + length, sizeof(text) - length,
+            ", slowest %s p99<%" PRIu64 "us", slowest->_command,
+            slowest->percentile(0.99));
+    }
+    if (_frames._count != 0) {
+        length += snprintf(text + length, sizeof(text) - length,
+            " | %zu frames p50<%" PRIu64 "B p99<%" PRIu64 "B max %" PRIu64
+            "B", _frames._count, _frames.percentile(0.5),
+            _frames.percentile(0.99), _frames._max);
+    }
+    snprintf(text + length, sizeof(text) - length,
+        " | gap moves %zu (%s) reallocations %zu scanned %s",
+        counters._gapMoves, bytes(counters._gapBytes).c_str(),
+        counters._reallocations, bytes(counters._scanned).c_str());
+
+    return text;
+}
+
+// The buckets are listed in order; see BUCKETS for what each one covers.
+bool Statistics::write(const string& filename,
+const BufferCounters& counters) const {
+    FILE* file = fopen(filename.c_str(), "w");
+    if (file == nullptr) {
+        return false;
+    }
+
+    auto histogram = [file](const char* indent, const Histogram& h,
+    const char* unit) {
+        fprintf(file, "{\n%s  \"count\": %zu,\n", indent, h._count);
+        fprintf(file, "%s  \"mean_%s\": %.1f,\n", indent, unit,
+            h._count ? static_cast<double>(h._total) / h._count : 0.0);
+        fprintf(file, "%s  \"p50_%s\": %" PRIu64 ",\n", indent, unit,
+            h.percentile(0.5));
+        fprintf(file, "%s  \"p99_%s\": %" PRIu64 ",\n", indent, unit,
+            h.percentile(0.99));
+        fprintf(file, "%s  \"max_%s\": %" PRIu64 ",\n", indent, unit,
+            h._max);
+        fprintf(file, "%s  \"buckets\": [", indent);
+        for (size_t i = 0; i < BUCKETS; i++) {
+            fprintf(file, "%s%zu", i ? ", " : "", h._buckets[i]);
+        }
+        fprintf(file, "]\n%s}", indent);
+    };
+
+    fprintf(file, "{\n  \"keys\": ");
+    histogram("  ", _all, "us");
+    fprintf(file, ",\n  \"commands\": {");
+    for (size_t i = 0; i < _commands.size(); i++) {
+        fprintf(file, "%s\n    \"%s\": ", i ? "," : "",
+            _commands[i]._command);
+        histogram("    ", _commands[i], "us");
+    }
+    fprintf(file, "\n  },\n  \"frames\": ");
+    histogram("  ", _frames, "bytes");
+    fprintf(file, ",\n  \"buffers\": {\n");
+    fprintf(file, "    \"gap_moves\": %zu,\n", counters._gapMoves);
+    fprintf(file, "    \"gap_bytes\": %zu,\n", counters._gapBytes);
+    fprintf(file, "    \"reallocations\": %zu,\n", counters._reallocations);
+    fprintf(file, "    \"scanned\": %zu\n", counters._scanned);
+    fprintf(file, "  }\n}\n");
+
+    return fclose(file) == 0;
+}
+
+// The histogram for command, adding it if this is the first time.
+size_t Statistics::find(const char* command) {
+    for (size_t i = 0; i < _commands.size(); i++) {
+        if (strcmp(_commands[i]._command, command) == 0) {
+            return i;
+        }
+    }
+
+    _commands.emplace_back(command);
+    return _commands.size() - 1;
+}
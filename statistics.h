@@ -0,0 +1,75 @@
+// Statistics -- how long commands take in a text editor (Interface)
+//
+// By Jaldhar H. Vyas <jaldhar@braincells.com>
+// Copyright (C) 2017, Consolidated Braincells Inc. All rights reserved.
+// "Do what thou wilt" shall be the whole of the license.
+//
+// For each command, a histogram of the time from reading a key to having
+// painted the screen after it.  Times go into buckets by powers of two
+// microseconds, so recording one is a few arithmetic operations and the
+// histograms never grow.  The bytes sent to the terminal for each frame which
+// changed it go into one more histogram the same way.  Together with the
+// counters every Buffer keeps, they can be shown on the status line or written
+// out as JSON.
+
+#ifndef _STATISTICS_H_
+#define _STATISTICS_H_
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+#include "buffer.h"
+
+class Statistics {
+public:
+    using clock = std::chrono::steady_clock;
+
+    // Bucket 0 is under 1us (or 1 byte) and bucket i is from 2^(i-1) up to
+    // 2^i us.  The last one takes everything longer.
+    static const std::size_t BUCKETS = 32;
+
+    Statistics();
+
+    // A key has been read which is going to run command.
+    void started(const char* command);
+
+    // The screen has been painted, so every key started since the last time
+    // is done.
+    void painted();
+
+    // A frame has been shown, which took sending bytes to the terminal.  Ones
+    // which sent nothing aren't recorded.
+    void sent(std::size_t bytes);
+
+    // One line about all keys, the slowest command and counters.
+    std::string summary(const BufferCounters& counters) const;
+
+    // Writes everything as JSON to filename.
+    bool write(const std::string& filename,
+        const BufferCounters& counters) const;
+
+private:
+    struct Histogram {
+        const char*   _command;
+        std::size_t   _count;
+        std::uint64_t _total;   // In microseconds, or bytes for _frames.
+        std::uint64_t _max;
+        std::size_t   _buckets[BUCKETS];
+
+        explicit Histogram(const char* command);
+        void add(std::uint64_t us);
+        std::uint64_t percentile(double p) const;
+    };
+
+    Histogram                                      _all;
+    Histogram                                      _frames;
+    std::vector<Histogram>                         _commands;
+    std::vector<std::pair<std::size_t, clock::time_point>> _pending;
+
+    std::size_t find(const char* command);
+};
+
+#endif
@@ -5,119 +5,721 @@
 // "Do what thou wilt" shall be the whole of the license.
 
 #include <algorithm>
+#include <cctype>
+#include <cerrno>
 #include <cstdlib>
+#include <cstring>
 #include <iterator>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
 using namespace std;
 
+#include <curses.h>
+#include <unistd.h>
+#include "file.h"
 #include "subeditor.h"
+#include "utf8.h"
 
-Subeditor::Subeditor() : _buffer() {
+const char* const Subeditor::SCRATCH = "*scratch*";
+
+// Paged text reads in pages as they are needed so only one thread can look
+// at it at a time.  The other buffers can be searched by as many threads as
+// there are processors.
+static unsigned searchThreads() {
+#ifdef PAGED_TEXT
+    return 1;
+#else
+    return max(1u, thread::hardware_concurrency());
+#endif
+}
+
+// A piece table keeps a mapping of the file it was loaded from and paged text
+// reads pages from it, so that file can only be replaced when it is saved.  A
+// gap buffer has a copy of the text, so its file can be written over to keep
+// any other hard links to it.
+static bool overwriteFiles() {
+#if defined(PAGED_TEXT) || defined(PIECE_TABLE)
+    return false;
+#else
+    return true;
+#endif
+}
+
+// Keys which are typed into a line of input: printable ASCII and the bytes of
+// UTF-8 sequences, as with self_insert.
+static bool isText(int c) {
+    return (c >= 0x20 && c < 0x7f) || (c >= 0x80 && c <= 0xff);
+}
+
+// Where the last character of text starts.  Like everywhere else, a byte
+// which isn't part of a valid UTF-8 sequence is a character of its own; one
+// which is cut short is one too.
+static size_t lastCharacter(const string& text) {
+    const char* last = text.data() + text.size();
+    size_t start = 0;
+    for (size_t i = 0; i < text.size(); ) {
+        char32_t codepoint;
+        size_t length = utf8Decode(text.data() + i, last, codepoint);
+        start = i;
+        i += (length == 0) ? text.size() - i : length;
+    }
+    return start;
+}
+
+Subeditor::Save::Save(buffer_type::snapshot_type&& snapshot) :
+_snapshot(move(snapshot)), _thread(), _done{false}, _written{false},
+_error{0} {
+}
+
+Subeditor::Document::Document(const string& name, const string& filename) :
+_name{name}, _filename{filename}, _buffer(), _journal(), _save() {
+}
+
+// A buffer isn't gone until it has been saved.
+Subeditor::Document::~Document() {
+    if (_save) {
+        _save->_thread.join();
+    }
+}
+
+Subeditor::Subeditor() : _documents(), _buffer{nullptr}, _killRing(),
+_yankStart{buffer_type::npos}, _yankEnd{buffer_type::npos},
+_yankSize{buffer_type::npos}, _status(), _input(), _reading{false},
+_selections{0}, _statistics(), _killed(), _memoryLimit{0}, _recover{false},
+_search(),
+_searchString(), _lastSearch(), _searchSteps(), _searchOrigin{0},
+_unread{ERR}, _replaceFrom(), _truncateLines{false} {
+    select(create(SCRATCH, ""));
+}
+
+Subeditor::buffer_type& Subeditor::buffer() {
+    return *_buffer;
+}
+
+const string& Subeditor::name() const {
+    return _documents.front()._name;
+}
+
+const string& Subeditor::filename() const {
+    return _documents.front()._filename;
+}
+
+size_t Subeditor::buffers() const {
+    return _documents.size();
+}
+
+unsigned long Subeditor::selections() const {
+    return _selections;
+}
+
+BufferCounters Subeditor::counters() const {
+    BufferCounters counters = _killed;
+    for (auto& document: _documents) {
+        counters += document._buffer.counters();
+    }
+    return counters;
+}
+
+Statistics& Subeditor::statistics() {
+    return _statistics;
+}
+
+void Subeditor::memoryLimit(size_t bytes) {
+    _memoryLimit = bytes;
+#ifdef PAGED_TEXT
+    for (auto& document: _documents) {
+        document._buffer.memoryLimit(bytes);
+    }
+#endif
+}
+
+void Subeditor::recover(bool recover) {
+    _recover = recover;
+}
+
+const string& Subeditor::status() const {
+    return _status;
+}
+
+void Subeditor::message(const string& text) {
+    _status = text;
+}
+
+bool Subeditor::truncating() const {
+    return _truncateLines;
+}
+
+const Search<char>* Subeditor::searching() const {
+    return _searchSteps.empty() ? nullptr : &_search;
+}
+
+int Subeditor::unread() {
+    int c = _unread;
+    _unread = ERR;
+    return c;
+}
+
+// Reads filename into the current buffer.  A file that does not exist yet is
+// not an error; the buffer starts out empty and the file is created when it
+// is saved.  A piece table keeps the mapping of the file as its original text
+// so it is handed over along with the contents.  Paged text reads the file
+// itself, a page at a time.
+bool Subeditor::load(const string& filename) {
+#ifdef PAGED_TEXT
+    if (!_buffer->open(filename) && errno != ENOENT) {
+        return false;
+    }
+#else
+    auto file = make_shared<File>();
+
+    if (!file->open(filename)) {
+        if (errno != ENOENT) {
+            return false;
+        }
+    }
+
+    _buffer->assign(file->begin(), file->end(), file);
+#endif
+    _documents.front()._filename = filename;
+
+    return true;
+}
+
+// Makes the buffer for filename current, reading it into a new buffer first
+// if it isn't in one already.
+bool Subeditor::visit(const string& filename) {
+    for (auto i = _documents.begin(); i != _documents.end(); ++i) {
+        if (i->_filename == filename) {
+            select(i);
+            return true;
+        }
+    }
+
+    auto document = create(uniqueName(filename), filename);
+    auto previous = _documents.begin();
+    select(document);
+    if (!load(filename)) {
+        select(previous);
+        _documents.erase(document);
+        return false;
+    }
+    openJournal();
+
+    return true;
+}
+
+// Makes the buffer called name current, making a new empty one if there is
+// no such buffer.
+void Subeditor::switchTo(const string& name) {
+    auto document = find(name);
+    select(document != _documents.end() ? document : create(name, ""));
+}
+
+// Gets rid of the current buffer.  Its storage goes back to the pool and the
+// buffer used before it becomes current.  There is always at least one
+// buffer so if it was the last, an empty one takes its place.
+void Subeditor::kill() {
+    if (_documents.front()._save) {
+        finishSave(_documents.front());
+    }
+    _killed += _buffer->counters();
+    _documents.pop_front();
+    if (_documents.empty()) {
+        create(SCRATCH, "");
+    }
+    select(_documents.begin());
+}
+
+// A thread of its own writes a snapshot of the text, so however big it is the
+// buffer can go on being used meanwhile.  The text is written as it is
+// visited because paged text may not all be in memory at once.  A buffer
+// that isn't being journaled (because its file had a journal left behind)
+// can only start to be from the text that was saved, so in that case the
+// save is waited for.  So is an earlier save of the same buffer that hasn't
+// finished yet.
+bool Subeditor::save() {
+    Document& document = _documents.front();
+    if (document._filename.empty()) {
+        return false;
+    }
+
+    if (document._save) {
+        finishSave(document);
+    }
+
+    if (document._journal) {
+        document._journal->mark();
+    }
+    Save* save = new Save(_buffer->snapshot());
+    document._save.reset(save);
+    save->_thread = thread([save, filename = document._filename]() {
+        const buffer_type::snapshot_type& snapshot = save->_snapshot;
+        FileWriter writer;
+        try {
+            save->_written = writer.open(filename, overwriteFiles()) &&
+                snapshot.for_each_segment(0, snapshot.size(),
+                    [&writer](const char* data, size_t length) {
+                        return writer.write(data, length);
+                    }) &&
+                writer.commit();
+            save->_error = errno;
+        } catch (const system_error& e) {
+            save->_error = e.code().value();
+        }
+        save->_done.store(true, memory_order_release);
+    });
+
+    message("Saving " + document._filename + "...");
+    if (!document._journal) {
+        finishSave(document);
+    }
+    return true;
 }
 
-Buffer<char, Subeditor::BUFFERSIZE>& Subeditor::buffer() {
-    return _buffer;
+bool Subeditor::saving() const {
+    return any_of(_documents.begin(), _documents.end(),
+        [](const Document& document) {
+            return document._save != nullptr;
+        });
+}
+
+bool Subeditor::finishSaves() {
+    bool finished = false;
+    for (auto& document: _documents) {
+        if (document._save &&
+        document._save->_done.load(memory_order_acquire)) {
+            finishSave(document);
+            finished = true;
+        }
+    }
+    return finished;
+}
+
+// Inserts text at point as one change to the buffer.
+bool Subeditor::insert(const string& text) {
+    return _buffer->insert(text.begin(), text.end());
+}
+
+// Inserts text from a terminal paste.  Terminals send newlines as carriage
+// returns so those are put back.  A paste is undone by itself, not with
+// whatever was typed around it.
+bool Subeditor::paste(const string& text) {
+    string pasted;
+    pasted.reserve(text.size());
+    for (size_t i = 0; i < text.size(); i++) {
+        if (text[i] != '\r') {
+            pasted += text[i];
+        } else if (i + 1 == text.size() || text[i + 1] != '\n') {
+            pasted += '\n';
+        }
+    }
+
+    _buffer->undoBoundary();
+    bool inserted = insert(pasted);
+    _buffer->undoBoundary();
+
+    return inserted;
 }
 
 size_t Subeditor::point() {
-    return static_cast<size_t>(_buffer.point());
+    return static_cast<size_t>(_buffer->point());
 }
 
+// Inserts arg copies of c in one go.
 bool Subeditor::self_insert(bool& /*isArg*/, int& arg,
 bool& /*isExit*/, int c) {
     if (arg < 0) {
         arg = -arg;
     }
 
-    while (arg-- > 0) {
-        if (!_buffer.insert(c)) {
-            break;
-        }
-    }
-
-    return true;
+    return _buffer->insert(static_cast<size_t>(arg), c);
 }
 
 bool Subeditor::backward_char(bool& /*isArg*/, int& arg,
 bool& /*isExit*/, int /*c*/) {
-    arg = -1;
-    _buffer.pointMove(arg);
+    moveChars(-arg);
     return true;
 }
 
 bool Subeditor::forward_char(bool& /*isArg*/, int& arg,
 bool& /*isExit*/, int /*c*/) {
-    arg = 1;
-    _buffer.pointMove(arg);
+    moveChars(arg);
     return true;
 }
 
 bool Subeditor::backward_delete_char(bool& /*isArg*/, int& arg,
 bool& /*isExit*/, int /*c*/) {
+    deleteChars(-arg);
+    return true;
+}
+
+bool Subeditor::delete_char(bool& /*isArg*/, int& arg, bool& /*isExit*/,
+int /*c*/) {
+    deleteChars(arg);
+    return true;
+}
+
+bool Subeditor::beginning_of_line(bool& /*isArg*/, int& /*arg*/,
+bool& /*isExit*/, int /*c*/) {
+    _buffer->pointSet(_buffer->lineStart(_buffer->lineOf(_buffer->point())));
+
+    return true;
+}
+
+bool Subeditor::end_of_line(bool& /*isArg*/, int& /*arg*/, bool& /*isExit*/,
+int /*c*/) {
+    _buffer->pointSet(_buffer->lineEnd(_buffer->lineOf(_buffer->point())));
+
+    return true;
+}
+
+bool Subeditor::next_line(bool& /*isArg*/, int& arg, bool& /*isExit*/,
+int /*c*/) {
+    moveLines(arg);
+
+    return true;
+}
+
+bool Subeditor::previous_line(bool& /*isArg*/, int& arg, bool& /*isExit*/,
+int /*c*/) {
+    moveLines(-arg);
+
+    return true;
+}
+
+// M-g (ESC g).  Reads a line number terminated by Enter and moves to the
+// start of that line.  Called once for each key.  The line number is read
+// as input of its own, so a prefix argument doesn't change it.
+bool Subeditor::goto_line(bool& /*isArg*/, int& /*arg*/, bool& /*isExit*/,
+int c) {
+    switch (readInput("Goto line: ", c)) {
+        case Input::MORE:
+            return false;
+        case Input::DONE:
+            if (!_input.empty() &&
+            all_of(_input.begin(), _input.end(), ::isdigit)) {
+                gotoLine(strtoul(_input.c_str(), nullptr, 10));
+            } else if (!_input.empty()) {
+                message("Not a line number: " + _input);
+            }
+            break;
+        case Input::CANCEL:
+            break;
+    }
+
+    return true;
+}
+
+// Moves point to the start of line number n (counting from 1 as people
+// do.)  Line numbers past the end go to the last line.
+void Subeditor::gotoLine(size_t n) {
+    size_t line = min(max<size_t>(n, 1), _buffer->lines()) - 1;
+    _buffer->pointSet(_buffer->lineStart(line));
+}
+
+// Sets from and to to the ends of the region between point and mark.
+// Returns false if there is no mark or the region is empty.
+bool Subeditor::region(size_t& from, size_t& to) {
+    size_t point = _buffer->point();
+    size_t mark = _buffer->mark();
+    if (mark == buffer_type::npos) {
+        return false;
+    }
+
+    from = min(point, mark);
+    to = max(point, mark);
+    return from != to;
+}
+
+// Each yank is undone by itself, like a paste.
+void Subeditor::yankText(const KillRing<char>::chunk_type& text) {
+    _yankStart = _buffer->point();
+    _buffer->undoBoundary();
+    _buffer->insert(text->begin(), text->end());
+    _buffer->undoBoundary();
+    _buffer->markSet(_yankStart);
+    _yankEnd = _buffer->point();
+    _yankSize = _buffer->size();
+}
+
+// Moves point count characters forward (or backward if count is negative)
+// but not past either end of the buffer.  A character is a whole UTF-8
+// sequence along with any combining marks after it.
+void Subeditor::moveChars(int count) {
+    size_t pos = _buffer->point();
+
+    if (count < 0) {
+        pos = _buffer->previousChar(pos, -static_cast<long>(count));
+    } else {
+        pos = _buffer->nextChar(pos, count);
+    }
+
+    _buffer->pointSet(pos);
+}
+
+// Deletes count characters after point (or before it if count is
+// negative) or as many as there are, with one call to the buffer.
+void Subeditor::deleteChars(int count) {
+    size_t pos = _buffer->point();
+
+    if (count < 0) {
+        _buffer->deletePrevious(pos - _buffer->previousChar(pos,
+            -static_cast<long>(count)));
+    } else {
+        _buffer->deleteNext(_buffer->nextChar(pos, count) - pos);
+    }
+}
+
+// Moves point count lines down (or up if count is negative) staying in the
+// same column if the line is long enough or going to its end if not.
+void Subeditor::moveLines(int count) {
+    size_t pos = _buffer->point();
+    size_t line = _buffer->lineOf(pos);
+    size_t column = _buffer->column(pos);
+
+    if (count < 0) {
+        line -= min<size_t>(line, -count);
+    } else {
+        line = min<size_t>(line + count, _buffer->lines() - 1);
+    }
+
+    _buffer->pointSet(_buffer->columnStart(line, column));
+}
+
+// C-x C-s.
+bool Subeditor::save_buffer(bool& /*isArg*/, int& /*arg*/, bool& /*isExit*/,
+int /*c*/) {
+    save();
+
+    return true;
+}
+
+bool Subeditor::undo(bool& /*isArg*/, int& arg, bool& /*isExit*/,
+int /*c*/) {
     while (arg-- > 0) {
-        if (!_buffer.deletePrevious()) {
+        if (!_buffer->undo()) {
             break;
         }
     }
+
     return true;
 }
 
-bool Subeditor::delete_char(bool& /*isArg*/, int& arg, bool& /*isExit*/,
+bool Subeditor::redo(bool& /*isArg*/, int& arg, bool& /*isExit*/,
 int /*c*/) {
     while (arg-- > 0) {
-        if (!_buffer.deleteNext()) {
+        if (!_buffer->redo()) {
             break;
         }
     }
+
     return true;
 }
 
-bool Subeditor::beginning_of_line(bool& /*isArg*/, int& /*arg*/,
-bool& /*isExit*/, int /*c*/) {
-    auto result = _buffer.searchBackward('\n', _buffer.point());
+// C-SPC.
+bool Subeditor::set_mark(bool& /*isArg*/, int& /*arg*/, bool& /*isExit*/,
+int /*c*/) {
+    _buffer->markSet(_buffer->point());
 
-    if (result == _buffer.npos) {
-        _buffer.pointSet(_buffer.begin().pos());
-    } else {
-        _buffer.pointSet(result + 1);
+    return true;
+}
+
+// C-x C-x.
+bool Subeditor::exchange_point_and_mark(bool& /*isArg*/, int& /*arg*/,
+bool& /*isExit*/, int /*c*/) {
+    size_t mark = _buffer->mark();
+    if (mark != buffer_type::npos) {
+        _buffer->markSet(_buffer->point());
+        _buffer->pointSet(mark);
     }
 
     return true;
 }
 
-bool Subeditor::end_of_line(bool& /*isArg*/, int& /*arg*/, bool& /*isExit*/,
+// C-w.  The region is copied once, into the kill ring, and the buffer and
+// its undo log share that copy.
+bool Subeditor::kill_region(bool& /*isArg*/, int& /*arg*/, bool& /*isExit*/,
 int /*c*/) {
-    auto result = _buffer.searchForward('\n', _buffer.point());
+    size_t from, to;
+    if (region(from, to)) {
+        auto text = _buffer->copy(from, to);
+        _buffer->erase(from, to, text);
+        _killRing.push(text);
+    }
 
-    if (result == _buffer.npos) {
-        _buffer.pointSet(_buffer.end().pos());
-    } else {
-        _buffer.pointSet(result - 1);
+    return true;
+}
+
+// M-w.
+bool Subeditor::copy_region_as_kill(bool& /*isArg*/, int& /*arg*/,
+bool& /*isExit*/, int /*c*/) {
+    size_t from, to;
+    if (region(from, to)) {
+        _killRing.push(_buffer->copy(from, to));
     }
 
     return true;
 }
 
-bool Subeditor::next_line(bool& /*isArg*/, int& /*arg*/, bool& /*isExit*/,
+// C-y.  Inserts the last kill at point, leaving the mark at its beginning
+// and point at its end.
+bool Subeditor::yank(bool& /*isArg*/, int& /*arg*/, bool& /*isExit*/,
 int /*c*/) {
-    auto result = _buffer.searchForward('\n', _buffer.point());
+    auto text = _killRing.yank();
+    if (text) {
+        yankText(text);
+    }
 
-    if (result == _buffer.npos) {
-        _buffer.pointSet(_buffer.end().pos());
-    } else {
-        _buffer.pointSet(result + 1);
+    return true;
+}
+
+// M-y.  Straight after a yank, replaces the yanked text with the kill before
+// it.
+bool Subeditor::yank_pop(bool& /*isArg*/, int& /*arg*/, bool& /*isExit*/,
+int /*c*/) {
+    if (_buffer->mark() != _yankStart ||
+    static_cast<size_t>(_buffer->point()) != _yankEnd ||
+    _buffer->size() != _yankSize) {
+        return true;
+    }
+
+    auto text = _killRing.rotate();
+    if (text) {
+        _buffer->erase(_yankStart, _yankEnd);
+        yankText(text);
     }
 
     return true;
 }
 
-bool Subeditor::previous_line(bool& /*isArg*/, int& /*arg*/, bool& /*isExit*/,
+// C-x C-f.  Reads a file name and visits it.
+bool Subeditor::find_file(bool& /*isArg*/, int& /*arg*/, bool& /*isExit*/,
+int c) {
+    switch (readInput("Find file: ", c)) {
+        case Input::MORE:
+            return false;
+        case Input::DONE:
+            if (!_input.empty() && !visit(_input)) {
+                message("Can't open " + _input);
+            }
+            break;
+        case Input::CANCEL:
+            break;
+    }
+
+    return true;
+}
+
+// C-x b.  Reads the name of a buffer and switches to it, making it if it
+// doesn't exist.  Just Enter switches to the buffer used before this one.
+bool Subeditor::switch_to_buffer(bool& /*isArg*/, int& /*arg*/,
+bool& /*isExit*/, int c) {
+    string other = (_documents.size() > 1) ? next(_documents.begin())->_name :
+        name();
+
+    switch (readInput("Switch to buffer (default " + other + "): ", c)) {
+        case Input::MORE:
+            return false;
+        case Input::DONE:
+            switchTo(_input.empty() ? other : _input);
+            break;
+        case Input::CANCEL:
+            break;
+    }
+
+    return true;
+}
+
+// C-x k.  Kills the current buffer.
+bool Subeditor::kill_buffer(bool& /*isArg*/, int& /*arg*/, bool& /*isExit*/,
 int /*c*/) {
-    auto result = _buffer.searchBackward('\n', _buffer.point());
+    kill();
 
-    if (result == _buffer.npos) {
-        _buffer.pointSet(_buffer.begin().pos());
-    } else {
-        _buffer.pointSet(result - 1);
+    return true;
+}
+
+// C-x l.  Shows how long keys have taken and what the buffers have been
+// doing on the status line.
+bool Subeditor::show_statistics(bool& /*isArg*/, int& /*arg*/,
+bool& /*isExit*/, int /*c*/) {
+    message(_statistics.summary(counters()));
+
+    return true;
+}
+
+// C-x t.  Switches between wrapping long lines and cutting them off.
+bool Subeditor::toggle_truncate_lines(bool& /*isArg*/, int& /*arg*/,
+bool& /*isExit*/, int /*c*/) {
+    _truncateLines = !_truncateLines;
+    message(_truncateLines ? "Truncating long lines" : "Wrapping long lines");
+
+    return true;
+}
+
+// C-s.  Searches forward incrementally.
+bool Subeditor::isearch_forward(bool& /*isArg*/, int& /*arg*/,
+bool& /*isExit*/, int c) {
+    return isearch(true, c);
+}
+
+// C-r.  Searches backward incrementally.
+bool Subeditor::isearch_backward(bool& /*isArg*/, int& /*arg*/,
+bool& /*isExit*/, int c) {
+    return isearch(false, c);
+}
+
+// ESC %.  Reads a string and what to replace it with and replaces it
+// everywhere in the buffer.  Point is left after the last replacement.
+bool Subeditor::replace_string(bool& /*isArg*/, int& /*arg*/,
+bool& /*isExit*/, int c) {
+    if (_replaceFrom.empty()) {
+        Input input = readInput("Replace string: ", c);
+        if (input == Input::MORE) {
+            return false;
+        }
+        if (input == Input::CANCEL || _input.empty()) {
+            return true;
+        }
+        _replaceFrom = _input;
+        readInput("Replace " + _replaceFrom + " with: ", c);
+        return false;
+    }
+
+    Input input = readInput("Replace " + _replaceFrom + " with: ", c);
+    if (input == Input::MORE) {
+        return false;
+    }
+    string from;
+    from.swap(_replaceFrom);
+    if (input == Input::DONE) {
+        size_t n = replaceAll(from, _input);
+        message("Replaced " + to_string(n) + " occurrence" +
+            ((n == 1) ? "" : "s"));
+    }
+
+    return true;
+}
+
+// ESC #.  Reads a string and shows how many times it is in the buffer.
+bool Subeditor::count_matches(bool& /*isArg*/, int& /*arg*/,
+bool& /*isExit*/, int c) {
+    switch (readInput("Count matches for: ", c)) {
+        case Input::MORE:
+            return false;
+        case Input::DONE:
+            if (!_input.empty()) {
+                size_t n = Search<char>(_input).all(*_buffer,
+                    searchThreads()).size();
+                message(to_string(n) + " occurrence" +
+                    ((n == 1) ? "" : "s"));
+            }
+            break;
+        case Input::CANCEL:
+            break;
     }
 
     return true;
@@ -129,3 +731,260 @@ int /*c*/) {
 
     return true;
 }
+
+// Adds a new buffer after the others.  It isn't current until it is
+// selected.
+Subeditor::document_list::iterator Subeditor::create(const string& name,
+const string& filename) {
+    auto document = _documents.emplace(_documents.end(), name, filename);
+#ifdef PAGED_TEXT
+    if (_memoryLimit != 0) {
+        document->_buffer.memoryLimit(_memoryLimit);
+    }
+#endif
+    return document;
+}
+
+Subeditor::document_list::iterator Subeditor::find(const string& name) {
+    return find_if(_documents.begin(), _documents.end(),
+        [&name](const Document& document) {
+            return document._name == name;
+        });
+}
+
+// Makes document the current buffer by moving it to the front of the list.
+// Nothing is copied so this takes the same time however many buffers there
+// are or however big they are.
+void Subeditor::select(document_list::iterator document) {
+    _documents.splice(_documents.begin(), _documents, document);
+    _buffer = &document->_buffer;
+    _selections++;
+    _yankStart = _yankEnd = _yankSize = buffer_type::npos;
+}
+
+// name, or if there is already a buffer called that, name<2>, name<3> and so
+// on.
+string Subeditor::uniqueName(const string& name) {
+    string unique = name;
+    for (int i = 2; find(unique) != _documents.end(); i++) {
+        unique = name + "<" + to_string(i) + ">";
+    }
+    return unique;
+}
+
+// Starts journaling the current buffer, which has just been loaded.  If its
+// file has a journal already, the editor that left it must have died so the
+// changes in it are made again if the editor is recovering, and otherwise
+// the journal is left alone.
+void Subeditor::openJournal() {
+    const string& filename = _documents.front()._filename;
+    if (access(Journal::path(filename).c_str(), F_OK) != 0) {
+        startJournal(_documents.front(), 0);
+        return;
+    }
+
+    size_t keep = _recover ? Journal::recover(*_buffer, filename) : 0;
+    if (keep == 0) {
+        message(_recover ? "Can't recover " + filename + "; it has changed" :
+            filename + " has a journal; use --recover to recover it");
+        return;
+    }
+    startJournal(_documents.front(), keep);
+    message("Recovered changes to " + filename);
+}
+
+// Records the changes to document's buffer in its journal, keeping the first
+// keep bytes of the journal there is already.
+void Subeditor::startJournal(Document& document, size_t keep) {
+    document._journal.reset(new Journal);
+    if (document._journal->open(document._filename, keep)) {
+        document._buffer.journal(document._journal.get());
+    } else {
+        document._journal.reset();
+    }
+}
+
+// Waits for document's save to finish.  Once the file has been written the
+// changes in the journal from before the save are not needed any more; any
+// journal left behind is for the file as it was, so now it can be replaced.
+void Subeditor::finishSave(Document& document) {
+    Save& save = *document._save;
+    save._thread.join();
+    if (save._written) {
+        if (document._journal) {
+            document._journal->checkpoint();
+        } else {
+            startJournal(document, 0);
+        }
+        message("Wrote " + document._filename);
+    } else {
+        message("Can't write " + document._filename + ": " +
+            strerror(save._error));
+    }
+    document._save.reset();
+}
+
+// Reads a line of input for a command that is called once for each key.
+// The first call shows prompt on the status line and the following ones add
+// the key to what has been typed so far (or with C-h or Backspace, take the
+// last character off.)  Returns DONE when Enter is pressed and CANCEL for
+// C-g leaving what was typed in _input.
+Subeditor::Input Subeditor::readInput(const string& prompt, int c) {
+    if (!_reading) {
+        _reading = true;
+        _input.clear();
+    } else if (c == 0x0d) { // Enter
+        _reading = false;
+        _status.clear();
+        return Input::DONE;
+    } else if (c == 0x07) { // CTRL-g
+        _reading = false;
+        _status.clear();
+        return Input::CANCEL;
+    } else if (c == 0x08 || c == 0x7f || c == KEY_BACKSPACE) {
+        _input.resize(lastCharacter(_input));
+    } else if (isText(c)) {
+        _input += static_cast<char>(c);
+    }
+
+    _status = prompt + _input;
+    return Input::MORE;
+}
+
+// Searches incrementally, called once for each key.  Printable keys add to
+// the string and move to where it is found; C-s and C-r go on to the next or
+// previous match (or, before anything has been typed, search for the string
+// searched for last time, or after failing, from the other end of the
+// buffer); C-h or Backspace take back the last of those or of the
+// characters typed; Enter stops at the match and C-g goes back to where the
+// search started.  Any other key stops the search and is left in _unread to
+// be carried out as usual.
+//
+// A longer string can only match where the shorter one did or further on,
+// so each key carries on from the last match instead of starting again, and
+// once the string can't be found, adding to it doesn't search at all.
+bool Subeditor::isearch(bool forward, int c) {
+    size_t npos = Search<char>::npos;
+
+    if (_searchSteps.empty()) {
+        _searchOrigin = _buffer->point();
+        _searchString.clear();
+        _search.assign(nullptr, 0);
+        _searchSteps.push_back({ 0, _searchOrigin, forward });
+    } else if (c == 0x13 || c == 0x12) { // CTRL-s, CTRL-r
+        forward = (c == 0x13);
+        SearchStep step = _searchSteps.back();
+        if (_searchString.empty() && !_lastSearch.empty()) {
+            _searchString = _lastSearch;
+            _search.assign(_searchString.data(), _searchString.size());
+            step._match = forward ? _search.forward(*_buffer, _searchOrigin) :
+                _search.backward(*_buffer, _searchOrigin);
+        } else if (!_searchString.empty()) {
+            // After failing, go round again from the other end.
+            if (step._match == npos) {
+                step._match = forward ? _search.forward(*_buffer, 0) :
+                    _search.backward(*_buffer, _buffer->size());
+            } else if (forward) {
+                step._match = _search.forward(*_buffer, step._match + 1);
+            } else {
+                step._match = (step._match == 0) ? npos :
+                    _search.backward(*_buffer, step._match - 1);
+            }
+        }
+        _searchSteps.push_back({ _searchString.size(), step._match,
+            forward });
+    } else if (c == 0x0d) { // Enter
+        endSearch();
+        return true;
+    } else if (c == 0x07) { // CTRL-g
+        _buffer->pointSet(_searchOrigin);
+        endSearch();
+        return true;
+    } else if (c == 0x08 || c == 0x7f || c == KEY_BACKSPACE) {
+        // Each byte of a character was a step of its own, so they all go.
+        if (_searchSteps.size() > 1) {
+            size_t length = _searchSteps[_searchSteps.size() - 2]._length;
+            if (length < _searchSteps.back()._length) {
+                length = lastCharacter(_searchString);
+            }
+            _searchSteps.pop_back();
+            while (_searchSteps.size() > 1 &&
+            _searchSteps.back()._length > length) {
+                _searchSteps.pop_back();
+            }
+            _searchString.resize(_searchSteps.back()._length);
+            _search.assign(_searchString.data(), _searchString.size());
+        }
+    } else if (isText(c)) {
+        SearchStep step = _searchSteps.back();
+        _searchString += static_cast<char>(c);
+        _search.assign(_searchString.data(), _searchString.size());
+        if (step._match != npos) {
+            step._match = step._forward ?
+                _search.forward(*_buffer, step._match) :
+                _search.backward(*_buffer, step._match);
+        }
+        _searchSteps.push_back({ _searchString.size(), step._match,
+            step._forward });
+    } else {
+        _unread = c;
+        endSearch();
+        return true;
+    }
+
+    const SearchStep& step = _searchSteps.back();
+    if (step._match == npos) {
+        _status = "Failing ";
+    } else {
+        _buffer->pointSet(step._forward ? step._match + _searchString.size() :
+            step._match);
+        _status.clear();
+    }
+    _status += step._forward ? "I-search: " : "I-search backward: ";
+    _status += _searchString;
+
+    return false;
+}
+
+void Subeditor::endSearch() {
+    if (!_searchString.empty()) {
+        _lastSearch = _searchString;
+    }
+    _searchSteps.clear();
+    _status.clear();
+}
+
+// Replaces every match of from with to.  The matches are all found first
+// (in parallel) and then the text from the first to the end of the last is
+// copied out, rebuilt with the replacements in one pass and put back, so
+// the buffer itself is changed just twice however many matches there are.
+// The copy of the old text is kept for undo.  Returns how many were
+// replaced.
+size_t Subeditor::replaceAll(const string& from, const string& to) {
+    auto matches = Search<char>(from).all(*_buffer, searchThreads());
+    if (matches.empty()) {
+        return 0;
+    }
+
+    size_t first = matches.front();
+    size_t last = matches.back() + from.size();
+    auto old = _buffer->copy(first, last);
+    vector<char> text;
+    text.reserve(old->size() + matches.size() * to.size() -
+        matches.size() * from.size());
+
+    size_t pos = first;
+    for (auto match: matches) {
+        text.insert(text.end(), old->begin() + (pos - first),
+            old->begin() + (match - first));
+        text.insert(text.end(), to.begin(), to.end());
+        pos = match + from.size();
+    }
+
+    _buffer->undoBoundary();
+    _buffer->erase(first, last, old);
+    _buffer->insert(text.begin(), text.end());
+    _buffer->undoBoundary();
+
+    return matches.size();
+}
@@ -7,17 +7,107 @@
 #ifndef _SUBEDITOR_H_
 #define _SUBEDITOR_H_
 
+#include <atomic>
+#include <list>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
 #include "buffer.h"
+#include "journal.h"
+#include "killring.h"
+#include "paged.h"
+#include "piecetable.h"
+#include "pool.h"
+#include "search.h"
+#include "statistics.h"
 
 class Subeditor {
     static const std::size_t BUFFERSIZE = 80;
 
 public:
+    // Build with -DPIECE_TABLE to keep text in a piece table instead of a
+    // gap buffer, or with -DPAGED_TEXT to keep it in pages read from the file
+    // as they are needed.  Either way the storage of every buffer comes from
+    // the Pool.
+#if defined(PAGED_TEXT)
+    using buffer_type = Buffer<char, BUFFERSIZE,
+        PagedText<char, PoolAllocator<char>>>;
+#elif defined(PIECE_TABLE)
+    using buffer_type = Buffer<char, BUFFERSIZE,
+        PieceTable<char, PoolAllocator<char>>>;
+#else
+    using buffer_type = Buffer<char, BUFFERSIZE,
+        std::vector<char, PoolAllocator<char>>>;
+#endif
+
+    static const char* const SCRATCH;
+
     Subeditor();
+    Subeditor(const Subeditor&) = delete;
+    Subeditor& operator=(const Subeditor&) = delete;
 
-    Buffer<char, BUFFERSIZE>& buffer();
+    // The current buffer and what it is called.
+    buffer_type& buffer();
+    const std::string& name() const;
+    const std::string& filename() const;
     size_t point();
 
+    // How many buffers there are.
+    std::size_t buffers() const;
+
+    // Goes up every time a buffer is made current.
+    unsigned long selections() const;
+
+    // The counters of every buffer there has been, added together.
+    BufferCounters counters() const;
+    Statistics& statistics();
+
+    // How many bytes of each buffer's text to keep in memory when it is
+    // paged.  Other kinds of buffer always keep all of it.
+    void memoryLimit(std::size_t bytes);
+
+    // Whether the changes in the journal left behind by an editor that died
+    // are made again when a file is visited.  If not, a file with a journal
+    // isn't journaled until it is saved so the journal is kept.
+    void recover(bool recover);
+
+    // What the status line should show: a prompt and what has been typed
+    // after it, or a message.
+    const std::string& status() const;
+    void message(const std::string& text);
+
+    // Whether long lines are cut off at the edge of the window, which
+    // scrolls sideways to show point, rather than wrapped onto more rows.
+    bool truncating() const;
+
+    // What an incremental search is looking for, so the display can pick out
+    // the matches, or nullptr if there isn't one going on.
+    const Search<char>* searching() const;
+
+    // A key a command stopped at without using, which should be read again,
+    // or ERR if there isn't one.
+    int unread();
+
+    bool load(const std::string& filename);
+    bool visit(const std::string& filename);
+    void switchTo(const std::string& name);
+    void kill();
+
+    // Starts saving the current buffer in the background.  The text is
+    // saved as it is now; it can go on being changed meanwhile.  Returns
+    // false if it has no file.
+    bool save();
+
+    // Whether any buffer is being saved.
+    bool saving() const;
+
+    // Deals with the saves that have finished since the last call, saying
+    // so on the status line.  Returns whether there were any.
+    bool finishSaves();
+    bool insert(const std::string& text);
+    bool paste(const std::string& text);
+
     bool self_insert(bool& isArg, int& arg, bool& isExit, int c);
     bool backward_char(bool& isArg, int& arg, bool& isExit,int c);
     bool forward_char(bool& isArg, int& arg, bool& isExit, int c);
@@ -27,10 +117,107 @@ public:
     bool end_of_line(bool& isArg, int& arg, bool& isExit, int c);
     bool next_line(bool& isArg, int& arg, bool& isExit, int c);
     bool previous_line(bool& isArg, int& arg, bool& isExit, int c);
+    bool goto_line(bool& isArg, int& arg, bool& isExit, int c);
+    bool save_buffer(bool& isArg, int& arg, bool& isExit, int c);
+    bool undo(bool& isArg, int& arg, bool& isExit, int c);
+    bool redo(bool& isArg, int& arg, bool& isExit, int c);
+    bool set_mark(bool& isArg, int& arg, bool& isExit, int c);
+    bool exchange_point_and_mark(bool& isArg, int& arg, bool& isExit, int c);
+    bool kill_region(bool& isArg, int& arg, bool& isExit, int c);
+    bool copy_region_as_kill(bool& isArg, int& arg, bool& isExit, int c);
+    bool yank(bool& isArg, int& arg, bool& isExit, int c);
+    bool yank_pop(bool& isArg, int& arg, bool& isExit, int c);
+    bool find_file(bool& isArg, int& arg, bool& isExit, int c);
+    bool switch_to_buffer(bool& isArg, int& arg, bool& isExit, int c);
+    bool kill_buffer(bool& isArg, int& arg, bool& isExit, int c);
+    bool show_statistics(bool& isArg, int& arg, bool& isExit, int c);
+    bool toggle_truncate_lines(bool& isArg, int& arg, bool& isExit, int c);
+    bool isearch_forward(bool& isArg, int& arg, bool& isExit, int c);
+    bool isearch_backward(bool& isArg, int& arg, bool& isExit, int c);
+    bool replace_string(bool& isArg, int& arg, bool& isExit, int c);
+    bool count_matches(bool& isArg, int& arg, bool& isExit, int c);
     bool quit(bool& isArg, int& arg, bool& isExit, int c);
 
 private:
-    Buffer<char, BUFFERSIZE>   _buffer;
+    // A save going on in a thread of its own, which writes a snapshot of
+    // the buffer.  The snapshot is let go of here, after the thread has been
+    // joined, so the buffer knows it is done with.
+    struct Save {
+        buffer_type::snapshot_type _snapshot;
+        std::thread                _thread;
+        std::atomic<bool>          _done;
+        bool                       _written; // Once _done, whether it worked
+        int                        _error;   // and if not, why not.
+
+        explicit Save(buffer_type::snapshot_type&& snapshot);
+    };
+
+    // A buffer along with the name it goes by and the file it is saved to
+    // (if any.)
+    struct Document {
+        std::string _name;
+        std::string _filename;
+        buffer_type _buffer;
+        std::unique_ptr<Journal> _journal; // If _buffer is being journaled.
+        std::unique_ptr<Save> _save;       // If _buffer is being saved.
+
+        Document(const std::string& name, const std::string& filename);
+        ~Document();
+    };
+    using document_list = std::list<Document>;
+
+    // Where an incremental search had got to after each key, so C-h can go
+    // back a step.
+    struct SearchStep {
+        std::size_t _length;  // How much of the search string there was.
+        std::size_t _match;   // Where it was found or npos if it wasn't.
+        bool        _forward;
+    };
+
+    // Most recently used first, so the current buffer is always at the front.
+    document_list              _documents;
+    buffer_type*               _buffer;    // The current buffer's text.
+    KillRing<char>             _killRing;
+    std::size_t                _yankStart; // Where the last yank was put
+    std::size_t                _yankEnd;   // in the buffer.
+    std::size_t                _yankSize;  // The size of the buffer after it.
+    std::string                _status;
+    std::string                _input;     // Typed in answer to a prompt.
+    bool                       _reading;   // A prompt is being answered.
+    unsigned long              _selections;
+    Statistics                 _statistics;
+    BufferCounters             _killed;    // Counters of killed buffers.
+    std::size_t                _memoryLimit; // 0 for the default.
+    bool                       _recover;
+    Search<char>               _search;
+    std::string                _searchString;
+    std::string                _lastSearch;
+    std::vector<SearchStep>    _searchSteps; // Empty unless searching.
+    std::size_t                _searchOrigin; // Point before the search.
+    int                        _unread;
+    std::string                _replaceFrom; // Set once it has been read.
+    bool                       _truncateLines;
+
+    enum class Input { MORE, DONE, CANCEL };
+
+    document_list::iterator create(const std::string& name,
+        const std::string& filename);
+    document_list::iterator find(const std::string& name);
+    void select(document_list::iterator document);
+    std::string uniqueName(const std::string& name);
+    void openJournal();
+    void startJournal(Document& document, std::size_t keep);
+    void finishSave(Document& document);
+    Input readInput(const std::string& prompt, int c);
+    bool isearch(bool forward, int c);
+    void endSearch();
+    std::size_t replaceAll(const std::string& from, const std::string& to);
+    void deleteChars(int count);
+    bool region(std::size_t& from, std::size_t& to);
+    void yankText(const KillRing<char>::chunk_type& text);
+    void gotoLine(std::size_t n);
+    void moveChars(int count);
+    void moveLines(int count);
 };
 
 #endif
\ No newline at end of file
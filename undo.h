@@ -0,0 +1,312 @@
+// UndoLog -- undo and redo history for Buffer
+//
+// By Jaldhar H. Vyas <jaldhar@braincells.com>
+// Copyright (C) 2017, Consolidated Braincells Inc. All rights reserved.
+// "Do what thou wilt" shall be the whole of the license.
+//
+// Every change to a buffer is an insertion or a deletion of a run of
+// elements and is recorded as one.  Inserting right after the last insertion
+// or deleting one element next to the last deletion lengthens the last
+// record instead of adding a new one, so a record usually stands for a whole
+// run of keys and undoing it is a single insertion or deletion however long
+// the run was.  Call boundary() to keep changes apart.
+//
+// The text a record needs is kept in one arena.  Deleted text has to be
+// saved when it is deleted but inserted text is still in the buffer so it is
+// only copied to the arena when the insertion is undone (and the text is
+// needed to redo it.)  When the history takes more memory than the limit,
+// the oldest records are dropped.  The arena is only ever appended to, so
+// the text that nothing refers to any more is given back in one go once it
+// is most of the arena.  Text that has already been copied out of the buffer
+// as a TextChunk (e.g. for the kill ring) is shared instead of copied again.
+
+#ifndef _UNDO_H_
+#define _UNDO_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <deque>
+#include <iterator>
+#include <memory>
+#include <utility>
+#include <vector>
+
+// A piece of text that never changes once it has been made, so any number of
+// owners can share it.
+template<typename T>
+using TextChunk = std::shared_ptr<const std::vector<T>>;
+
+template<typename T>
+class UndoLog {
+public:
+    using size_type = std::size_t;
+
+    static const size_type DEFAULTLIMIT = size_type(128) << 20;
+
+    UndoLog() : _undo(), _redo(), _arena(), _saved{0}, _shared{0},
+    _limit{DEFAULTLIMIT}, _open{false}, _replaying{false} {
+    }
+
+    // The history is trimmed to roughly this many bytes.
+    void limit(size_type bytes) {
+        _limit = bytes;
+        trim();
+    }
+
+    // The next change starts a new record even if it could have been merged
+    // with the last one.
+    void boundary() {
+        _open = false;
+    }
+
+    void clear() {
+        _undo.clear();
+        _redo.clear();
+        _arena.clear();
+        _saved = _shared = 0;
+        _open = false;
+    }
+
+    bool canUndo() const {
+        return !_undo.empty();
+    }
+
+    bool canRedo() const {
+        return !_redo.empty();
+    }
+
+    // Approximately how much memory the history is using.
+    size_type bytes() const {
+        return (_saved + _shared) * sizeof(T) +
+            (_undo.size() + _redo.size()) * sizeof(Record);
+    }
+
+    // n elements have been inserted at pos.
+    void inserted(size_type pos, size_type n) {
+        if (_replaying || n == 0) {
+            return;
+        }
+        forget();
+
+        if (_open && !_undo.empty()) {
+            Record& last = _undo.back();
+            if (last.insert && last.text == NONE &&
+            last.pos + last.length == pos) {
+                last.length += n;
+                return;
+            }
+        }
+
+        _undo.push_back({ true, false, pos, n, NONE, nullptr });
+        _open = true;
+        trim();
+    }
+
+    // n elements at pos in buffer are about to be deleted.  backward is
+    // true if they are being deleted from the end (i.e. backspacing.)
+    template<typename B>
+    void erasing(const B& buffer, size_type pos, size_type n,
+    bool backward) {
+        if (_replaying || n == 0) {
+            return;
+        }
+        forget();
+
+        if (n == 1 && _open && !_undo.empty()) {
+            Record& last = _undo.back();
+            if (!last.insert && last.text != NONE &&
+            last.text + last.length == end() &&
+            last.reversed == backward &&
+            last.pos == (backward ? pos + 1 : pos)) {
+                save(buffer, pos, 1);
+                _saved++;
+                last.pos = pos;
+                last.length++;
+                return;
+            }
+        }
+
+        size_type text = end();
+        save(buffer, pos, n);
+        if (backward) {
+            std::reverse(_arena.begin() + text, _arena.end());
+        }
+        _saved += n;
+        _undo.push_back({ false, backward, pos, n, text, nullptr });
+        _open = true;
+        trim();
+    }
+
+    // The same but chunk already holds a copy of the elements (in order) so
+    // it is kept instead of copying them again.
+    void erasing(size_type pos, const TextChunk<T>& chunk) {
+        if (_replaying || chunk->empty()) {
+            return;
+        }
+        forget();
+
+        _undo.push_back({ false, false, pos, chunk->size(), NONE, chunk });
+        _shared += chunk->size();
+        _open = false;
+        trim();
+    }
+
+    // Reverses the last change to buffer and leaves point where it was
+    // made.  Returns false if there was nothing to undo.
+    template<typename B>
+    bool undo(B& buffer) {
+        if (_undo.empty()) {
+            return false;
+        }
+
+        Record record = std::move(_undo.back());
+        _undo.pop_back();
+        _replaying = true;
+
+        if (record.insert) {
+            if (record.text == NONE && !record.chunk) {
+                record.text = end();
+                save(buffer, record.pos, record.length);
+                _saved += record.length;
+            }
+            buffer.remove(record.pos, record.length);
+            buffer.pointSet(record.pos);
+        } else {
+            put(buffer, record);
+            buffer.pointSet(record.reversed ? record.pos + record.length :
+                record.pos);
+        }
+
+        _replaying = false;
+        _redo.push_back(record);
+        _open = false;
+        trim();
+        return true;
+    }
+
+    // Makes the last change undone again.  Returns false if there was
+    // nothing to redo.
+    template<typename B>
+    bool redo(B& buffer) {
+        if (_redo.empty()) {
+            return false;
+        }
+
+        Record record = std::move(_redo.back());
+        _redo.pop_back();
+        _replaying = true;
+
+        if (record.insert) {
+            put(buffer, record);
+            buffer.pointSet(record.pos + record.length);
+        } else {
+            buffer.remove(record.pos, record.length);
+            buffer.pointSet(record.pos);
+        }
+
+        _replaying = false;
+        _undo.push_back(record);
+        _open = false;
+        return true;
+    }
+
+private:
+    static const size_type NONE = -1;
+
+    struct Record {
+        bool         insert;   // Text was inserted, not deleted.
+        bool         reversed; // The text is in the arena back to front.
+        size_type    pos;
+        size_type    length;
+        size_type    text;     // Where the text starts in the arena or NONE.
+        TextChunk<T> chunk;    // Or the text if it is shared.
+    };
+
+    std::deque<Record> _undo;
+    std::vector<Record> _redo;
+    std::vector<T>     _arena;
+    size_type          _saved;     // How much of the arena is in use.
+    size_type          _shared;    // How much text is in chunks.
+    size_type          _limit;
+    bool               _open;      // The last record can still be merged.
+    bool               _replaying; // Changes are from undo() or redo().
+
+    size_type end() const {
+        return _arena.size();
+    }
+
+    template<typename B>
+    void save(const B& buffer, size_type pos, size_type n) {
+        buffer.for_each_segment(pos, pos + n,
+            [this](const T* data, size_type length) {
+                _arena.insert(_arena.end(), data, data + length);
+                return true;
+            });
+    }
+
+    // Inserts the text of record at its position.
+    template<typename B>
+    void put(B& buffer, const Record& record) {
+        const T* first = record.chunk ? record.chunk->data() :
+            _arena.data() + record.text;
+        const T* last = first + record.length;
+        buffer.pointSet(record.pos);
+        if (record.reversed) {
+            buffer.insert(std::reverse_iterator<const T*>(last),
+                std::reverse_iterator<const T*>(first));
+        } else {
+            buffer.insert(first, last);
+        }
+    }
+
+    void drop(const Record& record) {
+        if (record.text != NONE) {
+            _saved -= record.length;
+        } else if (record.chunk) {
+            _shared -= record.length;
+        }
+    }
+
+    // A new change means the undone ones can't be redone any more.
+    void forget() {
+        for (auto& record: _redo) {
+            drop(record);
+        }
+        _redo.clear();
+        compact();
+    }
+
+    // Drops the oldest records until the history fits in the limit.
+    void trim() {
+        while (bytes() > _limit && !_undo.empty()) {
+            drop(_undo.front());
+            _undo.pop_front();
+        }
+        compact();
+    }
+
+    // Once most of the arena is text that no record refers to, copies what
+    // is still used to a new one.  The records keep their order so the last
+    // one's text is still at the end of the arena.
+    void compact() {
+        if (_arena.size() < 2 * _saved + 4096) {
+            return;
+        }
+
+        std::vector<T> arena;
+        arena.reserve(_saved);
+        auto move = [this, &arena](Record& record) {
+            if (record.text != NONE) {
+                size_type text = arena.size();
+                arena.insert(arena.end(), _arena.begin() + record.text,
+                    _arena.begin() + record.text + record.length);
+                record.text = text;
+            }
+        };
+        std::for_each(_undo.begin(), _undo.end(), move);
+        std::for_each(_redo.begin(), _redo.end(), move);
+        _arena.swap(arena);
+    }
+};
+
+#endif
@@ -0,0 +1,124 @@
+// UTF8 -- decoding the text of a simple text editor (Interface)
+//
+// By Jaldhar H. Vyas <jaldhar@braincells.com>
+// Copyright (C) 2017, Consolidated Braincells Inc. All rights reserved.
+// "Do what thou wilt" shall be the whole of the license.
+//
+// Text is kept as bytes and only decoded to find out where characters start
+// and how wide they are when shown.  A byte which is not part of a valid
+// UTF-8 sequence is a character of its own and is shown as U+FFFD so any file
+// can be edited without being changed by accident.
+//
+// Widths are decided here rather than by wcwidth() so they don't depend on
+// the locale and are the same whether or not there is a terminal: combining
+// marks and other zero width codepoints take up no columns, East Asian wide
+// and fullwidth ones and most emoji take up two, control characters take up
+// two (they are shown as ^X) and everything else takes up one.
+
+#ifndef _UTF8_H_
+#define _UTF8_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+// What a byte which isn't valid UTF-8 decodes to.
+static const char32_t UTF8INVALID = 0xFFFD;
+
+// How far apart tab stops are.
+static const std::size_t TABSTOP = 8;
+
+// utf8Decode() for a sequence which doesn't start with an ASCII character.
+std::size_t utf8DecodeSequence(const char* first, const char* last,
+    char32_t& codepoint);
+
+// Decodes the sequence at the start of [first, last), which must not be
+// empty.  Returns its length and sets codepoint to what it stands for or, if
+// it is not valid, returns 1 and sets codepoint to UTF8INVALID.  Returns 0 if
+// the sequence is valid as far as it goes but last cuts it off.
+inline std::size_t utf8Decode(const char* first, const char* last,
+char32_t& codepoint) {
+    unsigned char c = *first;
+    if (c < 0x80) {
+        codepoint = c;
+        return 1;
+    }
+    return utf8DecodeSequence(first, last, codepoint);
+}
+
+// Writes codepoint (which must be valid) as UTF-8 to bytes, which must have
+// room for 4, and returns how many bytes that took.
+std::size_t utf8Encode(char32_t codepoint, char* bytes);
+
+// How many columns codepoint takes up if it is not printable ASCII.
+std::size_t utf8WidthTable(char32_t codepoint);
+
+// How many columns codepoint takes up, apart from tabs and newlines.
+// UTF8INVALID takes up one.
+inline std::size_t utf8Width(char32_t codepoint) {
+    return (codepoint >= 0x20 && codepoint < 0x7F) ? 1 :
+        utf8WidthTable(codepoint);
+}
+
+// Calls fn(pos, codepoint, length) for each codepoint in buffer (which can be
+// any Buffer backend) that starts in [from, to), in order.  from must be at
+// the start of one.  A sequence which starts before to is read to the end
+// even if that is after it.  fn returns false to stop early.
+template<typename B, typename F>
+void utf8ForEach(const B& buffer, std::size_t from, std::size_t to, F fn) {
+    std::size_t size = buffer.size();
+    to = std::min(to, size);
+    if (from >= to) {
+        return;
+    }
+    std::size_t pos = from;
+    std::size_t skip = 0; // Bytes of this segment decoded with the last one.
+
+    buffer.for_each_segment(from, std::min(size, to + 3),
+        [&buffer, &pos, &skip, to, size, &fn](const char* data,
+        std::size_t length) {
+            if (skip >= length) {
+                skip -= length;
+                return true;
+            }
+            const char* p = data + skip;
+            const char* end = data + length;
+            skip = 0;
+            while (p < end && pos < to) {
+                char32_t codepoint;
+                std::size_t n = utf8Decode(p, end, codepoint);
+                std::size_t have = end - p;
+                if (n == 0) {
+                    // The sequence goes on into the next segment so the rest
+                    // of it is fetched from there.
+                    char bytes[4];
+                    std::size_t want = std::min<std::size_t>(4, size - pos);
+                    std::memcpy(bytes, p, have);
+                    std::size_t got = have;
+                    buffer.for_each_segment(pos + have, pos + want,
+                        [&bytes, &got](const char* next, std::size_t count) {
+                            std::memcpy(bytes + got, next, count);
+                            got += count;
+                            return true;
+                        });
+                    n = utf8Decode(bytes, bytes + got, codepoint);
+                    if (n == 0) {
+                        n = 1;
+                        codepoint = UTF8INVALID;
+                    }
+                }
+                if (!fn(pos, codepoint, n)) {
+                    return false;
+                }
+                pos += n;
+                if (n > have) {
+                    skip = n - have;
+                    break;
+                }
+                p += n;
+            }
+            return pos < to;
+        });
+}
+
+#endif
@@ -4,39 +4,117 @@
 // Copyright (C) 2017, Consolidated Braincells Inc. All rights reserved.
 // "Do what thou wilt" shall be the whole of the license.
 
+#include <algorithm>
 #include <clocale>
 #include <csignal>
 #include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <utility>
 using namespace std;
 
+#include <langinfo.h>
+
 #include "subeditor.h"
+#include "utf8.h"
 #include "window.h"
 
-static WINDOW* _statusWin;
-static WINDOW* _titleWin;
-static WINDOW* _viewport;
+// The title line is the top row of the terminal and the status line is the
+// bottom one.  The viewport is everything in between.
+static const size_t VIEWPORTTOP = 1;
+
+// How each Face is shown.  Text in the viewport is shown in PLAIN if it has
+// no other face, and so is the status line.
+static attr_t _faces[static_cast<size_t>(Face::FACES)];
 
-static int createStatusWindow(WINDOW* win, int /*cols*/) {
-    _statusWin = win;
+// How the title line is shown.
+static attr_t _titleFace;
 
-    return OK;
+// Shows codepoint, which takes up width columns, on row of screen from column
+// on.  Tabs are shown as spaces, control characters the way unctrl() shows
+// them and C1 controls as U+FFFD like invalid bytes.
+static void addCodepoint(Screen& screen, size_t row, size_t column,
+char32_t codepoint, size_t width, attr_t attributes) {
+    if (codepoint == '\t') {
+        for (size_t i = 0; i < width; i++) {
+            screen.put(row, column + i, " ", 1, 1, attributes);
+        }
+    } else if (codepoint < 0x20 || codepoint == 0x7F) {
+        const char* text = unctrl(codepoint);
+        for (size_t i = 0; text[i] != '\0'; i++) {
+            screen.put(row, column + i, &text[i], 1, 1, attributes);
+        }
+    } else {
+        char bytes[4];
+        size_t length = utf8Encode((codepoint >= 0x80 && codepoint < 0xA0) ?
+            UTF8INVALID : codepoint, bytes);
+        screen.put(row, column, bytes, length, width, attributes);
+    }
 }
 
-static int createTitleWindow(WINDOW* win, int /*cols*/) {
-    _titleWin = win;
+// Calls fn(codepoint) for each character of text until it returns false.
+template<typename F>
+static void eachCodepoint(const string& text, F fn) {
+    const char* p = text.data();
+    const char* end = p + text.size();
+    while (p < end) {
+        char32_t codepoint;
+        size_t length = utf8Decode(p, end, codepoint);
+        if (length == 0) {
+            length = 1;
+            codepoint = UTF8INVALID;
+        }
+        if (!fn(codepoint)) {
+            break;
+        }
+        p += length;
+    }
+}
 
-    return OK;
+// Shows as much of text as fits on row of screen from column on.
+static void addText(Screen& screen, size_t row, size_t column,
+const string& text, attr_t attributes) {
+    eachCodepoint(text, [&screen, row, &column, attributes](char32_t c) {
+        size_t width = (c == '\t') ? TABSTOP - column % TABSTOP :
+            utf8Width(c);
+        if (column + width > screen.cols()) {
+            return false;
+        }
+        addCodepoint(screen, row, column, c, width, attributes);
+        column += width;
+        return true;
+    });
 }
 
-static void end(int /* sig */) {
+static void face(Face face, attr_t attributes) {
+    _faces[static_cast<size_t>(face)] = attributes;
+}
+
+static void restore() {
     curs_set(1);
     endwin();
     clear();
+}
+
+// Anything that would be done on the way out of main() is skipped, so the
+// journals of the buffers are left for recovery.
+static void end(int /* sig */) {
+    restore();
     exit(EXIT_SUCCESS);
 }
 
+Window::Window() : _topLine{0}, _topRow{0}, _leftColumn{0},
+_truncating{false}, _redrawAll{true}, _selection{0}, _title(), _status(),
+_highlight(), _highlighter(), _wrap(), _layout(), _screen() {
+}
+
+// The text is shown as UTF-8 whatever the locale says, though if it says
+// something else the terminal may not agree.
 bool Window::init(string display) {
-    setlocale(LC_ALL, "POSIX");
+    setlocale(LC_CTYPE, "");
+    if (strcmp(nl_langinfo(CODESET), "UTF-8") != 0) {
+        setlocale(LC_CTYPE, "C.UTF-8");
+    }
 
     struct sigaction act;
     act.sa_handler = end;
@@ -45,17 +123,40 @@ bool Window::init(string display) {
     sigaction(SIGINT, &act, NULL);
     sigaction(SIGSEGV, &act, NULL);
 
-    ripoffline(1, createTitleWindow);
-    ripoffline(-1, createStatusWindow);
-
     initscr();
 
     if (has_colors()) {
         start_color();
         init_pair(1, COLOR_WHITE, COLOR_BLACK);
         init_pair(2, COLOR_BLACK, COLOR_WHITE);
+        init_pair(3, COLOR_CYAN, COLOR_BLACK);
+        init_pair(4, COLOR_GREEN, COLOR_BLACK);
+        init_pair(5, COLOR_YELLOW, COLOR_BLACK);
+        init_pair(6, COLOR_MAGENTA, COLOR_BLACK);
+        init_pair(7, COLOR_BLUE, COLOR_BLACK);
+        init_pair(8, COLOR_RED, COLOR_BLACK);
+        face(Face::COMMENT, COLOR_PAIR(3));
+        face(Face::STRING, COLOR_PAIR(4));
+        face(Face::KEYWORD, COLOR_PAIR(5) | A_BOLD);
+        face(Face::NUMBER, COLOR_PAIR(6));
+        face(Face::PREPROCESSOR, COLOR_PAIR(7) | A_BOLD);
+        face(Face::WARNING, COLOR_PAIR(5));
+        face(Face::ERROR, COLOR_PAIR(8) | A_BOLD);
+        face(Face::PLAIN, COLOR_PAIR(1));
+        _titleFace = COLOR_PAIR(2);
+    } else {
+        face(Face::COMMENT, A_DIM);
+        face(Face::KEYWORD, A_BOLD);
+        face(Face::PREPROCESSOR, A_BOLD);
+        face(Face::WARNING, A_UNDERLINE);
+        face(Face::ERROR, A_BOLD | A_UNDERLINE);
+        face(Face::PLAIN, A_NORMAL);
+        _titleFace = A_NORMAL;
     }
 
+    // Curses clears the terminal the first time it is refreshed, so that is
+    // got out of the way before anything is shown.
+    refresh();
     resize();
 
     setTitle(display);
@@ -63,53 +164,394 @@ bool Window::init(string display) {
 }
 
 int Window::fini() {
-    end(0);
+    restore();
 
-    return EXIT_SUCCESS; // never actually called as end() exits.
+    return EXIT_SUCCESS;
 }
 
+// Only the lines that fit in the viewport are ever looked at and of those,
+// only the ones the buffer says have changed since last time, or which have
+// moved to other rows, are repainted (the Screen keeps the rest.)  Everything
+// is repainted if the viewport has scrolled or been resized, but only what
+// differs from what the terminal shows already is sent to it.  So the cost
+// depends on the size of the screen and the edit, not the size of the buffer
+// or of its lines.
 void Window::redisplay(Subeditor& subeditor) {
+    auto& buffer = subeditor.buffer();
+    int rows = max(static_cast<int>(_screen.rows() - VIEWPORTTOP) - 1, 1);
+    int cols = _screen.cols();
+
+    // Another buffer has been switched to.
+    if (subeditor.selections() != _selection) {
+        _selection = subeditor.selections();
+        _topLine = 0;
+        _topRow = 0;
+        _leftColumn = 0;
+        _redrawAll = true;
+        setTitle(subeditor.name());
+        _highlighter.reset(Syntax::forFile(subeditor.filename()),
+            buffer.lines());
+        _wrap.reset(cols);
+    }
+
+    if (subeditor.truncating() != _truncating) {
+        _truncating = subeditor.truncating();
+        _topRow = 0;
+        _leftColumn = 0;
+        _redrawAll = true;
+    }
+
+    if (subeditor.status() != _status) {
+        _status = subeditor.status();
+        drawStatus();
+    }
+
+    // The matches of a search in progress are shown in reverse video so
+    // everything has to be repainted when what is being searched for
+    // changes.
+    const Search<char>* search = subeditor.searching();
+    static const vector<char> nothing;
+    const vector<char>& needle = (search != nullptr) ? search->needle() :
+        nothing;
+    if (needle != _highlight) {
+        _highlight = needle;
+        _redrawAll = true;
+    }
+
+    size_t point = buffer.point();
+    size_t pointLine = buffer.lineOf(point);
+    _wrap.edited(buffer);
+    size_t pointRow = showPoint(subeditor, rows, cols, point, pointLine);
+    size_t top = _topLine;
+
+    size_t first = top;
+    size_t last = top + rows;
+    if (!_redrawAll) {
+        const BufferDamage& damage = buffer.damage();
+        if (!damage._damaged) {
+            last = first;
+        } else {
+            first = max(first, buffer.lineOf(damage._first));
+            if (!damage._lines) {
+                last = min(last, buffer.lineOf(damage._last) + 1);
+            }
+        }
+    }
+
+    // Lines which haven't changed themselves may still have to be painted
+    // again if the state they start in has, e.g. after a comment is opened
+    // above them.
+    _highlighter.edited(buffer);
+    _highlighter.prepare(buffer, top, top + rows);
+    auto restyled = _highlighter.changed();
+    restyled.first = max(restyled.first, top);
+    restyled.second = min(restyled.second, top + rows);
+    if (restyled.first < restyled.second) {
+        if (first < last) {
+            first = min(first, restyled.first);
+            last = max(last, restyled.second);
+        } else {
+            first = restyled.first;
+            last = restyled.second;
+        }
+    }
+
+    // A row is painted if the line on it has changed or if it shows another
+    // part of the text than it did, e.g. because a line above it wraps onto
+    // one more row than it did.
+    vector<ScreenRow> layout;
+    this->layout(subeditor, rows, layout);
+    vector<bool> paint(rows);
+    size_t from = buffer.size();
+    size_t to = 0;
+    for (int row = 0; row < rows; row++) {
+        const ScreenRow& screenRow = layout[row];
+        paint[row] = _redrawAll || static_cast<size_t>(row) >= _layout.size() ||
+            screenRow._line != _layout[row]._line ||
+            screenRow._row != _layout[row]._row ||
+            (screenRow._line >= first && screenRow._line < last);
+        if (paint[row] && screenRow._line != npos) {
+            from = min(from, screenRow._from);
+            to = max(to, screenRow._to);
+        }
+    }
 
-    wmove(_viewport, 0 , 0);
-    wclrtoeol(_viewport);
-    for (auto c: subeditor.buffer()) {
-        waddch(_viewport, c);
+    // Only the text about to be painted is searched.
+    match_list matches;
+    if (!_highlight.empty() && from <= to) {
+        size_t length = _highlight.size();
+        search->each(buffer, from - min(from, length - 1), to,
+            [&matches, length](size_t at) {
+                matches.emplace_back(at, at + length);
+                return true;
+            });
     }
 
-    wmove(_viewport, 0, subeditor.point());
-    wrefresh(_viewport);
+    Highlighter::span_list spans;
+    size_t spansLine = npos;
+    for (int row = 0; row < rows; row++) {
+        if (!paint[row]) {
+            continue;
+        }
+        if (layout[row]._line != npos && layout[row]._line != spansLine) {
+            spansLine = layout[row]._line;
+            _highlighter.spans(buffer, spansLine, spans);
+        }
+        drawRow(subeditor, row, layout[row], cols, matches, spans);
+    }
+    buffer.clearDamage();
+    _redrawAll = false;
+
+    int cursor = 0;
+    while (cursor < rows - 1 && (layout[cursor]._line != pointLine ||
+    layout[cursor]._row != pointRow)) {
+        cursor++;
+    }
+    size_t column = buffer.column(point) - layout[cursor]._left;
+    _screen.cursor(VIEWPORTTOP + cursor, min<size_t>(column, cols - 1));
+    subeditor.statistics().sent(_screen.update());
+
+    // Rows past the end of the buffer have no line, so the last line shown
+    // is the last one before them.
+    size_t bottom = top;
+    for (auto& screenRow: layout) {
+        if (screenRow._line != npos) {
+            bottom = screenRow._line;
+        }
+    }
+    _wrap.keep(top, bottom + 1);
+    _layout.swap(layout);
 }
 
+// Where long lines wrap depends on how wide the viewport is so they are all
+// found again.  Curses has resized stdscr, which would be painted over
+// everything at the next key if it wasn't marked as seen.
 void Window::resize() {
+    _redrawAll = true;
+
     int lines = 0, cols = 0;
     getmaxyx(stdscr, lines, cols);
+    _wrap.reset(cols);
+    wnoutrefresh(stdscr);
+
+    _screen.resize(lines, cols, _faces[static_cast<size_t>(Face::PLAIN)]);
+    drawTitle();
+    drawStatus();
+}
 
-    wbkgd(stdscr, ' ');
+void Window::setTitle(const string& display) {
+    _title = display;
+    drawTitle();
+}
+
+bool Window::highlighting() const {
+    return !_highlighter.done();
+}
 
-    if (_viewport == NULL) {
-        _viewport = subwin(stdscr, lines, cols, 0, 0);
+// Nothing is done if the buffer has been changed or switched since it was
+// last shown; the next redisplay() has to take that in first.  Otherwise the
+// screen only has to be redisplayed if lines on it turn out to have been
+// highlighted from the wrong state.
+bool Window::highlight(Subeditor& subeditor) {
+    if (subeditor.selections() != _selection ||
+    subeditor.buffer().damage()._damaged) {
+        return true;
+    }
+
+    _highlighter.lexSome(subeditor.buffer());
+    size_t first = npos;
+    size_t last = 0;
+    for (auto& screenRow: _layout) {
+        if (screenRow._line != npos) {
+            first = min(first, screenRow._line);
+            last = max(last, screenRow._line + 1);
+        }
+    }
+    return _highlighter.changedIn(first, last);
+}
+
+// Moves the viewport if need be so point is in it.  When long lines are cut
+// off it is scrolled sideways by half its width at a time.  Returns the row
+// of its line point is on (which is always 0 then.)
+size_t Window::showPoint(Subeditor& subeditor, size_t rows, size_t cols,
+size_t point, size_t pointLine) {
+    auto& buffer = subeditor.buffer();
+    size_t top = _topLine;
+    size_t topRow = _topRow;
+    size_t pointRow = 0;
+
+    if (_truncating) {
+        if (pointLine < top) {
+            top = pointLine;
+        } else if (pointLine >= top + rows) {
+            top = pointLine - rows + 1;
+        }
+        size_t column = buffer.column(point);
+        if (column < _leftColumn || column >= _leftColumn + cols) {
+            _leftColumn = (column < cols / 2) ? 0 : column - cols / 2;
+            _redrawAll = true;
+        }
     } else {
-        wresize(_viewport, lines, cols);
+        // Every line takes up at least one row so there is no need to count
+        // them if point is further down than the height of the viewport.
+        pointRow = _wrap.rowOf(buffer, pointLine, point);
+        size_t below = pointRow;
+        if (pointLine >= top && pointLine - top < rows) {
+            for (size_t line = top; line < pointLine && below < rows + topRow;
+            line++) {
+                below += _wrap.rows(buffer, line, rows + topRow - below);
+            }
+        }
+
+        if (pointLine < top || (pointLine == top && pointRow < topRow)) {
+            top = pointLine;
+            topRow = pointRow;
+        } else if (pointLine - top >= rows || below - topRow >= rows) {
+            // Point goes on the bottom row.
+            top = pointLine;
+            topRow = pointRow;
+            for (size_t up = rows - 1; up > 0;) {
+                if (topRow >= up) {
+                    topRow -= up;
+                    break;
+                }
+                if (top == 0) {
+                    topRow = 0;
+                    break;
+                }
+                up -= topRow + 1;
+                top--;
+                topRow = _wrap.rows(buffer, top) - 1;
+            }
+        }
+    }
+
+    if (top != _topLine || topRow != _topRow) {
+        _topLine = top;
+        _topRow = topRow;
+        _redrawAll = true;
     }
-    wbkgd(_viewport, ' ' | COLOR_PAIR(1));
+    return pointRow;
+}
 
-    wresize(_titleWin, 1, cols);
-    wbkgd(_titleWin, ' ' | COLOR_PAIR(2));
+// Works out which part of which line goes on each of the rows of the
+// viewport from the top down.
+void Window::layout(Subeditor& subeditor, size_t rows,
+vector<ScreenRow>& layout) {
+    auto& buffer = subeditor.buffer();
+    size_t line = _topLine;
+    size_t row = _topRow;
 
-    wresize(_statusWin, 1, cols);
-    wbkgd(_statusWin, ' ' | COLOR_PAIR(1));
+    while (layout.size() < rows) {
+        ScreenRow screenRow{ npos, 0, 0, 0, 0, 0, 0 };
+        if (line < buffer.lines()) {
+            screenRow._line = line;
+            screenRow._start = buffer.lineStart(line);
+            if (_truncating) {
+                screenRow._from = screenRow._start;
+                screenRow._to = buffer.lineEnd(line);
+                screenRow._left = _leftColumn;
+                if (_leftColumn > 0) {
+                    screenRow._from = buffer.columnStart(line, _leftColumn);
+                    screenRow._column = buffer.column(screenRow._from);
+                }
+                line++;
+            } else if (_wrap.row(buffer, line, row, screenRow._from,
+            screenRow._to, screenRow._column)) {
+                screenRow._row = row;
+                screenRow._left = screenRow._column;
+                row++;
+            } else {
+                line++;
+                row = 0;
+                continue;
+            }
+        }
+        layout.push_back(screenRow);
+    }
 }
 
-void Window::setTitle(const string& display) {
-    int lines = 0, cols = 0;
-    lines += 0; // just to prevent 'set but not used' compiler warning;
+// Paints the part of a line screenRow says on row of the viewport, cutting
+// it off at the right edge.  Each part of it is shown in its face and the
+// parts of it in matches are shown in reverse video as well.  A tab or wide
+// character which is only partly in the viewport is shown as spaces.
+void Window::drawRow(Subeditor& subeditor, int row,
+const ScreenRow& screenRow, int cols, const match_list& matches,
+const Highlighter::span_list& spans) {
+    auto& buffer = subeditor.buffer();
+    size_t y = VIEWPORTTOP + row;
+    attr_t plain = _faces[static_cast<size_t>(Face::PLAIN)];
+    size_t x = 0;
 
-    getmaxyx(_titleWin, lines, cols);
-    wclear(_titleWin);
-    mvwaddstr(_titleWin, 0, (cols - display.length()) / 2, display.c_str());
-    wnoutrefresh(_titleWin);
+    if (screenRow._line != npos) {
+        size_t column = screenRow._column;
+        size_t left = screenRow._left;
+        size_t right = left + cols;
+        size_t start = screenRow._start;
+        size_t from = screenRow._from;
+        auto match = lower_bound(matches.begin(), matches.end(),
+            make_pair(from, size_t(0)));
+        if (match != matches.begin() && prev(match)->second > from) {
+            --match;
+        }
+        auto span = lower_bound(spans.cbegin(), spans.cend(), from - start,
+            [](const FaceSpan& face, size_t offset) {
+                return face._end <= offset;
+            });
+        utf8ForEach(buffer, from, screenRow._to,
+            [this, y, &column, left, right, start, &match, &matches, &span,
+            &spans, plain](size_t at, char32_t codepoint, size_t /*length*/) {
+                size_t width = (codepoint == '\t') ?
+                    TABSTOP - column % TABSTOP : utf8Width(codepoint);
+                if (column + width > right) {
+                    return false;
+                }
+                while (match != matches.end() && match->second <= at) {
+                    ++match;
+                }
+                while (span != spans.cend() && span->_end <= at - start) {
+                    ++span;
+                }
+                attr_t attributes = plain;
+                if (span != spans.cend() && span->_start <= at - start) {
+                    attributes = _faces[static_cast<size_t>(span->_face)];
+                }
+                if (match != matches.end() && match->first <= at) {
+                    attributes |= A_REVERSE;
+                }
+                if (column >= left) {
+                    addCodepoint(_screen, y, column - left, codepoint, width,
+                        attributes);
+                } else {
+                    for (size_t i = left; i < column + width; i++) {
+                        _screen.put(y, i - left, " ", 1, 1, attributes);
+                    }
+                }
+                column += width;
+                return true;
+            });
+        x = max(column, left) - left;
+    }
+    _screen.blank(y, x, plain);
 }
 
-const WINDOW* Window::viewport() const {
-    return _viewport;
-}
\ No newline at end of file
+void Window::drawTitle() {
+    size_t width = 0;
+    eachCodepoint(_title, [&width](char32_t c) {
+        width += utf8Width(c);
+        return true;
+    });
+    size_t cols = _screen.cols();
+
+    _screen.blank(0, 0, _titleFace);
+    addText(_screen, 0, (width < cols) ? (cols - width) / 2 : 0, _title,
+        _titleFace);
+}
+
+void Window::drawStatus() {
+    size_t row = _screen.rows() - 1;
+    attr_t plain = _faces[static_cast<size_t>(Face::PLAIN)];
+
+    _screen.blank(row, 0, plain);
+    addText(_screen, row, 0, _status, plain);
+}
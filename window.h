@@ -8,18 +8,75 @@
 #define _WINDOW_H_
 
 #include <curses.h>
+#include <cstddef>
 #include <string>
+#include <utility>
+#include <vector>
+#include "highlight.h"
+#include "screen.h"
+#include "wrap.h"
 
 class Subeditor;
 
 class Window {
 public:
+    Window();
     bool init(std::string display);
     int  fini();
     void redisplay(Subeditor& subeditor);
     void resize();
     void setTitle(const std::string& display);
-    const WINDOW* viewport() const;
+
+    // Whether there is any of the current buffer still to be highlighted,
+    // and highlights some more of it.  highlight() should only be called
+    // between redisplay() and the next key.  It returns whether what is on
+    // the screen has to be redisplayed because of it.
+    bool highlighting() const;
+    bool highlight(Subeditor& subeditor);
+
+private:
+    static const std::size_t npos = -1;
+
+    // What a row of the viewport shows: the text of _line (which starts at
+    // _start) in [_from, _to), where _from is at _column of the line and the
+    // column at the left edge is _left.  _line is npos for the rows past the
+    // end of the buffer and _row is which row of it this is when it wraps.
+    struct ScreenRow {
+        std::size_t _line;
+        std::size_t _row;
+        std::size_t _start;
+        std::size_t _from;
+        std::size_t _to;
+        std::size_t _column;
+        std::size_t _left;
+    };
+
+    std::size_t   _topLine;   // The line shown at the top of the viewport
+    std::size_t   _topRow;    // and which of its rows that is.
+    std::size_t   _leftColumn; // The column at the left edge if truncating.
+    bool          _truncating; // Long lines are cut off, not wrapped.
+    bool          _redrawAll; // Every row must be repainted next time.
+    unsigned long _selection; // Which buffer was shown last time.
+    std::string   _title;     // What the title line shows.
+    std::string   _status;    // What the status line shows.
+    std::vector<char> _highlight; // The search string whose matches are shown.
+    Highlighter   _highlighter; // Colors the text of the buffer shown.
+    WrapCache     _wrap;      // Where the lines shown wrap.
+    std::vector<ScreenRow> _layout; // What each row showed last time.
+    Screen        _screen;    // What the terminal shows.
+
+    // The start and end of each match to be shown, in order.
+    using match_list = std::vector<std::pair<std::size_t, std::size_t>>;
+
+    std::size_t showPoint(Subeditor& subeditor, std::size_t rows,
+        std::size_t cols, std::size_t point, std::size_t pointLine);
+    void layout(Subeditor& subeditor, std::size_t rows,
+        std::vector<ScreenRow>& layout);
+    void drawRow(Subeditor& subeditor, int row, const ScreenRow& screenRow,
+        int cols, const match_list& matches,
+        const Highlighter::span_list& spans);
+    void drawTitle();
+    void drawStatus();
 };
 
 #endif
\ No newline at end of file
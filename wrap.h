@@ -0,0 +1,214 @@
+// Wrap -- where long lines are broken when they are shown
+//
+// By Jaldhar H. Vyas <jaldhar@braincells.com>
+// Copyright (C) 2017, Consolidated Braincells Inc. All rights reserved.
+// "Do what thou wilt" shall be the whole of the license.
+//
+// When long lines are wrapped, each line of a buffer is shown on as many
+// rows as it needs, each one starting with the first character that didn't
+// fit on the row before.  So where a row starts depends on everything before
+// it in the line, and finding it means going through the line from the start.
+// A WrapCache keeps the rows it has found for each line it has been asked
+// about, as offsets from the start of the line, and only ever finds as many
+// as it is asked for: those about to be painted and those up to point.  So a
+// line several megabytes long costs nothing past the part of it that has been
+// shown, and typing in it only finds the rows again from the one typed on.
+//
+// After an edit, the line it starts on keeps the rows before the edit and the
+// lines it covers are forgotten.  Lines after it keep their rows, unless lines
+// were added or removed, since the rows are relative to the start of the line.
+// A change of width forgets everything.
+//
+//     WrapCache wrap;
+//     wrap.reset(80);
+//     std::size_t from, to, column;
+//     wrap.row(buffer, 0, 2, from, to, column);
+
+#ifndef _WRAP_H_
+#define _WRAP_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+#include "columnindex.h"
+#include "utf8.h"
+
+class WrapCache {
+public:
+    static const std::size_t npos = -1;
+
+    WrapCache() : _width{0}, _lines() {
+    }
+
+    // Forgets every line.  Rows are width columns wide from now on.
+    void reset(std::size_t width) {
+        _width = width;
+        _lines.clear();
+    }
+
+    std::size_t width() const {
+        return _width;
+    }
+
+    // Takes in buffer's damage.  This has to be done once for each edit (or
+    // run of edits) before the damage is cleared.
+    template<typename B>
+    void edited(const B& buffer) {
+        const auto& damage = buffer.damage();
+        if (!damage._damaged || _lines.empty()) {
+            return;
+        }
+
+        std::size_t first = buffer.lineOf(damage._first);
+        std::size_t last = damage._lines ? npos : buffer.lineOf(damage._last);
+        std::size_t offset = damage._first - buffer.lineStart(first);
+        for (auto i = _lines.begin(); i != _lines.end();) {
+            if (i->first == first) {
+                truncate(i->second, offset);
+            } else if (i->first > first && i->first <= last) {
+                i = _lines.erase(i);
+                continue;
+            }
+            ++i;
+        }
+    }
+
+    // Finds row n of line.  Returns false if line doesn't have that many.
+    // Otherwise sets from and to to where the row starts and ends in buffer
+    // and column to the column of the line the row starts at.
+    template<typename B>
+    bool row(const B& buffer, std::size_t line, std::size_t n,
+    std::size_t& from, std::size_t& to, std::size_t& column) {
+        Rows& rows = find(line);
+        extend(buffer, line, rows, n + 1, npos);
+        if (n >= rows._rows.size()) {
+            return false;
+        }
+
+        std::size_t start = buffer.lineStart(line);
+        from = start + rows._rows[n]._offset;
+        to = (n + 1 < rows._rows.size()) ? start + rows._rows[n + 1]._offset :
+            buffer.lineEnd(line);
+        column = rows._rows[n]._column;
+        return true;
+    }
+
+    // The row of line that pos (which must be on it) is on.  A position at
+    // the start of a row is on that row, not at the end of the one before.
+    template<typename B>
+    std::size_t rowOf(const B& buffer, std::size_t line, std::size_t pos) {
+        Rows& rows = find(line);
+        std::size_t offset = pos - buffer.lineStart(line);
+        extend(buffer, line, rows, npos, offset);
+        auto next = std::upper_bound(rows._rows.begin(), rows._rows.end(),
+            offset, [](std::size_t value, const Row& row) {
+                return value < row._offset;
+            });
+        return (next - rows._rows.begin()) - 1;
+    }
+
+    // How many rows line takes up, or most if that is fewer.  Only as many
+    // as that are found.
+    template<typename B>
+    std::size_t rows(const B& buffer, std::size_t line,
+    std::size_t most = npos) {
+        Rows& rows = find(line);
+        extend(buffer, line, rows, most - 1, npos);
+        return std::min(rows._rows.size(), most);
+    }
+
+    // Forgets the lines outside [first, last).
+    void keep(std::size_t first, std::size_t last) {
+        for (auto i = _lines.begin(); i != _lines.end();) {
+            if (i->first < first || i->first >= last) {
+                i = _lines.erase(i);
+            } else {
+                ++i;
+            }
+        }
+    }
+
+private:
+    // Where a row starts in its line and the column of the line that is at.
+    struct Row {
+        std::size_t _offset;
+        std::size_t _column;
+    };
+
+    // The rows of a line found so far and whether that is all of them.
+    struct Rows {
+        std::vector<Row> _rows;
+        bool             _done;
+    };
+
+    std::size_t                          _width;
+    std::unordered_map<std::size_t, Rows> _lines;
+
+    Rows& find(std::size_t line) {
+        auto found = _lines.find(line);
+        if (found == _lines.end()) {
+            found = _lines.emplace(line, Rows{ { Row{0, 0} }, false }).first;
+        }
+        return found->second;
+    }
+
+    // Forgets the rows that may have changed because of an edit at offset.
+    // Row 0 always starts at the start of the line.
+    static void truncate(Rows& rows, std::size_t offset) {
+        auto next = std::lower_bound(rows._rows.begin() + 1, rows._rows.end(),
+            offset, [](const Row& row, std::size_t value) {
+                return row._offset < value;
+            });
+        rows._rows.erase(next, rows._rows.end());
+        rows._done = false;
+    }
+
+    // Finds more rows of line until it has more than n, or one starts past
+    // offset, or there are no more.
+    template<typename B>
+    void extend(const B& buffer, std::size_t line, Rows& rows, std::size_t n,
+    std::size_t offset) {
+        if (rows._done || rows._rows.size() > n ||
+        rows._rows.back()._offset > offset) {
+            return;
+        }
+
+        std::size_t start = buffer.lineStart(line);
+        std::size_t end = buffer.lineEnd(line);
+        Row row = rows._rows.back();
+        std::size_t column = row._column;
+        std::size_t width = _width;
+        bool stopped = false;
+        utf8ForEach(buffer, start + row._offset, end,
+            [&rows, &row, &column, &stopped, start, width, n, offset](
+            std::size_t pos, char32_t codepoint, std::size_t) {
+                std::size_t advance = (codepoint == '\t') ?
+                    TextAdvance::tabStop(column) - column :
+                    utf8Width(codepoint);
+                if (column > row._column &&
+                column + advance - row._column > width) {
+                    row = Row{ pos - start, column };
+                    rows._rows.push_back(row);
+                    if (rows._rows.size() > n || row._offset > offset) {
+                        stopped = true;
+                        return false;
+                    }
+                }
+                column += advance;
+                return true;
+            });
+        if (stopped) {
+            return;
+        }
+
+        // A line that fills its last row exactly has another, empty, row
+        // after it for point to be on at the end of the line.
+        if (width > 0 && column - row._column >= width) {
+            rows._rows.push_back(Row{ end - start, column });
+        }
+        rows._done = true;
+    }
+};
+
+#endif